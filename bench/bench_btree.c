@@ -0,0 +1,132 @@
+// Benchmark da Árvore B de um diretório: vazão de inserção e busca para
+// diretórios com 1k, 100k e 1M entradas. A ordem é fixada na compilação
+// (-DBTREE_ORDER=N); use 'make bench-orders' para comparar várias ordens e
+// 'make bench-simd' para comparar as versões da comparação de prefixos.
+//
+// A coluna "strcmp" mede a busca antiga, que compara o nome de cada chave
+// via ponteiro para o TreeNode, sobre a mesma árvore.
+//
+// Uso: bench_btree [n1 n2 ...]
+
+#define _POSIX_C_SOURCE 200809L
+#include "../filesystem.h"
+#include "bench_util.h"
+
+// Estado do gerador (bench_util.h) que embaralha as chaves
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static void shuffle(TreeNode **items, size_t n)
+{
+    for (size_t i = n - 1; i > 0; i--)
+    {
+        size_t j = rng_next(&rng_state) % (i + 1);
+        TreeNode *tmp = items[i];
+        items[i] = items[j];
+        items[j] = tmp;
+    }
+}
+
+// Busca sem os prefixos inline: busca binária com strcmp nos nomes das chaves
+static TreeNode *search_strcmp(BTree *tree, const char *name)
+{
+    BTreeNode *node = tree->root;
+    while (node)
+    {
+        int lo = 0, hi = node->num_keys;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (strcmp(tree_node_name(node->keys[mid]), name) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < node->num_keys && strcmp(tree_node_name(node->keys[lo]), name) == 0)
+            return node->keys[lo];
+        node = node->leaf ? NULL : node->children[lo];
+    }
+    return NULL;
+}
+
+static const char *simd_name(void)
+{
+#if defined(BTREE_NO_SIMD)
+    return "escalar";
+#elif defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "escalar";
+#endif
+}
+
+static int tree_height(BTree *tree)
+{
+    int h = 0;
+    for (BTreeNode *node = tree->root; node; node = node->leaf ? NULL : node->children[0])
+        h++;
+    return h;
+}
+
+static void run(size_t n)
+{
+    FileSystem *fs = fs_create();
+    TreeNode **items = (TreeNode **)malloc(n * sizeof(TreeNode *));
+    char name[32];
+    for (size_t i = 0; i < n; i++)
+    {
+        snprintf(name, sizeof(name), "arquivo_%08zu.txt", i);
+        items[i] = create_txt_file(name, "", fs->root);
+    }
+    shuffle(items, n);
+
+    BTree *tree = btree_create(&fs->alloc);
+    double t0 = now_sec();
+    for (size_t i = 0; i < n; i++)
+        btree_insert(tree, items[i]);
+    double t_insert = now_sec() - t0;
+
+    shuffle(items, n);
+    size_t found = 0;
+    t0 = now_sec();
+    for (size_t i = 0; i < n; i++)
+        found += btree_search(tree, tree_node_name(items[i])) == items[i];
+    double t_search = now_sec() - t0;
+
+    shuffle(items, n);
+    size_t found_strcmp = 0;
+    t0 = now_sec();
+    for (size_t i = 0; i < n; i++)
+        found_strcmp += search_strcmp(tree, tree_node_name(items[i])) == items[i];
+    double t_strcmp = now_sec() - t0;
+
+    if (found != n || found_strcmp != n)
+        fprintf(stderr, "ERRO: %zu/%zu de %zu chaves encontradas\n", found, found_strcmp, n);
+
+    printf("%5d  %-7s  %9zu  %6d  %12.0f  %12.0f  %9.1f  %9.1f  %9.1f\n",
+           BTREE_ORDER, simd_name(), n, tree_height(tree),
+           n / t_insert, n / t_search,
+           t_insert * 1e9 / n, t_search * 1e9 / n, t_strcmp * 1e9 / n);
+
+    btree_destroy(tree); // libera também os TreeNodes
+    fs_destroy(fs);
+    free(items);
+}
+
+int main(int argc, char **argv)
+{
+    size_t default_sizes[] = {1000, 100000, 1000000};
+    printf("ordem  simd      entradas  altura  insert(op/s)  search(op/s)  insert(ns) search(ns) strcmp(ns)\n");
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+            run((size_t)strtoull(argv[i], NULL, 10));
+    }
+    else
+    {
+        for (size_t i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++)
+            run(default_sizes[i]);
+    }
+    return 0;
+}
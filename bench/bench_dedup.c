@@ -0,0 +1,99 @@
+// Custo e ganho do armazenamento por conteúdo: cria N arquivos com corpos de
+// vários tamanhos, tirados de um conjunto pequeno de corpos (repetidos) ou
+// todos diferentes (únicos), e mede o tempo de criação e os bytes lógicos e
+// físicos. O mesmo fonte é compilado com o FILE_DEDUP_MIN padrão e com o
+// armazenamento desligado (FILE_DEDUP_MIN=SIZE_MAX), para comparar.
+//
+// A saída é uma linha JSON por medição, como a de bench_fs:
+//   {"dedup_min":...,"tamanho":...,"corpos":"repetidos","ns_por_arquivo":...,
+//    "bytes_logicos":...,"bytes_fisicos":...,"rss_kib":...}
+//
+// Uso: bench_dedup [n] [tamanhos ...]
+
+#define _POSIX_C_SOURCE 200809L
+#include "../filesystem.h"
+#include "bench_util.h"
+
+#define DISTINCT_BODIES 64
+#define MAX_SIZES 32
+
+// Corpo número 'id' com 'size' letras (diferentes para ids diferentes)
+static void fill_body(char *body, size_t size, unsigned long long id)
+{
+    unsigned long long rng = 88172645463325252ULL ^ (id * 0x9E3779B97F4A7C15ULL);
+    for (size_t i = 0; i < size; i++)
+    {
+        body[i] = (char)('a' + rng_next(&rng) % 26);
+    }
+    body[size] = '\0';
+}
+
+static void bench_run(size_t n, size_t size, bool repeated)
+{
+    char **bodies = (char **)malloc(DISTINCT_BODIES * sizeof(char *));
+    for (int b = 0; b < DISTINCT_BODIES; b++)
+    {
+        bodies[b] = (char *)malloc(size + 1);
+        fill_body(bodies[b], size, (unsigned long long)b);
+    }
+    char *unique = (char *)malloc(size + 1);
+    char name[32];
+
+    FileSystem *fs = fs_create();
+    long rss0 = current_rss();
+    double elapsed = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const char *body = bodies[i % DISTINCT_BODIES];
+        if (!repeated)
+        {
+            // O corpo único é montado fora da medição
+            fill_body(unique, size, DISTINCT_BODIES + i);
+            body = unique;
+        }
+        snprintf(name, sizeof(name), "f%08zu.txt", i);
+        double t0 = now_ns();
+        TreeNode *node = create_txt_file(name, body, fs->root);
+        elapsed += now_ns() - t0;
+        directory_add_entry(fs->root, node);
+    }
+    long rss = current_rss() - rss0;
+
+    FsContentStats content;
+    fs_content_stats(&fs->alloc.content, &content);
+    printf("{\"dedup_min\":%lld,\"tamanho\":%zu,\"corpos\":\"%s\",\"ns_por_arquivo\":%.1f,"
+           "\"bytes_logicos\":%llu,\"bytes_fisicos\":%zu,\"rss_kib\":%ld}\n",
+           FILE_DEDUP_MIN == SIZE_MAX ? -1LL : (long long)FILE_DEDUP_MIN, size, repeated ? "repetidos" : "unicos",
+           elapsed / n, (unsigned long long)fs->root->totals.bytes, content.chunk_bytes, rss / 1024);
+    fflush(stdout);
+
+    fs_destroy(fs);
+    for (int b = 0; b < DISTINCT_BODIES; b++)
+        free(bodies[b]);
+    free(bodies);
+    free(unique);
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = (argc > 1) ? (size_t)strtoull(argv[1], NULL, 10) : 100000;
+    size_t default_sizes[] = {8, 32, 64, 256, 1024, 4096, 16384};
+    size_t sizes[MAX_SIZES];
+    int size_count = 0;
+    for (int a = 2; a < argc && size_count < MAX_SIZES; a++)
+        sizes[size_count++] = (size_t)strtoull(argv[a], NULL, 10);
+    if (size_count == 0)
+    {
+        for (size_t i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++)
+            sizes[size_count++] = default_sizes[i];
+    }
+    if (n == 0)
+        return 0;
+
+    for (int i = 0; i < size_count; i++)
+    {
+        bench_run(n, sizes[i], true);
+        bench_run(n, sizes[i], false);
+    }
+    return 0;
+}
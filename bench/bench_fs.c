@@ -0,0 +1,248 @@
+// Suíte de benchmarks das operações principais da Árvore B e do sistema de
+// arquivos: btree_insert, btree_search, btree_delete, btree_traverse,
+// create_directory e get_current_path, com três distribuições de nomes:
+//
+//   sequencial   nomes em ordem crescente, inseridos nessa ordem
+//   aleatoria    nomes aleatórios, inseridos em ordem aleatória
+//   prefixo      nomes com um prefixo comum de 26 bytes (maior que o prefixo
+//                inline de 16 bytes), inseridos em ordem aleatória
+//
+// A saída é uma linha JSON por medição, para comparar versões:
+//   {"op":"insert","dist":"aleatoria","n":100000,"ordem":3,"ops_por_seg":...,
+//    "p50_ns":...,"p90_ns":...,"p99_ns":...,"max_ns":...,"pico_rss_kb":...}
+//
+// As latências de cada operação são medidas uma a uma; o traverse percorre a
+// árvore inteira, então as amostras são as de cada repetição divididas pelo
+// número de entradas.
+//
+// Uso: bench_fs [n1 n2 ...]
+
+#define _POSIX_C_SOURCE 200809L
+#include "../filesystem.h"
+#include "bench_util.h"
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define TRAVERSE_RUNS 5
+#define PATH_DEPTH 16
+
+typedef enum {
+    DIST_SEQUENTIAL,
+    DIST_RANDOM,
+    DIST_SHARED_PREFIX,
+    DIST_COUNT
+} Distribution;
+
+static const char *dist_names[DIST_COUNT] = {"sequencial", "aleatoria", "prefixo"};
+
+// Estado do gerador (bench_util.h)
+static unsigned long long rng_state = 88172645463325252ULL;
+
+static void shuffle(char **names, size_t n)
+{
+    for (size_t i = n - 1; i > 0; i--)
+    {
+        size_t j = rng_next(&rng_state) % (i + 1);
+        char *tmp = names[i];
+        names[i] = names[j];
+        names[j] = tmp;
+    }
+}
+
+// Gera n nomes distintos, já na ordem em que serão inseridos
+static char **make_names(Distribution dist, size_t n)
+{
+    char **names = (char **)malloc(n * sizeof(char *));
+    char buf[64];
+    for (size_t i = 0; i < n; i++)
+    {
+        if (dist == DIST_SEQUENTIAL)
+            snprintf(buf, sizeof(buf), "arquivo_%08zu.txt", i);
+        else if (dist == DIST_RANDOM)
+            snprintf(buf, sizeof(buf), "%08llx_%zu.txt", rng_next(&rng_state) & 0xFFFFFFFFULL, i);
+        else
+            snprintf(buf, sizeof(buf), "relatorio_financeiro_2024_%08llx_%zu.txt", rng_next(&rng_state) & 0xFFFFFFFFULL, i);
+        names[i] = strdup(buf);
+    }
+    if (dist != DIST_SEQUENTIAL)
+        shuffle(names, n);
+    return names;
+}
+
+static void free_names(char **names, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        free(names[i]);
+    free(names);
+}
+
+static long peak_rss_kb(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Imprime uma linha de resultado. 'samples' tem a latência de cada operação
+// (é reordenado); 'total_ns' é o tempo do lote inteiro.
+static void report(const char *op, Distribution dist, size_t n, double *samples, size_t count, double total_ns, size_t ops)
+{
+    qsort(samples, count, sizeof(double), compare_double);
+    printf("{\"op\":\"%s\",\"dist\":\"%s\",\"n\":%zu,\"ordem\":%d,"
+           "\"ops_por_seg\":%.0f,\"p50_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f,\"max_ns\":%.1f,"
+           "\"pico_rss_kb\":%ld}\n",
+           op, dist_names[dist], n, BTREE_ORDER,
+           ops / (total_ns / 1e9),
+           percentile(samples, count, 0.50), percentile(samples, count, 0.90),
+           percentile(samples, count, 0.99), samples[count - 1], peak_rss_kb());
+    fflush(stdout);
+}
+
+// btree_insert, btree_search, btree_traverse e btree_delete numa mesma árvore
+static void bench_btree(Distribution dist, size_t n, double *samples)
+{
+    FileSystem *fs = fs_create();
+    char **names = make_names(dist, n);
+    TreeNode **items = (TreeNode **)malloc(n * sizeof(TreeNode *));
+    for (size_t i = 0; i < n; i++)
+        items[i] = create_txt_file(names[i], "", fs->root);
+    BTree *tree = btree_create(&fs->alloc);
+
+    double start = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        double t0 = now_ns();
+        btree_insert(tree, items[i]);
+        samples[i] = now_ns() - t0;
+    }
+    report("insert", dist, n, samples, n, now_ns() - start, n);
+
+    shuffle(names, n);
+    size_t found = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        double t0 = now_ns();
+        found += btree_search(tree, names[i]) != NULL;
+        samples[i] = now_ns() - t0;
+    }
+    report("search", dist, n, samples, n, now_ns() - start, n);
+    if (found != n)
+        fprintf(stderr, "ERRO: %zu de %zu chaves encontradas\n", found, n);
+
+    // O traverse imprime cada entrada: a saída vai para /dev/null durante a medição
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    double runs[TRAVERSE_RUNS];
+    start = now_ns();
+    for (int r = 0; r < TRAVERSE_RUNS; r++)
+    {
+        double t0 = now_ns();
+        btree_traverse(tree->root, false);
+        fflush(stdout);
+        runs[r] = (now_ns() - t0) / n;
+    }
+    double total = now_ns() - start;
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(devnull);
+    report("traverse", dist, n, runs, TRAVERSE_RUNS, total, n * TRAVERSE_RUNS);
+
+    shuffle(names, n);
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        double t0 = now_ns();
+        btree_delete(tree, names[i]);
+        samples[i] = now_ns() - t0;
+    }
+    report("delete", dist, n, samples, n, now_ns() - start, n);
+
+    btree_destroy(tree);
+    fs_destroy(fs);
+    free(items);
+    free_names(names, n);
+}
+
+// create_directory (com a inserção no pai) e get_current_path em diretórios
+// aninhados: cadeias de PATH_DEPTH níveis a partir da raiz
+static void bench_directories(Distribution dist, size_t n, double *samples)
+{
+    FileSystem *fs = fs_create();
+    char **names = make_names(dist, n);
+    Directory **dirs = (Directory **)malloc(n * sizeof(Directory *));
+
+    double start = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        Directory *parent = (i % PATH_DEPTH == 0) ? fs->root : dirs[i - 1];
+        double t0 = now_ns();
+        TreeNode *node = create_directory(names[i], parent);
+        directory_add_entry(parent, node);
+        samples[i] = now_ns() - t0;
+        dirs[i] = node->data.directory;
+    }
+    report("create_directory", dist, n, samples, n, now_ns() - start, n);
+
+    // Primeira chamada monta o caminho; as seguintes devolvem o guardado
+    size_t total_len = 0;
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        double t0 = now_ns();
+        total_len += strlen(get_current_path(dirs[i]));
+        samples[i] = now_ns() - t0;
+    }
+    report("get_current_path_frio", dist, n, samples, n, now_ns() - start, n);
+
+    start = now_ns();
+    for (size_t i = 0; i < n; i++)
+    {
+        Directory *dir = dirs[rng_next(&rng_state) % n];
+        double t0 = now_ns();
+        total_len += strlen(get_current_path(dir));
+        samples[i] = now_ns() - t0;
+    }
+    report("get_current_path", dist, n, samples, n, now_ns() - start, n);
+    if (total_len == 0)
+        fprintf(stderr, "ERRO: caminhos vazios\n");
+
+    fs_destroy(fs);
+    free(dirs);
+    free_names(names, n);
+}
+
+int main(int argc, char **argv)
+{
+    size_t default_sizes[] = {1000, 10000, 100000};
+    size_t sizes[64];
+    size_t size_count = 0;
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc && size_count < 64; i++)
+            sizes[size_count++] = (size_t)strtoull(argv[i], NULL, 10);
+    }
+    else
+    {
+        for (size_t i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++)
+            sizes[size_count++] = default_sizes[i];
+    }
+
+    for (size_t s = 0; s < size_count; s++)
+    {
+        size_t n = sizes[s];
+        if (n == 0)
+            continue;
+        double *samples = (double *)malloc(n * sizeof(double));
+        for (int d = 0; d < DIST_COUNT; d++)
+        {
+            bench_btree((Distribution)d, n, samples);
+            bench_directories((Distribution)d, n, samples);
+        }
+        free(samples);
+    }
+    return 0;
+}
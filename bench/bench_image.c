@@ -0,0 +1,61 @@
+// Tempo de gravação e carga da imagem binária. Monta um sistema de arquivos
+// com N arquivos (metade num único diretório grande e metade espalhada em
+// diretórios de 1000 entradas), salva com fs_image_save e carrega com
+// fs_image_load.
+//
+// Uso: bench_image [n] [arquivo.img]
+
+#define _POSIX_C_SOURCE 200809L
+#include "../fs_image.h"
+#include "bench_util.h"
+#include <sys/stat.h>
+
+int main(int argc, char **argv)
+{
+    size_t n = (argc > 1) ? (size_t)strtoull(argv[1], NULL, 10) : 1000000;
+    const char *filename = (argc > 2) ? argv[2] : "bench/bench_image.img";
+    char name[32];
+
+    FileSystem *fs = fs_create();
+    TreeNode *big = create_directory("grande", fs->root);
+    btree_insert(fs->root->tree, big);
+    for (size_t i = 0; i < n / 2; i++)
+    {
+        snprintf(name, sizeof(name), "arquivo_%08zu.txt", i);
+        btree_insert(big->data.directory->tree, create_txt_file(name, "conteudo do arquivo", big->data.directory));
+    }
+    Directory *small = NULL;
+    for (size_t i = 0; i < n - n / 2; i++)
+    {
+        if (i % 1000 == 0)
+        {
+            snprintf(name, sizeof(name), "pasta_%06zu", i / 1000);
+            TreeNode *dir_node = create_directory(name, fs->root);
+            btree_insert(fs->root->tree, dir_node);
+            small = dir_node->data.directory;
+        }
+        snprintf(name, sizeof(name), "item_%04zu.txt", i % 1000);
+        btree_insert(small->tree, create_txt_file(name, "abc", small));
+    }
+
+    double t0 = now_sec();
+    if (fs_image_save(fs->root, filename, false) != 0)
+        return 1;
+    double t_save = now_sec() - t0;
+
+    t0 = now_sec();
+    FileSystem *loaded = fs_image_load(filename);
+    double t_load = now_sec() - t0;
+    if (!loaded)
+        return 1;
+
+    struct stat st;
+    stat(filename, &st);
+    printf("entradas: %zu  imagem: %.1f MiB  save: %.3f s  load: %.3f s (%.0f entradas/s)\n",
+           n, st.st_size / (1024.0 * 1024.0), t_save, t_load, n / t_load);
+
+    fs_destroy(loaded);
+    fs_destroy(fs);
+    remove(filename);
+    return 0;
+}
@@ -0,0 +1,100 @@
+// Busca pelo número do inode (fs_inode_visit, o caminho do 'stat -i') contra a
+// busca pelo caminho (path_lookup), com N arquivos em diretórios de 1000. Os
+// itens são sorteados com um gerador fixo, então duas execuções buscam os
+// mesmos. A tabela de inodes precisa continuar O(1) com dezenas de milhões
+// de entradas: o tempo por busca não deve crescer com N além do efeito da cache.
+//
+// A saída é uma linha JSON por medição, como a de bench_fs:
+//   {"modo":"inode","arquivos":...,"ns_por_busca":...,"rss_kib":...}
+//   {"modo":"caminho","arquivos":...,"ns_por_busca":...,"rss_kib":...}
+//
+// Uso: bench_inode [n1 n2 ...]   (padrão: 100000 1000000 10000000)
+
+#define _POSIX_C_SOURCE 200809L
+#include "../filesystem.h"
+#include "bench_util.h"
+
+#define DIR_FILES 1000
+#define LOOKUPS 1000000
+
+static void print_result(const char *mode, size_t count, double ns, long rss)
+{
+    printf("{\"modo\":\"%s\",\"arquivos\":%zu,\"ns_por_busca\":%.1f,\"rss_kib\":%ld}\n", mode, count, ns, rss / 1024);
+    fflush(stdout);
+}
+
+static void count_visit(TreeNode *node, uint64_t parent, void *ctx)
+{
+    (void)parent;
+    *(size_t *)ctx += node->type == FILE_TYPE;
+}
+
+static void run(size_t n)
+{
+    FileSystem *fs = fs_create();
+    uint64_t *inos = (uint64_t *)malloc(n * sizeof(uint64_t));
+    char name[48];
+    Directory *dir = NULL;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i % DIR_FILES == 0)
+        {
+            snprintf(name, sizeof(name), "d%06zu", i / DIR_FILES);
+            TreeNode *node = create_directory(name, fs->root);
+            directory_add_entry(fs->root, node);
+            dir = node->data.directory;
+        }
+        snprintf(name, sizeof(name), "f%06zu.txt", i % DIR_FILES);
+        TreeNode *file = create_txt_file(name, "", dir);
+        directory_add_entry(dir, file);
+        inos[i] = tree_node_ino(file);
+    }
+    long rss = current_rss();
+
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    size_t found = 0;
+    double start = now_ns();
+    for (size_t k = 0; k < LOOKUPS; k++)
+        fs_inode_visit(&fs->alloc.inodes, inos[rng_next(&state) % n], count_visit, &found);
+    double inode_ns = (now_ns() - start) / LOOKUPS;
+
+    state = 0x9E3779B97F4A7C15ULL;
+    size_t found_path = 0;
+    start = now_ns();
+    for (size_t k = 0; k < LOOKUPS; k++)
+    {
+        size_t i = rng_next(&state) % n;
+        snprintf(name, sizeof(name), "/d%06zu/f%06zu.txt", i / DIR_FILES, i % DIR_FILES);
+        PathLookup lookup;
+        if (path_lookup(fs->root, name, &lookup, LOOKUP_READ) && lookup.node)
+            found_path++;
+        path_lookup_free(&lookup);
+    }
+    double path_ns = (now_ns() - start) / LOOKUPS;
+
+    if (found != LOOKUPS || found_path != LOOKUPS)
+        fprintf(stderr, "ERRO: %zu/%zu buscas pelo inode e %zu/%zu pelo caminho acharam o arquivo\n",
+                found, (size_t)LOOKUPS, found_path, (size_t)LOOKUPS);
+    print_result("inode", n, inode_ns, rss);
+    print_result("caminho", n, path_ns, rss);
+    free(inos);
+    fs_destroy(fs);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        run(100000);
+        run(1000000);
+        run(10000000);
+        return 0;
+    }
+    for (int a = 1; a < argc; a++)
+    {
+        size_t n = (size_t)strtoull(argv[a], NULL, 10);
+        if (n > 0)
+            run(n);
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Taxa de compressão e vazão do codec LZ (fs_lz.c) nas duas direções, com
+// blocos do tamanho dos blocos dos arquivos (4 KiB) e dos quadros da imagem
+// (64 KiB), para três tipos de conteúdo:
+//
+//   texto      palavras de um vocabulário pequeno, como os arquivos de texto
+//   log        linhas quase iguais, com números que mudam
+//   aleatorio  bytes sem padrão (o pior caso: nada comprime)
+//
+// Cada medição comprime e descomprime todos os blocos do volume pedido
+// (64 MB por padrão) várias vezes e confere que a volta dá o original.
+//
+// A saída é uma linha JSON por medição, como a de bench_fs:
+//   {"conteudo":"texto","bloco":4096,"taxa":...,"compressao_mb_s":...,
+//    "descompressao_mb_s":...}
+//
+// Uso: bench_lz [megabytes]
+
+#define _POSIX_C_SOURCE 200809L
+#include "../fs_lz.h"
+#include "bench_util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ROUNDS 5
+
+static void fill_text(char *buf, size_t size, unsigned long long *rng)
+{
+    static const char *words[] = {"o", "sistema", "de", "arquivos", "guarda", "cada", "diretório", "numa",
+                                  "árvore", "com", "nomes", "em", "ordem", "e", "os", "blocos", "do",
+                                  "conteúdo", "são", "divididos", "entre", "as", "cópias", "quando", "possível"};
+    size_t count = sizeof(words) / sizeof(words[0]);
+    size_t pos = 0;
+    while (pos < size)
+    {
+        const char *w = words[rng_next(rng) % count];
+        for (; *w && pos < size; w++)
+            buf[pos++] = *w;
+        if (pos < size)
+            buf[pos++] = (rng_next(rng) % 12 == 0) ? '\n' : ' ';
+    }
+}
+
+static void fill_log(char *buf, size_t size, unsigned long long *rng)
+{
+    char line[128];
+    size_t pos = 0;
+    for (unsigned long long i = 0; pos < size; i++)
+    {
+        int n = snprintf(line, sizeof(line), "2024-05-%02llu 12:%02llu:%02llu INFO requisição %llu concluída em %llu ms\n",
+                         1 + i / 100000 % 28, i / 60 % 60, i % 60, rng_next(rng) % 100000, rng_next(rng) % 500);
+        for (int c = 0; c < n && pos < size; c++)
+            buf[pos++] = line[c];
+    }
+}
+
+static void fill_random(char *buf, size_t size, unsigned long long *rng)
+{
+    for (size_t i = 0; i < size; i++)
+        buf[i] = (char)rng_next(rng);
+}
+
+static int bench_run(const char *kind, void (*fill)(char *, size_t, unsigned long long *), size_t total, size_t block)
+{
+    size_t blocks = total / block;
+    char *src = (char *)malloc(blocks * block);
+    char *packed = (char *)malloc(blocks * FS_LZ_BOUND(block));
+    size_t *sizes = (size_t *)malloc(blocks * sizeof(size_t));
+    char *out = (char *)malloc(block);
+    unsigned long long rng = 88172645463325252ULL;
+    fill(src, blocks * block, &rng);
+
+    double compress_ns = 0, decompress_ns = 0;
+    size_t packed_total = 0;
+    int errors = 0;
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        double t0 = now_ns();
+        packed_total = 0;
+        for (size_t b = 0; b < blocks; b++)
+        {
+            sizes[b] = fs_lz_compress(src + b * block, block, packed + b * FS_LZ_BOUND(block), FS_LZ_BOUND(block));
+            packed_total += sizes[b];
+        }
+        double t1 = now_ns();
+        for (size_t b = 0; b < blocks; b++)
+        {
+            if (fs_lz_decompress(packed + b * FS_LZ_BOUND(block), sizes[b], out, block) != block ||
+                memcmp(out, src + b * block, block) != 0)
+                errors++;
+        }
+        double t2 = now_ns();
+        compress_ns += t1 - t0;
+        decompress_ns += t2 - t1;
+    }
+
+    double mb = (double)(blocks * block) * ROUNDS / (1024.0 * 1024.0);
+    printf("{\"conteudo\":\"%s\",\"bloco\":%zu,\"taxa\":%.3f,\"compressao_mb_s\":%.1f,\"descompressao_mb_s\":%.1f}\n",
+           kind, block, (double)(blocks * block) / packed_total, mb / (compress_ns / 1e9), mb / (decompress_ns / 1e9));
+    fflush(stdout);
+    if (errors)
+        fprintf(stderr, "ERRO: %d bloco(s) não voltaram iguais (%s, %zu)\n", errors, kind, block);
+
+    free(src);
+    free(packed);
+    free(sizes);
+    free(out);
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    size_t megabytes = (argc > 1) ? (size_t)strtoull(argv[1], NULL, 10) : 64;
+    if (megabytes == 0)
+        return 0;
+    size_t total = megabytes * 1024 * 1024;
+    size_t blocks[] = {4096, 64 * 1024};
+    int errors = 0;
+    for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++)
+    {
+        errors += bench_run("texto", fill_text, total, blocks[i]);
+        errors += bench_run("log", fill_log, total, blocks[i]);
+        errors += bench_run("aleatorio", fill_random, total, blocks[i]);
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,39 @@
+// Memória por entrada: cria N arquivos e N/10 diretórios dentro de um mesmo
+// diretório e mede quanto o RSS do processo cresceu, além do que os slabs do
+// alocador reservaram.
+//
+// Uso: bench_mem [n]
+
+#define _POSIX_C_SOURCE 200809L
+#include "../filesystem.h"
+#include "bench_util.h"
+
+int main(int argc, char **argv)
+{
+    size_t n = (argc > 1) ? (size_t)strtoull(argv[1], NULL, 10) : 1000000;
+    size_t n_dirs = n / 10;
+    char name[48];
+
+    FileSystem *fs = fs_create();
+    long rss0 = current_rss();
+    for (size_t i = 0; i < n; i++)
+    {
+        snprintf(name, sizeof(name), "arquivo_%08zu.txt", i);
+        btree_insert(fs->root->tree, create_txt_file(name, "conteudo", fs->root));
+    }
+    long rss1 = current_rss();
+    for (size_t i = 0; i < n_dirs; i++)
+    {
+        snprintf(name, sizeof(name), "pasta_%08zu", i);
+        btree_insert(fs->root->tree, create_directory(name, fs->root));
+    }
+    long rss2 = current_rss();
+
+    printf("ordem %d, %zu arquivos, %zu diretórios\n", BTREE_ORDER, n, n_dirs);
+    printf("  arquivo:   %7.1f bytes/entrada (RSS)\n", (double)(rss1 - rss0) / n);
+    printf("  diretório: %7.1f bytes/entrada (RSS)\n", (double)(rss2 - rss1) / n_dirs);
+    printf("  slabs reservados: %.1f MiB\n", fs_alloc_reserved_bytes(&fs->alloc) / (1024.0 * 1024.0));
+
+    fs_destroy(fs);
+    return 0;
+}
@@ -0,0 +1,236 @@
+// Teste de carga das buscas sem trava (modo concorrente): threads leitoras
+// procuram nomes num diretório grande enquanto threads escritoras criam e
+// removem arquivos no mesmo diretório, e o resultado é conferido no fim.
+//
+// Cada medição roda por um tempo fixo em dois modos:
+//
+//   rcu     a leitora só entra numa seção de leitura (fs_epoch_enter) e busca
+//   trava   a leitora segura a trava do diretório durante a busca, como faria
+//           sem a cópia na escrita: leitoras e escritoras se revezam
+//
+// As leitoras só procuram nomes que nunca são removidos, então qualquer busca
+// que falhe é um erro. No fim de cada medição, a Árvore B do diretório passa
+// por directory_check e a quantidade de entradas precisa bater com a soma do
+// que cada escritora deixou.
+//
+// A saída é uma linha JSON por medição, como a de bench_fs:
+//   {"modo":"rcu","leitores":4,"escritores":2,"buscas_por_seg":...,
+//    "escritas_por_seg":...,"pendentes":...}
+//
+// Uso: bench_rcu [ms por medição] [leitores ...]
+
+#define _POSIX_C_SOURCE 200809L
+#include "../filesystem.h"
+#include "../fs_epoch.h"
+#include "bench_util.h"
+
+#define STABLE_FILES 20000
+#define WRITERS 2
+#define WRITER_NAMES 256 // cada escritora cria e remove sempre os mesmos nomes
+#define MAX_READERS 256
+
+typedef enum {
+    MODE_RCU,
+    MODE_LOCK,
+    MODE_COUNT
+} Mode;
+
+static const char *mode_names[MODE_COUNT] = {"rcu", "trava"};
+
+typedef struct Worker {
+    FileSystem *fs;
+    Directory *dir;
+    Mode mode;
+    int id;
+    volatile bool *stop;
+    pthread_barrier_t *start;
+    size_t ops;
+    size_t errors;
+    size_t live; // arquivos que a escritora deixou no diretório
+} Worker;
+
+static void *reader_main(void *arg)
+{
+    Worker *w = (Worker *)arg;
+    unsigned long long rng = 88172645463325252ULL + (unsigned long long)w->id * 7919;
+    char name[32];
+    pthread_barrier_wait(w->start);
+    while (!__atomic_load_n(w->stop, __ATOMIC_RELAXED))
+    {
+        snprintf(name, sizeof(name), "s%05llu.txt", rng_next(&rng) % STABLE_FILES);
+
+        if (w->mode == MODE_RCU)
+            fs_epoch_enter();
+        else
+            directory_lock(w->dir);
+        TreeNode *node = directory_lookup(w->dir, name);
+        if (!node || strcmp(tree_node_name(node), name) != 0)
+            w->errors++;
+        if (w->mode == MODE_RCU)
+            fs_epoch_exit();
+        else
+            directory_unlock(w->dir);
+        w->ops++;
+    }
+    return NULL;
+}
+
+// Cria os WRITER_NAMES arquivos da escritora e depois remove todos, em ciclo
+static void *writer_main(void *arg)
+{
+    Worker *w = (Worker *)arg;
+    char path[64];
+    pthread_barrier_wait(w->start);
+    for (size_t i = 0; !__atomic_load_n(w->stop, __ATOMIC_RELAXED); i++)
+    {
+        snprintf(path, sizeof(path), "/quente/w%d_%03zu.txt", w->id, i % WRITER_NAMES);
+        bool create = (i / WRITER_NAMES) % 2 == 0;
+
+        PathLookup lookup;
+        if (!path_lookup(w->fs->root, path, &lookup, LOOKUP_WRITE) || (lookup.node != NULL) == create)
+        {
+            w->errors++;
+        }
+        else if (create)
+        {
+            directory_add_entry(lookup.parent, create_txt_file(lookup.name, "conteudo", lookup.parent));
+            w->live++;
+        }
+        else
+        {
+            directory_remove_entry(lookup.parent, lookup.name);
+            w->live--;
+        }
+        path_lookup_free(&lookup);
+        w->ops++;
+    }
+    return NULL;
+}
+
+// Tira o que as escritoras deixaram, para a próxima medição começar igual
+static void writers_cleanup(FileSystem *fs, Worker *writers)
+{
+    char path[64];
+    for (int i = 0; i < WRITERS; i++)
+    {
+        for (int n = 0; n < WRITER_NAMES; n++)
+        {
+            snprintf(path, sizeof(path), "/quente/w%d_%03d.txt", writers[i].id, n);
+            PathLookup lookup;
+            if (path_lookup(fs->root, path, &lookup, LOOKUP_WRITE) && lookup.node)
+                directory_remove_entry(lookup.parent, lookup.name);
+            path_lookup_free(&lookup);
+        }
+    }
+}
+
+static bool bench_run(FileSystem *fs, Directory *dir, Mode mode, int readers, double ms)
+{
+    Worker workers[MAX_READERS + WRITERS];
+    pthread_t threads[MAX_READERS + WRITERS];
+    pthread_barrier_t start;
+    volatile bool stop = false;
+    int total = readers + WRITERS;
+    pthread_barrier_init(&start, NULL, (unsigned)total + 1);
+
+    for (int i = 0; i < total; i++)
+    {
+        Worker *w = &workers[i];
+        memset(w, 0, sizeof(*w));
+        w->fs = fs;
+        w->dir = dir;
+        w->mode = mode;
+        w->id = i < readers ? i : i - readers;
+        w->stop = &stop;
+        w->start = &start;
+        pthread_create(&threads[i], NULL, i < readers ? reader_main : writer_main, w);
+    }
+
+    pthread_barrier_wait(&start);
+    double t0 = now_ns();
+    struct timespec wait = {(time_t)(ms / 1000), (long)((ms - (long)(ms / 1000) * 1000) * 1e6)};
+    nanosleep(&wait, NULL);
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+    size_t lookups = 0, writes = 0, errors = 0, live = 0;
+    for (int i = 0; i < total; i++)
+    {
+        pthread_join(threads[i], NULL);
+        errors += workers[i].errors;
+        if (i < readers)
+        {
+            lookups += workers[i].ops;
+        }
+        else
+        {
+            writes += workers[i].ops;
+            live += workers[i].live;
+        }
+    }
+    double elapsed = now_ns() - t0;
+    pthread_barrier_destroy(&start);
+
+    char msg[256];
+    bool ok = errors == 0;
+    if (!ok)
+        fprintf(stderr, "ERRO: %zu busca(s) ou escrita(s) com resultado errado\n", errors);
+    if (!directory_check(dir, msg, sizeof(msg)))
+    {
+        fprintf(stderr, "ERRO: %s\n", msg);
+        ok = false;
+    }
+    if (btree_count(dir->tree) != STABLE_FILES + live)
+    {
+        fprintf(stderr, "ERRO: %zu entradas, esperadas %zu\n", btree_count(dir->tree), (size_t)STABLE_FILES + live);
+        ok = false;
+    }
+
+    printf("{\"modo\":\"%s\",\"leitores\":%d,\"escritores\":%d,\"buscas_por_seg\":%.0f,"
+           "\"escritas_por_seg\":%.0f,\"pendentes\":%zu}\n",
+           mode_names[mode], readers, WRITERS, lookups / (elapsed / 1e9), writes / (elapsed / 1e9),
+           fs_epoch_pending());
+    fflush(stdout);
+
+    writers_cleanup(fs, &workers[readers]);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    double ms = argc > 1 ? atof(argv[1]) : 1000;
+    int default_readers[] = {1, 2, 4, 8, 16};
+    int readers[64];
+    int reader_count = 0;
+    for (int a = 2; a < argc && reader_count < 64; a++)
+    {
+        int n = atoi(argv[a]);
+        if (n >= 1 && n <= MAX_READERS)
+            readers[reader_count++] = n;
+    }
+    if (reader_count == 0)
+    {
+        for (size_t i = 0; i < sizeof(default_readers) / sizeof(default_readers[0]); i++)
+            readers[reader_count++] = default_readers[i];
+    }
+    if (ms <= 0)
+        return 0;
+
+    FileSystem *fs = fs_create();
+    fs_set_concurrent(fs);
+    TreeNode *hot = create_directory("quente", fs->root);
+    directory_add_entry(fs->root, hot);
+    Directory *dir = hot->data.directory;
+    char name[32];
+    for (int i = 0; i < STABLE_FILES; i++)
+    {
+        snprintf(name, sizeof(name), "s%05d.txt", i);
+        directory_add_entry(dir, create_txt_file(name, "estavel", dir));
+    }
+
+    bool ok = true;
+    for (int m = 0; ok && m < MODE_COUNT; m++)
+        for (int i = 0; ok && i < reader_count; i++)
+            ok = bench_run(fs, dir, (Mode)m, readers[i], ms);
+
+    fs_destroy(fs);
+    return ok ? 0 : 1;
+}
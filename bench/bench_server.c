@@ -0,0 +1,258 @@
+// Gerador de carga do modo servidor (fs -s <socket>): abre N conexões ao
+// mesmo tempo, cada uma numa thread, e mede a vazão total e a latência de cada
+// comando para cada quantidade de clientes.
+//
+// Cada cliente trabalha no próprio diretório (criado no início), então os
+// clientes não disputam a trava de um mesmo diretório:
+//
+//   leitura   ls, stat, cd para um subdiretório e cd de volta
+//   escrita   touch e rm de arquivos no próprio diretório
+//
+// A saída é uma linha JSON por medição, como a de bench_fs:
+//   {"carga":"leitura","clientes":4,"comandos":8000,"ops_por_seg":...,
+//    "p50_us":...,"p90_us":...,"p99_us":...,"max_us":...}
+//
+// Uso: bench_server <socket> [comandos por cliente] [clientes ...]
+
+#define _POSIX_C_SOURCE 200809L
+#include "bench_util.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SETUP_FILES 32
+#define MAX_CLIENTS 256
+
+typedef enum {
+    LOAD_READ,
+    LOAD_WRITE,
+    LOAD_COUNT
+} Load;
+
+static const char *load_names[LOAD_COUNT] = {"leitura", "escrita"};
+
+typedef struct Client {
+    const char *socket_path;
+    Load load;
+    int clients; // quantidade de clientes da medição (entra no nome do diretório)
+    int id;
+    size_t commands;
+    double *samples; // latência de cada comando, em ns
+    pthread_barrier_t *start;
+    bool ok;
+} Client;
+
+// Conexão com buffer de leitura: as respostas terminam com '\0'
+typedef struct Connection {
+    int fd;
+    char buf[65536];
+    size_t pos;
+    size_t len;
+} Connection;
+
+static bool connection_open(Connection *c, const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    c->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    c->pos = c->len = 0;
+    if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        perror("bench_server: connect");
+        if (c->fd >= 0)
+            close(c->fd);
+        return false;
+    }
+    return true;
+}
+
+// Manda um comando e descarta a resposta, até o '\0'
+static bool connection_run(Connection *c, const char *command)
+{
+    size_t len = strlen(command);
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t n = write(c->fd, command + sent, len - sent);
+        if (n <= 0)
+            return false;
+        sent += (size_t)n;
+    }
+    for (;;)
+    {
+        if (c->pos == c->len)
+        {
+            ssize_t n = read(c->fd, c->buf, sizeof(c->buf));
+            if (n <= 0)
+                return false;
+            c->pos = 0;
+            c->len = (size_t)n;
+        }
+        char *end = memchr(c->buf + c->pos, '\0', c->len - c->pos);
+        if (end)
+        {
+            c->pos = (size_t)(end - c->buf) + 1;
+            return true;
+        }
+        c->pos = c->len;
+    }
+}
+
+// Monta o i-ésimo comando da carga do cliente
+static void make_command(const Client *cl, const char *dir, size_t i, char *cmd, size_t size)
+{
+    if (cl->load == LOAD_READ)
+    {
+        switch (i % 4)
+        {
+        case 0:
+            snprintf(cmd, size, "ls %s\n", dir);
+            break;
+        case 1:
+            snprintf(cmd, size, "stat %s/f%zu.txt\n", dir, (i / 4) % SETUP_FILES);
+            break;
+        case 2:
+            snprintf(cmd, size, "cd %s/sub\n", dir);
+            break;
+        default:
+            snprintf(cmd, size, "cd /\n");
+            break;
+        }
+    }
+    else
+    {
+        // touch e rm alternados: o diretório não cresce durante a medição
+        if (i % 2 == 0)
+            snprintf(cmd, size, "touch %s/w%zu.txt \"conteudo\"\n", dir, i / 2);
+        else
+            snprintf(cmd, size, "rm %s/w%zu.txt\n", dir, i / 2);
+    }
+}
+
+static void *client_main(void *arg)
+{
+    Client *cl = (Client *)arg;
+    Connection *c = (Connection *)malloc(sizeof(Connection));
+    cl->ok = connection_open(c, cl->socket_path);
+
+    char dir[64], cmd[256];
+    snprintf(dir, sizeof(dir), "/bench_%s_%d_%d", load_names[cl->load], cl->clients, cl->id);
+    if (cl->ok)
+    {
+        // Os diretórios podem ter sobrado de uma execução anterior no mesmo
+        // servidor: os erros de "já existe" são ignorados
+        snprintf(cmd, sizeof(cmd), "mkdir %s\n", dir);
+        cl->ok = connection_run(c, cmd);
+        snprintf(cmd, sizeof(cmd), "mkdir %s/sub\n", dir);
+        cl->ok = cl->ok && connection_run(c, cmd);
+        for (int f = 0; cl->ok && f < SETUP_FILES; f++)
+        {
+            snprintf(cmd, sizeof(cmd), "touch %s/f%d.txt \"arquivo %d\"\n", dir, f, f);
+            cl->ok = connection_run(c, cmd);
+        }
+    }
+
+    pthread_barrier_wait(cl->start);
+    for (size_t i = 0; cl->ok && i < cl->commands; i++)
+    {
+        make_command(cl, dir, i, cmd, sizeof(cmd));
+        double t0 = now_ns();
+        cl->ok = connection_run(c, cmd);
+        cl->samples[i] = now_ns() - t0;
+    }
+
+    if (cl->ok)
+        connection_run(c, "exit\n");
+    close(c->fd);
+    free(c);
+    return NULL;
+}
+
+// Roda a carga com 'clients' conexões ao mesmo tempo e imprime o resultado
+static bool bench_clients(const char *socket_path, Load load, int clients, size_t commands)
+{
+    Client cl[MAX_CLIENTS];
+    pthread_t threads[MAX_CLIENTS];
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)clients + 1);
+
+    size_t total = (size_t)clients * commands;
+    double *samples = (double *)malloc(total * sizeof(double));
+    for (int i = 0; i < clients; i++)
+    {
+        cl[i].socket_path = socket_path;
+        cl[i].load = load;
+        cl[i].clients = clients;
+        cl[i].id = i;
+        cl[i].commands = commands;
+        cl[i].samples = samples + (size_t)i * commands;
+        cl[i].start = &start;
+        pthread_create(&threads[i], NULL, client_main, &cl[i]);
+    }
+
+    // O relógio começa quando todos os clientes terminaram de preparar o diretório
+    pthread_barrier_wait(&start);
+    double t0 = now_ns();
+    bool ok = true;
+    for (int i = 0; i < clients; i++)
+    {
+        pthread_join(threads[i], NULL);
+        ok = ok && cl[i].ok;
+    }
+    double elapsed = now_ns() - t0;
+    pthread_barrier_destroy(&start);
+
+    if (ok)
+    {
+        qsort(samples, total, sizeof(double), compare_double);
+        printf("{\"carga\":\"%s\",\"clientes\":%d,\"comandos\":%zu,\"ops_por_seg\":%.0f,"
+               "\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+               load_names[load], clients, total, total / (elapsed / 1e9),
+               percentile(samples, total, 0.50) / 1e3, percentile(samples, total, 0.90) / 1e3,
+               percentile(samples, total, 0.99) / 1e3, samples[total - 1] / 1e3);
+        fflush(stdout);
+    }
+    else
+    {
+        fprintf(stderr, "bench_server: conexão perdida com %d cliente(s)\n", clients);
+    }
+    free(samples);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Uso: %s <socket> [comandos por cliente] [clientes ...]\n", argv[0]);
+        return 1;
+    }
+    size_t commands = argc > 2 ? (size_t)strtoull(argv[2], NULL, 10) : 2000;
+    int default_clients[] = {1, 2, 4, 8, 16};
+    int clients[64];
+    int client_count = 0;
+    for (int a = 3; a < argc && client_count < 64; a++)
+    {
+        int n = atoi(argv[a]);
+        if (n >= 1 && n <= MAX_CLIENTS)
+            clients[client_count++] = n;
+    }
+    if (client_count == 0)
+    {
+        for (size_t i = 0; i < sizeof(default_clients) / sizeof(default_clients[0]); i++)
+            clients[client_count++] = default_clients[i];
+    }
+    if (commands == 0)
+        return 0;
+
+    for (int l = 0; l < LOAD_COUNT; l++)
+        for (int i = 0; i < client_count; i++)
+            if (!bench_clients(argv[1], (Load)l, clients[i], commands))
+                return 1;
+    return 0;
+}
@@ -0,0 +1,130 @@
+// Custo de um snapshot: um diretório com N arquivos (e alguns subdiretórios)
+// é copiado com directory_add_clone, que divide com a origem os nós da Árvore
+// B e os blocos dos arquivos, e depois com uma cópia entrada por entrada, para
+// comparar. Em seguida, K arquivos da cópia são alterados, o que copia só os
+// nós do caminho até cada um; a origem precisa continuar igual.
+//
+// A saída é uma linha JSON por medição, como a de bench_fs:
+//   {"modo":"snapshot","entradas":...,"ms":...,"rss_kib":...}
+//   {"modo":"escritas","arquivos":...,"ms":...,"rss_kib":...}
+//
+// Uso: bench_snapshot [n] [k]
+
+#define _POSIX_C_SOURCE 200809L
+#include "../filesystem.h"
+#include "bench_util.h"
+
+#define SUBDIRS 16
+#define SUBDIR_FILES 100
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void print_result(const char *mode, const char *what, size_t count, double ms, long rss)
+{
+    printf("{\"modo\":\"%s\",\"%s\":%zu,\"ms\":%.3f,\"rss_kib\":%ld}\n", mode, what, count, ms, rss / 1024);
+    fflush(stdout);
+}
+
+static bool check(Directory *dir, const char *path)
+{
+    char msg[256];
+    if (directory_check(dir, msg, sizeof(msg)))
+        return true;
+    fprintf(stderr, "ERRO em %s: %s\n", path, msg);
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = (argc > 1) ? (size_t)strtoull(argv[1], NULL, 10) : 1000000;
+    size_t k = (argc > 2) ? (size_t)strtoull(argv[2], NULL, 10) : 1000;
+    if (n == 0)
+        return 0;
+    if (k > n)
+        k = n;
+    char name[40];
+
+    FileSystem *fs = fs_create();
+    TreeNode *data_node = create_directory("dados", fs->root);
+    directory_add_entry(fs->root, data_node);
+    Directory *data = data_node->data.directory;
+    for (size_t i = 0; i < n; i++)
+    {
+        snprintf(name, sizeof(name), "arquivo_%08zu.txt", i);
+        directory_add_entry(data, create_txt_file(name, "conteudo original", data));
+    }
+    for (int d = 0; d < SUBDIRS; d++)
+    {
+        snprintf(name, sizeof(name), "pasta_%02d", d);
+        TreeNode *sub = create_directory(name, data);
+        directory_add_entry(data, sub);
+        for (int i = 0; i < SUBDIR_FILES; i++)
+        {
+            snprintf(name, sizeof(name), "f%03d.txt", i);
+            directory_add_entry(sub->data.directory, create_txt_file(name, "conteudo original", sub->data.directory));
+        }
+    }
+    size_t entries = n + SUBDIRS * (SUBDIR_FILES + 1);
+
+    // Snapshot: proporcional aos subdiretórios
+    long rss0 = current_rss();
+    double t0 = now_ms();
+    TreeNode *snap_node = directory_add_clone(fs->root, "snap", data);
+    double t1 = now_ms();
+    print_result("snapshot", "entradas", entries, t1 - t0, current_rss() - rss0);
+    Directory *snap = snap_node->data.directory;
+
+    // Cópia entrada por entrada, para comparar (os blocos continuam divididos)
+    rss0 = current_rss();
+    t0 = now_ms();
+    TreeNode *copy_node = create_directory("copia", fs->root);
+    directory_add_entry(fs->root, copy_node);
+    BTreeCursor cursor;
+    btree_cursor_open(&cursor, data->tree);
+    TreeNode *item;
+    while ((item = btree_cursor_next(&cursor)) != NULL)
+    {
+        if (item->type == FILE_TYPE)
+            directory_add_entry(copy_node->data.directory, copy_txt_file(item, tree_node_name(item), copy_node->data.directory));
+    }
+    t1 = now_ms();
+    print_result("entrada_por_entrada", "entradas", n, t1 - t0, current_rss() - rss0);
+
+    // Primeiras escritas na cópia: cada uma copia o caminho até o arquivo
+    unsigned long long rng = 88172645463325252ULL;
+    rss0 = current_rss();
+    t0 = now_ms();
+    for (size_t i = 0; i < k; i++)
+    {
+        snprintf(name, sizeof(name), "arquivo_%08llu.txt", rng_next(&rng) % n);
+        TreeNode *node = directory_lookup(snap, name);
+        directory_file_write(snap, node, 0, "ALTERADO", 8);
+    }
+    t1 = now_ms();
+    print_result("escritas", "arquivos", k, t1 - t0, current_rss() - rss0);
+
+    // A origem não pode ter mudado
+    bool ok = check(data, "/dados") && check(snap, "/snap") && check(copy_node->data.directory, "/copia");
+    char buf[32];
+    btree_cursor_open(&cursor, data->tree);
+    while (ok && (item = btree_cursor_next(&cursor)) != NULL)
+    {
+        if (item->type != FILE_TYPE)
+            continue;
+        size_t len = file_read(item->data.file, 0, sizeof(buf) - 1, buf);
+        buf[len] = '\0';
+        if (strcmp(buf, "conteudo original") != 0)
+        {
+            fprintf(stderr, "ERRO: %s mudou na origem: %s\n", tree_node_name(item), buf);
+            ok = false;
+        }
+    }
+
+    fs_destroy(fs);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+// Funções comuns aos benchmarks: relógio, gerador de números, RSS e
+// percentis. Cada benchmark é um executável só, então tudo fica aqui como
+// 'static inline'.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static inline double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static inline double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Gerador simples e determinístico (xorshift64); o estado não pode ser 0
+static inline unsigned long long rng_next(unsigned long long *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// RSS atual do processo em bytes (lido de /proc/self/statm)
+static inline long current_rss(void)
+{
+    long pages_total = 0, pages_resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (!fp)
+        return 0;
+    if (fscanf(fp, "%ld %ld", &pages_total, &pages_resident) != 2)
+        pages_resident = 0;
+    fclose(fp);
+    return pages_resident * sysconf(_SC_PAGESIZE);
+}
+
+// Para ordenar as amostras com qsort antes de percentile
+static inline int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Percentil 'p' (0 a 1) de 'n' amostras já ordenadas
+static inline double percentile(const double *sorted, size_t n, double p)
+{
+    size_t i = (size_t)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+#endif // BENCH_UTIL_H
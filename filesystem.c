@@ -1,22 +1,64 @@
 #include "filesystem.h"
+#include "fs_epoch.h"
+#include "fs_journal.h"
+#include "fs_lz.h"
+#include "fs_reclaim.h"
+#include <fnmatch.h>
+
+// Implementação da comparação de prefixos escolhida na compilação:
+// AVX2 (-mavx2), SSE2 (padrão em x86-64) ou escalar (-DBTREE_NO_SIMD).
+#if !defined(BTREE_NO_SIMD) && defined(__AVX2__)
+#define BTREE_SIMD_AVX2
+#include <immintrin.h>
+#elif !defined(BTREE_NO_SIMD) && defined(__SSE2__)
+#define BTREE_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+// Tamanho da janela de chaves comparada de uma vez pela varredura de prefixos;
+// em nós maiores, uma busca binária reduz o intervalo até esse tamanho.
+#define BTREE_SCAN_WINDOW 32
+
+// Chave de busca com o prefixo já normalizado (calculado uma vez por operação)
+typedef struct BTreeKey {
+    const char *name;
+    int64_t hi, lo;
+    bool complete;
+} BTreeKey;
 
 /* ============================================================================= */
 /* --- PROTÓTIPOS DAS FUNÇÕES AUXILIARES (INTERNAS DA ÁRVORE B) --- */
 /* ============================================================================= */
 
-static BTreeNode *btree_create_node(bool leaf);
-static void btree_destroy_node(BTreeNode *node);
-static TreeNode *btree_search_in_node(BTreeNode *node, const char *name);
-static void btree_insert_non_full(BTreeNode *node, TreeNode *item);
-static void btree_split_child(BTreeNode *parent, int index, BTreeNode *child);
-static void btree_delete_from_node(BTreeNode *node, const char *name);
-static int btree_find_key(BTreeNode *node, const char *name);
-static void btree_merge(BTreeNode *node, int idx);
-static void btree_fill(BTreeNode *node, int idx);
-static void btree_borrow_from_prev(BTreeNode *node, int idx);
-static void btree_borrow_from_next(BTreeNode *node, int idx);
+static BTreeNode *btree_create_node(FsAllocator *alloc, bool leaf);
+static void btree_destroy_node(FsAllocator *alloc, BTreeNode *node);
+static BTreeKey btree_make_key(const char *name);
+static TreeNode *btree_search_in_node(BTreeNode *node, const BTreeKey *key);
+static void btree_insert_non_full(BTree *tree, BTreeNode *node, TreeNode *item, const BTreeKey *key);
+static void btree_split_child(BTree *tree, BTreeNode *parent, int index);
+static TreeNode *btree_remove(BTree *tree, const char *name);
+static void btree_release_item(BTree *tree, TreeNode *item);
+static TreeNode *btree_delete_from_node(BTree *tree, BTreeNode *node, const BTreeKey *key);
+static int btree_find_key(BTreeNode *node, const BTreeKey *key, bool *found);
+static void btree_merge(BTree *tree, BTreeNode *node, int idx);
+static size_t btree_node_count(const BTreeNode *node);
+static void btree_fill(BTree *tree, BTreeNode *node, int idx);
+static void btree_borrow_from_prev(BTree *tree, BTreeNode *node, int idx);
+static void btree_borrow_from_next(BTree *tree, BTreeNode *node, int idx);
 static TreeNode *btree_get_predecessor(BTreeNode *node, int idx);
 static TreeNode *btree_get_successor(BTreeNode *node, int idx);
+static BTreeNode *btree_build(FsAllocator *alloc, TreeNode **items, size_t count, int levels, bool is_root);
+static void print_entry(const TreeNode *item, bool long_format);
+static void dcache_invalidate(Directory *dir, const char *name);
+static void file_write(FsAllocator *alloc, File *file, size_t offset, const char *data, size_t len);
+static void file_seal(FsAllocator *alloc, File *file, size_t i, size_t len);
+static size_t file_chunk_count(size_t size);
+static size_t file_vector_capacity(size_t count);
+static TreeNode *btree_replace(BTree *tree, TreeNode *item);
+static bool btree_item_shared(const BTree *tree, const char *name);
+static void btree_share(BTree *dst, const BTree *src);
+static void directory_forget_link(FileSystem *fs, TreeNode *node);
+static void directory_forget_links(FileSystem *fs, Directory *sub);
 
 
 /* ============================================================================= */
@@ -25,340 +67,2616 @@ static TreeNode *btree_get_successor(BTreeNode *node, int idx);
 
 // --- Funções de Arquivos e Diretórios ---
 
-TreeNode *create_txt_file(const char *name, const char *content)
+// Nomes curtos ficam no próprio nó; os outros, na arena de nomes
+static void tree_node_set_name(FsAllocator *alloc, TreeNode *node, const char *name)
 {
-    TreeNode *node = (TreeNode *)malloc(sizeof(TreeNode)); 
-    node->name = strdup(name);
-    node->type = FILE_TYPE;
-    node->data.file = (File *)malloc(sizeof(File));
-    node->data.file->name = strdup(name);
-    node->data.file->content = strdup(content);
-    node->data.file->size = strlen(content);
+    size_t size = strlen(name) + 1;
+    node->name_inline = size <= TREE_NODE_INLINE_NAME;
+    if (node->name_inline)
+        memcpy(node->name.local, name, size);
+    else
+        node->name.heap = fs_alloc_name(alloc, name);
+}
+
+static void tree_node_free_name(FsAllocator *alloc, TreeNode *node)
+{
+    if (!node->name_inline)
+        fs_free_name(alloc, node->name.heap);
+}
 
-    time_t now = time(NULL);
+TreeNode *create_txt_file(const char *name, const char *content, Directory *parent)
+{
+    FsAllocator *alloc = &parent->fs->alloc;
+    TreeNode *node = (TreeNode *)slab_alloc(&alloc->tree_nodes);
+    tree_node_set_name(alloc, node, name);
+    node->type = FILE_TYPE;
+    node->refs = 1;
+    node->data.file = (File *)slab_alloc(&alloc->files);
+    node->data.file->chunks = &node->data.file->first;
+    node->data.file->first = NULL;
+    node->data.file->size = 0;
+    node->data.file->ino = __atomic_fetch_add(&parent->fs->next_ino, 1, __ATOMIC_RELAXED);
+    node->data.file->links = NULL;
+    node->data.file->refs = 1;
+    node->data.file->nlink = 1;
+    size_t len = strlen(content);
+    file_write(alloc, node->data.file, 0, content, len);
+    // Os blocos cheios já foram fechados por file_write; falta o último
+    if (len % FILE_CHUNK_SIZE != 0)
+        file_seal(alloc, node->data.file, len / FILE_CHUNK_SIZE, len % FILE_CHUNK_SIZE);
+
+    time_t now = fs_clock_now();
     node->creation_time = now;
     node->modification_time = now;
     node->last_access_time = now;
+    // Só entra na tabela pronto: o 'stat -i' de outra sessão pode achá-lo
+    fs_inode_put(&alloc->inodes, node->data.file->ino, node, parent->id);
     return node;
 }
 
 TreeNode *create_directory(const char *name, Directory *parent)
 {
-    TreeNode *node = (TreeNode *)malloc(sizeof(TreeNode));
-    node->name = strdup(name);
+    FsAllocator *alloc = &parent->fs->alloc;
+    TreeNode *node = (TreeNode *)slab_alloc(&alloc->tree_nodes);
+    tree_node_set_name(alloc, node, name);
     node->type = DIRECTORY_TYPE;
-    node->data.directory = (Directory *)malloc(sizeof(Directory));
-    node->data.directory->name = strdup(name);
+    node->refs = 1;
+    node->data.directory = (Directory *)slab_alloc(&alloc->directories);
+    node->data.directory->name = tree_node_name(node);
     node->data.directory->parent = parent;
-    node->data.directory->tree = btree_create();
-
-    time_t now = time(NULL);
+    node->data.directory->tree = btree_create(alloc);
+    node->data.directory->fs = parent->fs;
+    node->data.directory->node = node;
+    node->data.directory->path = NULL;
+    node->data.directory->path_len = 0;
+    node->data.directory->id = __atomic_fetch_add(&parent->fs->next_ino, 1, __ATOMIC_RELAXED);
+    memset(&node->data.directory->totals, 0, sizeof(DirectoryTotals));
+    pthread_mutex_init(&node->data.directory->lock, NULL);
+    node->data.directory->pins = 0;
+    node->data.directory->removed = false;
+    node->data.directory->dirty = false;
+    node->data.directory->clone_prev = node->data.directory;
+    node->data.directory->clone_next = node->data.directory;
+    node->data.directory->dirty_prev = NULL;
+    node->data.directory->dirty_next = NULL;
+    node->data.directory->subdirs = NULL;
+    node->data.directory->sibling_prev = NULL;
+    node->data.directory->sibling_next = NULL;
+
+    time_t now = fs_clock_now();
     node->creation_time = now;
     node->modification_time = now;
     node->last_access_time = now;
+    fs_inode_put(&alloc->inodes, node->data.directory->id, node, parent->id);
+    return node;
+}
+
+// Cópia do arquivo 'src' com o nome 'name', com um inode novo. Os blocos de
+// conteúdo são compartilhados (só o vetor deles é copiado) e as datas são as
+// da origem.
+TreeNode *copy_txt_file(const TreeNode *src, const char *name, Directory *parent)
+{
+    FsAllocator *alloc = &parent->fs->alloc;
+    const File *from = src->data.file;
+    TreeNode *node = (TreeNode *)slab_alloc(&alloc->tree_nodes);
+    tree_node_set_name(alloc, node, name);
+    node->type = FILE_TYPE;
+    node->refs = 1;
+    File *file = (File *)slab_alloc(&alloc->files);
+    node->data.file = file;
+    file->size = from->size;
+    file->first = NULL;
+    file->chunks = &file->first;
+    file->ino = __atomic_fetch_add(&parent->fs->next_ino, 1, __ATOMIC_RELAXED);
+    file->links = NULL;
+    file->refs = 1;
+    file->nlink = 1;
+
+    size_t count = file_chunk_count(file->size);
+    if (count > 1)
+        file->chunks = (FileChunk **)malloc(file_vector_capacity(count) * sizeof(FileChunk *));
+    for (size_t i = 0; i < count; i++)
+    {
+        file->chunks[i] = from->chunks[i];
+        __atomic_fetch_add(&file->chunks[i]->refs, 1, __ATOMIC_RELAXED);
+    }
+
+    node->creation_time = src->creation_time;
+    node->modification_time = __atomic_load_n(&src->modification_time, __ATOMIC_RELAXED);
+    node->last_access_time = __atomic_load_n(&src->last_access_time, __ATOMIC_RELAXED);
+    fs_inode_put(&alloc->inodes, file->ino, node, parent->id);
+    return node;
+}
+
+// --- Arquivos com Vários Nomes (ln) ---
+
+// A trava dos nomes só existe no modo concorrente, como a dos diretórios
+static void fs_links_lock(FileSystem *fs)
+{
+    if (fs->concurrent)
+        pthread_mutex_lock(&fs->links_lock);
+}
+
+static void fs_links_unlock(FileSystem *fs)
+{
+    if (fs->concurrent)
+        pthread_mutex_unlock(&fs->links_lock);
+}
+
+// Registra o nome 'node' (em 'dir') do arquivo; o primeiro registrado é o que
+// ele já tinha. Com a trava dos nomes.
+static void file_links_add(FileSystem *fs, File *file, Directory *dir, TreeNode *node)
+{
+    FileLinks *links = file->links;
+    uint32_t count = file->nlink;
+    if (!links)
+    {
+        count = 0;
+        links = (FileLinks *)calloc(1, sizeof(FileLinks));
+        if (!links)
+        {
+            perror("Erro ao reservar memória");
+            exit(EXIT_FAILURE);
+        }
+        links->file = file;
+        links->next = fs->links;
+        if (fs->links)
+            fs->links->prev = links;
+        fs->links = links;
+        __atomic_store_n(&file->links, links, __ATOMIC_RELEASE);
+    }
+    if (count == links->capacity)
+    {
+        links->capacity = links->capacity ? links->capacity * 2 : 4;
+        links->items = (FileLink *)realloc(links->items, links->capacity * sizeof(FileLink));
+        if (!links->items)
+        {
+            perror("Erro ao reservar memória");
+            exit(EXIT_FAILURE);
+        }
+    }
+    links->items[count].dir = dir;
+    links->items[count].node = node;
+    if (count > 0)
+        __atomic_store_n(&file->nlink, count + 1, __ATOMIC_RELAXED);
+}
+
+// Tira o nome 'node' do arquivo. A entrada da tabela de inodes passa para um
+// nome que fica, e os diretórios dos outros nomes vão para o checkpoint (o
+// número de nomes mudou). Com um nome só, o arquivo volta a ser comum: devolve
+// false quando 'links' foi liberado. Com a trava dos nomes.
+static bool file_links_remove(FileSystem *fs, File *file, TreeNode *node)
+{
+    FileLinks *links = file->links;
+    uint32_t count = file->nlink;
+    for (uint32_t i = 0; i < count; i++)
+        if (links->items[i].node == node)
+        {
+            links->items[i] = links->items[--count];
+            break;
+        }
+    __atomic_store_n(&file->nlink, count, __ATOMIC_RELAXED);
+    if (count > 0)
+        fs_inode_put(&fs->alloc.inodes, file->ino, links->items[0].node, links->items[0].dir->id);
+    fs_journal_lock(fs);
+    for (uint32_t i = 0; i < count; i++)
+        directory_mark_dirty(links->items[i].dir);
+    fs_journal_unlock(fs);
+    if (count > 1)
+        return true;
+
+    if (links->prev)
+        links->prev->next = links->next;
+    else
+        fs->links = links->next;
+    if (links->next)
+        links->next->prev = links->prev;
+    __atomic_store_n(&file->links, NULL, __ATOMIC_RELEASE);
+    free(links->items);
+    free(links);
+    return false;
+}
+
+// Muda a data de modificação em todos os nomes. Com a trava dos nomes.
+static void file_links_touch(File *file, time_t mtime)
+{
+    for (uint32_t i = 0; i < file->nlink; i++)
+        __atomic_store_n(&file->links->items[i].node->modification_time, mtime, __ATOMIC_RELAXED);
+}
+
+// Novo nome 'name' em 'parent' para o arquivo de 'src' (que está em
+// 'src_dir'): um TreeNode próprio, com as datas da origem, que aponta para o
+// mesmo File. Não entra na árvore aqui (ver directory_add_link). A entrada
+// 'src' não pode estar dividida com uma cópia do diretório.
+TreeNode *link_txt_file(TreeNode *src, Directory *src_dir, const char *name, Directory *parent)
+{
+    FileSystem *fs = parent->fs;
+    File *file = src->data.file;
+    TreeNode *node = (TreeNode *)slab_alloc(&fs->alloc.tree_nodes);
+    tree_node_set_name(&fs->alloc, node, name);
+    node->type = FILE_TYPE;
+    node->refs = 1;
+    node->data.file = file;
+    __atomic_fetch_add(&file->refs, 1, __ATOMIC_RELAXED);
+    node->creation_time = src->creation_time;
+    node->modification_time = __atomic_load_n(&src->modification_time, __ATOMIC_RELAXED);
+    node->last_access_time = __atomic_load_n(&src->last_access_time, __ATOMIC_RELAXED);
+
+    fs_links_lock(fs);
+    if (!file->links)
+        file_links_add(fs, file, src_dir, src);
+    file_links_add(fs, file, parent, node);
+    fs_links_unlock(fs);
     return node;
 }
 
-void delete_txt_file(TreeNode *node)
+// Muda a data de modificação do arquivo de 'node' em todos os nomes dele
+void file_set_mtime(FileSystem *fs, TreeNode *node, time_t mtime)
+{
+    File *file = node->data.file;
+    __atomic_store_n(&node->modification_time, mtime, __ATOMIC_RELAXED);
+    if (!__atomic_load_n(&file->links, __ATOMIC_ACQUIRE))
+        return;
+    fs_links_lock(fs);
+    if (file->links)
+        file_links_touch(file, mtime);
+    fs_links_unlock(fs);
+}
+
+static void inode_parent_visit(TreeNode *node, uint64_t parent, void *ctx)
+{
+    (void)node;
+    *(uint64_t *)ctx = parent;
+}
+
+// Troca o número do inode do item pelo gravado (checkpoint e journal). Um
+// número que já é de outro item, ou o da raiz, fica como está.
+void tree_node_set_ino(FileSystem *fs, TreeNode *node, uint64_t ino)
+{
+    uint64_t old = tree_node_ino(node);
+    if (ino <= FS_ROOT_DIR_ID || ino == old || fs_inode_get(&fs->alloc.inodes, ino))
+        return;
+    uint64_t parent = 0;
+    fs_inode_visit(&fs->alloc.inodes, old, inode_parent_visit, &parent);
+    fs_inode_remove(&fs->alloc.inodes, old);
+    if (node->type == FILE_TYPE)
+        node->data.file->ino = ino;
+    else
+        node->data.directory->id = ino;
+    fs_inode_put(&fs->alloc.inodes, ino, node, parent);
+    if (ino >= fs->next_ino)
+        fs->next_ino = ino + 1;
+}
+
+// Libera o TreeNode de um arquivo; o arquivo em si só vai com o último nome
+void delete_txt_file(FsAllocator *alloc, TreeNode *node)
 {
     if (node && node->type == FILE_TYPE)
     {
-        free(node->data.file->name);
-        free(node->data.file->content);
-        free(node->data.file);
-        free(node->name);
-        free(node);
+        File *file = node->data.file;
+        uint64_t ino = __atomic_load_n(&file->ino, __ATOMIC_RELAXED);
+        if (__atomic_sub_fetch(&file->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        {
+            fs_inode_remove(&alloc->inodes, ino);
+            size_t count = file_chunk_count(file->size);
+            for (size_t i = 0; i < count; i++)
+                fs_content_put(&alloc->content, file->chunks[i]);
+            if (file->chunks != &file->first)
+                free(file->chunks);
+            slab_free(&alloc->files, file);
+        }
+        // O arquivo continua no nome que um rm -r ainda na fila de liberação
+        // segura: a entrada da tabela não pode ficar com este
+        else
+            fs_inode_remove_node(&alloc->inodes, ino, node);
+        tree_node_free_name(alloc, node);
+        slab_free(&alloc->tree_nodes, node);
+    }
+}
+
+// Tira o diretório do anel das cópias antes de a Árvore B dele ir embora:
+// directory_unshare_file e o 'stat -i' procuram nas dos diretórios do anel.
+// Fora do anel, os ponteiros ficam nulos: o diretório está sendo liberado.
+static void directory_leave_clones(Directory *dir)
+{
+    pthread_mutex_lock(&dir->fs->clones_lock);
+    if (dir->clone_next)
+    {
+        dir->clone_prev->clone_next = dir->clone_next;
+        dir->clone_next->clone_prev = dir->clone_prev;
+        dir->clone_prev = NULL;
+        dir->clone_next = NULL;
     }
+    pthread_mutex_unlock(&dir->fs->clones_lock);
 }
 
+// Libera o diretório e tudo o que está dentro dele. O nome pertence ao
+// TreeNode que representa o diretório (a raiz usa uma constante).
 void delete_directory_recursive(Directory *dir)
 {
     if (dir)
     {
+        directory_leave_clones(dir);
+        directory_clear_dirty(dir);
+        free(dir->path);
         if(dir->tree) {
             btree_destroy(dir->tree);
         }
-        free(dir->name);
-        free(dir);
+        pthread_mutex_destroy(&dir->lock);
+        slab_free(&dir->fs->alloc.directories, dir);
     }
 }
 
-void free_tree_node(TreeNode *node)
+// Solta uma referência ao item; a última o libera
+void free_tree_node(FsAllocator *alloc, TreeNode *node)
 {
-    if (node)
+    if (node && __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL) == 0)
     {
         if (node->type == FILE_TYPE)
         {
-            delete_txt_file(node);
+            delete_txt_file(alloc, node);
         }
         else if (node->type == DIRECTORY_TYPE)
         {
-            free(node->name);
-            free(node);
+            // Os itens de dentro saem da tabela de inodes antes do diretório:
+            // até lá, o 'stat -i' ainda acha o diretório e vê que foi removido
+            Directory *dir = node->data.directory;
+            directory_leave_clones(dir);
+            if (dir->tree)
+            {
+                btree_destroy(dir->tree);
+                dir->tree = NULL;
+            }
+            fs_inode_remove(&alloc->inodes, dir->id);
+            delete_directory_recursive(dir);
+            tree_node_free_name(alloc, node);
+            slab_free(&alloc->tree_nodes, node);
         }
     }
 }
 
-// --- Funções de Navegação e Comandos ---
+// --- Conteúdo dos Arquivos ---
 
-Directory *get_root_directory()
+// No modo concorrente, 'cat' lê o conteúdo sem trava (dentro de uma seção de
+// leitura) enquanto outra thread escreve. Quem escreve nunca muda bytes que um
+// leitor possa estar vendo: um bloco com trecho sobrescrito, ou que precisa
+// crescer, é copiado e trocado no vetor, e o vetor também é trocado quando
+// cresce. Os antigos são aposentados. Bytes depois do fim vão direto para o
+// bloco, e o tamanho novo só é publicado no fim. Um bloco compartilhado com
+// outro arquivo (refs > 1), guardado no armazenamento por conteúdo ou
+// comprimido também é copiado antes de qualquer escrita.
+
+static size_t file_chunk_count(size_t size)
 {
-    Directory *root = (Directory *)malloc(sizeof(Directory));
-    root->name = strdup("/");
-    root->parent = NULL;
-    root->tree = btree_create();
-    return root;
+    return (size + FILE_CHUNK_SIZE - 1) / FILE_CHUNK_SIZE;
 }
 
-void list_directory_contents(Directory *dir, bool long_format)
+// Capacidade do bloco i de um arquivo com 'size' bytes
+static size_t file_chunk_capacity(size_t size, size_t i)
 {
-    if (dir && dir->tree && dir->tree->root && dir->tree->root->num_keys > 0)
-    {
-        printf("Conteúdo de %s:\n", dir->name);
-        btree_traverse(dir->tree->root, long_format);
-        if (!long_format)
-            printf("\n");
-    }
+    size_t held = size - i * FILE_CHUNK_SIZE;
+    if (held >= FILE_CHUNK_SIZE)
+        return FILE_CHUNK_SIZE;
+    size_t capacity = FILE_CHUNK_MIN;
+    while (capacity < held)
+        capacity *= 2;
+    return capacity;
+}
+
+// Capacidade do vetor de blocos (1: o próprio campo 'first')
+static size_t file_vector_capacity(size_t count)
+{
+    if (count <= 1)
+        return 1;
+    size_t capacity = 4;
+    while (capacity < count)
+        capacity *= 2;
+    return capacity;
+}
+
+static void file_reclaim_chunk(void *ctx, void *ptr)
+{
+    fs_content_put(&((FsAllocator *)ctx)->content, (FileChunk *)ptr);
+}
+
+static void file_reclaim_vector(void *ctx, void *ptr)
+{
+    (void)ctx;
+    free(ptr);
+}
+
+// Solta um bloco que saiu do arquivo
+static void file_release_chunk(FsAllocator *alloc, FileChunk *chunk)
+{
+    if (alloc->concurrent)
+        fs_epoch_retire(file_reclaim_chunk, alloc, chunk);
+    else
+        fs_content_put(&alloc->content, chunk);
+}
+
+static void file_release_vector(FsAllocator *alloc, FileChunk **vector)
+{
+    if (alloc->concurrent)
+        fs_epoch_retire(file_reclaim_vector, NULL, vector);
     else
+        free(vector);
+}
+
+// Escreve 'len' bytes a partir de 'offset' (no máximo o tamanho atual). Só os
+// blocos do trecho são tocados.
+static void file_write(FsAllocator *alloc, File *file, size_t offset, const char *data, size_t len)
+{
+    if (len == 0)
+        return;
+    bool cow = alloc->concurrent;
+    size_t old_size = file->size;
+    size_t end = offset + len;
+    size_t new_size = (end > old_size) ? end : old_size;
+    size_t old_count = file_chunk_count(old_size);
+    size_t new_count = file_chunk_count(new_size);
+
+    FileChunk **chunks = file->chunks;
+    char raw[FILE_CHUNK_SIZE];
+    if (file_vector_capacity(new_count) != file_vector_capacity(old_count))
     {
-        printf("Diretório %s está vazio.\n", dir->name);
+        FileChunk **vector = (FileChunk **)malloc(file_vector_capacity(new_count) * sizeof(FileChunk *));
+        memcpy(vector, chunks, old_count * sizeof(FileChunk *));
+        __atomic_store_n(&file->chunks, vector, __ATOMIC_RELEASE);
+        if (chunks != &file->first)
+            file_release_vector(alloc, chunks);
+        chunks = vector;
     }
-    if (dir->parent != NULL)
+
+    for (size_t i = offset / FILE_CHUNK_SIZE; i * FILE_CHUNK_SIZE < end; i++)
     {
-        TreeNode *self_node = btree_search(dir->parent->tree, dir->name);
-        if (self_node)
-            self_node->last_access_time = time(NULL);
+        size_t start = i * FILE_CHUNK_SIZE;
+        size_t held = (old_size > start) ? old_size - start : 0;
+        if (held > FILE_CHUNK_SIZE)
+            held = FILE_CHUNK_SIZE;
+        // Trecho [lo, hi) do bloco que recebe os dados
+        size_t lo = (offset > start) ? offset - start : 0;
+        size_t hi = (end - start < FILE_CHUNK_SIZE) ? end - start : FILE_CHUNK_SIZE;
+        const char *src = data + (start + lo - offset);
+        FileChunk *chunk = (i < old_count) ? chunks[i] : NULL;
+        size_t capacity = file_chunk_capacity(new_size, i);
+
+        if (!chunk || file_chunk_capacity(old_size, i) != capacity || (cow && lo < held) ||
+            chunk->stored || chunk->packed || __atomic_load_n(&chunk->refs, __ATOMIC_ACQUIRE) > 1)
+        {
+            const char *old = chunk ? chunk->data : NULL;
+            if (chunk && chunk->packed)
+            {
+                fs_lz_decompress(chunk->data, chunk->packed, raw, held);
+                old = raw;
+            }
+            FileChunk *copy = fs_content_alloc(&alloc->content, capacity);
+            if (lo > 0)
+                memcpy(copy->data, old, lo);
+            memcpy(copy->data + lo, src, hi - lo);
+            if (hi < held)
+                memcpy(copy->data + hi, old + hi, held - hi);
+            __atomic_store_n(&chunks[i], copy, __ATOMIC_RELEASE);
+            if (chunk)
+                file_release_chunk(alloc, chunk);
+        }
+        else
+        {
+            memcpy(chunk->data + lo, src, hi - lo);
+        }
     }
+    __atomic_store_n(&file->size, new_size, __ATOMIC_RELEASE);
+
+    // Blocos que encheram com esta escrita
+    for (size_t i = old_size / FILE_CHUNK_SIZE; i < new_size / FILE_CHUNK_SIZE; i++)
+        file_seal(alloc, file, i, FILE_CHUNK_SIZE);
 }
 
-void change_directory(Directory **current_dir, const char *path)
+// Troca o bloco i por 'chunk' e solta o antigo
+static void file_swap_chunk(FsAllocator *alloc, File *file, size_t i, FileChunk *chunk)
 {
-    if (strcmp(path, ".") == 0) return;
+    FileChunk *old = file->chunks[i];
+    __atomic_store_n(&file->chunks[i], chunk, __ATOMIC_RELEASE);
+    file_release_chunk(alloc, old);
+}
 
-    if (strcmp(path, "..") == 0)
+// O bloco i ficou completo, com 'len' bytes: é comprimido, se vale a pena, e
+// guardado no armazenamento por conteúdo (se já havia um bloco igual, ele toma
+// o lugar do bloco do arquivo). Os dois passos só trocam o bloco inteiro.
+static void file_seal(FsAllocator *alloc, File *file, size_t i, size_t len)
+{
+    FileChunk *chunk = file->chunks[i];
+    if (len >= FILE_COMPRESS_MIN)
     {
-        if ((*current_dir)->parent != NULL)
+        FileChunk *packed = fs_content_pack(&alloc->content, chunk->data, len);
+        if (packed)
         {
-            *current_dir = (*current_dir)->parent;
+            file_swap_chunk(alloc, file, i, packed);
+            chunk = packed;
         }
+    }
+    if (file->size < FILE_DEDUP_MIN)
         return;
+    size_t bytes = chunk->packed ? chunk->packed : len;
+    uint64_t hash = fs_content_hash(chunk->data, bytes);
+    FileChunk *stored = fs_content_intern(&alloc->content, hash, chunk, bytes);
+    if (stored != chunk)
+        file_swap_chunk(alloc, file, i, stored);
+}
+
+size_t file_size(const File *file)
+{
+    return __atomic_load_n(&file->size, __ATOMIC_ACQUIRE);
+}
+
+// Percorre os blocos do trecho [offset, offset + len), cortado no fim do
+// arquivo. Devolve quantos bytes foram visitados.
+static size_t file_visit(const File *file, size_t offset, size_t len,
+                         void (*visit)(const char *src, size_t n, void *ctx), void *ctx)
+{
+    size_t size = file_size(file);
+    if (offset >= size)
+        return 0;
+    if (len > size - offset)
+        len = size - offset;
+    FileChunk **chunks = __atomic_load_n(&file->chunks, __ATOMIC_ACQUIRE);
+    char raw[FILE_CHUNK_SIZE];
+    size_t done = 0;
+    while (done < len)
+    {
+        size_t pos = offset + done;
+        size_t in_chunk = pos % FILE_CHUNK_SIZE;
+        size_t n = FILE_CHUNK_SIZE - in_chunk;
+        if (n > len - done)
+            n = len - done;
+        const FileChunk *chunk = __atomic_load_n(&chunks[pos / FILE_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+        const char *bytes = chunk->data;
+        if (chunk->packed)
+        {
+            // Só até onde o trecho precisa
+            fs_lz_decompress(chunk->data, chunk->packed, raw, in_chunk + n);
+            bytes = raw;
+        }
+        visit(bytes + in_chunk, n, ctx);
+        done += n;
+    }
+    return len;
+}
+
+static void file_copy_out(const char *src, size_t n, void *ctx)
+{
+    char **dst = (char **)ctx;
+    memcpy(*dst, src, n);
+    *dst += n;
+}
+
+static void file_print_out(const char *src, size_t n, void *ctx)
+{
+    fwrite(src, 1, n, (FILE *)ctx);
+}
+
+// Copia até 'len' bytes a partir de 'offset' para 'dst'
+size_t file_read(const File *file, size_t offset, size_t len, char *dst)
+{
+    return file_visit(file, offset, len, file_copy_out, &dst);
+}
+
+size_t file_print(FILE *out, const File *file, size_t offset, size_t len)
+{
+    return file_visit(file, offset, len, file_print_out, out);
+}
+
+// --- Alterações em Diretórios ---
+
+// Os totais de um diretório mudam quando qualquer descendente muda, sem a
+// trava dele: são lidos e alterados com operações atômicas
+static DirectoryTotals directory_totals_load(const Directory *dir)
+{
+    DirectoryTotals t;
+    t.bytes = __atomic_load_n(&dir->totals.bytes, __ATOMIC_RELAXED);
+    t.files = __atomic_load_n(&dir->totals.files, __ATOMIC_RELAXED);
+    t.dirs = __atomic_load_n(&dir->totals.dirs, __ATOMIC_RELAXED);
+    return t;
+}
+
+// Quanto uma entrada soma aos totais do diretório que a contém
+static DirectoryTotals entry_totals(const TreeNode *node)
+{
+    DirectoryTotals t = {0, 0, 0};
+    if (node->type == FILE_TYPE)
+    {
+        t.bytes = file_size(node->data.file);
+        t.files = 1;
+    }
+    else
+    {
+        t = directory_totals_load(node->data.directory);
+        t.dirs++;
     }
+    return t;
+}
 
-    TreeNode *target_node = btree_search((*current_dir)->tree, path);
-    if (target_node && target_node->type == DIRECTORY_TYPE)
+// Soma (ou subtrai) 'delta' nos totais de 'dir' e de todos os seus ancestrais
+static void directory_totals_apply(Directory *dir, const DirectoryTotals *delta, bool add)
+{
+    for (; dir; dir = dir->parent)
     {
-        target_node->last_access_time = time(NULL);
-        *current_dir = target_node->data.directory;
+        if (add)
+        {
+            __atomic_fetch_add(&dir->totals.bytes, delta->bytes, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&dir->totals.files, delta->files, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&dir->totals.dirs, delta->dirs, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            __atomic_fetch_sub(&dir->totals.bytes, delta->bytes, __ATOMIC_RELAXED);
+            __atomic_fetch_sub(&dir->totals.files, delta->files, __ATOMIC_RELAXED);
+            __atomic_fetch_sub(&dir->totals.dirs, delta->dirs, __ATOMIC_RELAXED);
+        }
     }
+}
+
+// Lista de subdiretórios de 'dir' (alterada com a trava dele)
+static void directory_link_child(Directory *dir, Directory *child)
+{
+    child->sibling_prev = NULL;
+    child->sibling_next = dir->subdirs;
+    if (dir->subdirs)
+        dir->subdirs->sibling_prev = child;
+    dir->subdirs = child;
+}
+
+static void directory_unlink_child(Directory *dir, Directory *child)
+{
+    if (child->sibling_prev)
+        child->sibling_prev->sibling_next = child->sibling_next;
     else
+        dir->subdirs = child->sibling_next;
+    if (child->sibling_next)
+        child->sibling_next->sibling_prev = child->sibling_prev;
+    child->sibling_prev = NULL;
+    child->sibling_next = NULL;
+}
+
+// Todas as mudanças na estrutura passam por aqui: o diretório é marcado para
+// o próximo checkpoint e a operação vai para o journal. Quem chama segura a
+// trava de 'dir'.
+void directory_add_entry(Directory *dir, TreeNode *node)
+{
+    btree_insert(dir->tree, node);
+    if (node->type == DIRECTORY_TYPE)
+        directory_link_child(dir, node->data.directory);
+    DirectoryTotals delta = entry_totals(node);
+    directory_totals_apply(dir, &delta, true);
+    fs_journal_lock(dir->fs);
+    directory_mark_dirty(dir);
+    // Diretório novo também entra no checkpoint, mesmo vazio
+    if (node->type == DIRECTORY_TYPE)
+        directory_mark_dirty(node->data.directory);
+    if (dir->fs->journal)
+        fs_journal_log_add(dir, node);
+    fs_journal_unlock(dir->fs);
+}
+
+// O item sai da árvore antes de sair do cache de entradas, e só é liberado
+// depois dos dois (no modo concorrente, quando os leitores saírem)
+void directory_remove_entry(Directory *dir, const char *name)
+{
+    TreeNode *node = btree_remove(dir->tree, name);
+    dcache_invalidate(dir, name);
+    if (node)
     {
-        printf("cd: diretório não encontrado: %s\n", path);
+        if (node->type == DIRECTORY_TYPE)
+            directory_unlink_child(dir, node->data.directory);
+        DirectoryTotals delta = entry_totals(node);
+        directory_totals_apply(dir, &delta, false);
+        if (node->type == FILE_TYPE)
+            directory_forget_link(dir->fs, node);
+        else if (delta.files > 0)
+            directory_forget_links(dir->fs, node->data.directory);
     }
+    fs_journal_lock(dir->fs);
+    // Um diretório removido sai já da lista de sujos, mesmo que a liberação fique para depois
+    if (node && node->type == DIRECTORY_TYPE)
+        directory_clear_dirty(node->data.directory);
+    directory_mark_dirty(dir);
+    if (dir->fs->journal)
+        fs_journal_log_remove(dir, name);
+    fs_journal_unlock(dir->fs);
+    btree_release_item(dir->tree, node);
+}
+
+// Um diretório removido (rmdir, ou dentro de uma subárvore do rm -r ainda na
+// fila de liberação) continua na tabela até ser liberado, mas não tem caminho
+static bool directory_reachable(const Directory *dir)
+{
+    for (; dir; dir = dir->parent)
+        if (__atomic_load_n(&dir->removed, __ATOMIC_ACQUIRE))
+            return false;
+    return true;
 }
 
-char *get_current_path(Directory *dir)
+// 'other' é 'dir' ou está abaixo dele
+bool directory_contains(const Directory *dir, const Directory *other)
 {
-    if (dir == NULL || dir->parent == NULL)
+    for (; other; other = other->parent)
+        if (other == dir)
+            return true;
+    return false;
+}
+
+// O nome 'node', que acabou de sair da árvore, deixa de contar no arquivo
+static void directory_forget_link(FileSystem *fs, TreeNode *node)
+{
+    File *file = node->data.file;
+    if (!__atomic_load_n(&file->links, __ATOMIC_ACQUIRE))
+        return;
+    fs_links_lock(fs);
+    if (file->links)
+        file_links_remove(fs, file, node);
+    fs_links_unlock(fs);
+}
+
+// O mesmo para os nomes que estão na subárvore 'sub', que acabou de sair da
+// árvore. Custa o número de nomes dos arquivos com mais de um, e não o tamanho
+// da subárvore.
+static void directory_forget_links(FileSystem *fs, Directory *sub)
+{
+    fs_links_lock(fs);
+    for (FileLinks *links = fs->links; links;)
     {
-        return strdup("/");
+        FileLinks *next = links->next;
+        File *file = links->file;
+        // file_links_remove traz o último nome para a posição do removido
+        for (uint32_t i = file->nlink; i-- > 0;)
+            if (directory_contains(sub, links->items[i].dir) && !file_links_remove(fs, file, links->items[i].node))
+                break;
+        links = next;
     }
+    fs_links_unlock(fs);
+}
 
-    char *parent_path = get_current_path(dir->parent);
-    if (strcmp(parent_path, "/") == 0)
+// Tira de 'dir' o subdiretório 'name' com tudo o que está dentro (rm -r). Só
+// a remoção no pai e os diretórios sujos da subárvore (que são poucos: os
+// alterados desde o último checkpoint) custam aqui; o resto é liberado em
+// segundo plano (fs_reclaim.h). Quem chama segura a trava de 'dir' e garante
+// que ninguém mais está na subárvore (no modo servidor, a trava global
+// exclusiva; sem pins, ver directory_mark_removed).
+void directory_remove_tree(Directory *dir, const char *name)
+{
+    TreeNode *node = btree_remove(dir->tree, name);
+    dcache_invalidate(dir, name);
+    if (!node)
+        return;
+    Directory *sub = node->data.directory;
+    directory_unlink_child(dir, sub);
+    DirectoryTotals delta = entry_totals(node);
+    directory_totals_apply(dir, &delta, false);
+    if (delta.files > 0)
+        directory_forget_links(dir->fs, sub);
+
+    fs_journal_lock(dir->fs);
+    for (Directory *d = dir->fs->dirty_head; d;)
     {
-        char *path = (char *)malloc(strlen(dir->name) + 2);
-        sprintf(path, "/%s", dir->name);
-        free(parent_path);
-        return path;
+        Directory *next = d->dirty_next;
+        if (directory_contains(sub, d))
+            directory_clear_dirty(d);
+        d = next;
     }
+    directory_mark_dirty(dir);
+    if (dir->fs->journal)
+        fs_journal_log_remove(dir, name);
+    fs_journal_unlock(dir->fs);
+    fs_reclaim_push(dir->fs, node);
+}
 
-    char *path = (char *)malloc(strlen(parent_path) + strlen(dir->name) + 2);
-    sprintf(path, "%s/%s", parent_path, dir->name);
-    free(parent_path);
-    return path;
+// Atualiza os totais de 'dir' e dos ancestrais depois que um arquivo dele
+// mudou de tamanho
+void directory_file_resized(Directory *dir, size_t old_size, size_t new_size)
+{
+    DirectoryTotals delta = {0, 0, 0};
+    delta.bytes = (new_size > old_size) ? new_size - old_size : old_size - new_size;
+    directory_totals_apply(dir, &delta, new_size > old_size);
 }
 
-void update_parent_modification_time(Directory *dir)
+// Se a entrada 'node' de 'dir' é compartilhada com cópias do diretório
+// (snapshot, cp -r), troca-a por uma só deste diretório, que divide com a
+// antiga os blocos não escritos, e devolve a nova; 'node' continua válido, mas
+// passa a ser só das cópias. Senão, devolve 'node'. O número do inode fica com
+// o diretório de menor id entre os que têm a entrada (a origem é sempre mais
+// antiga que as cópias): se é este, quem ganha o número novo é a entrada que
+// as cópias continuam dividindo, e os diretórios delas vão para o próximo
+// checkpoint. Quem chama segura a trava de 'dir'.
+TreeNode *directory_unshare_file(Directory *dir, TreeNode *node)
+{
+    const char *name = tree_node_name(node);
+    if (!btree_item_shared(dir->tree, name))
+        return node;
+    FileSystem *fs = dir->fs;
+    TreeNode *own = copy_txt_file(node, name, dir);
+
+    // Os outros diretórios com a entrada estão no anel de 'dir'
+    pthread_mutex_lock(&fs->clones_lock);
+    uint64_t owner = UINT64_MAX;
+    for (Directory *d = dir->clone_next; d != dir; d = d->clone_next)
+        if (d->id < owner && directory_reachable(d) && btree_search(d->tree, name) == node)
+            owner = d->id;
+    bool keep = dir->id < owner;
+    if (keep)
+    {
+        uint64_t ino = tree_node_ino(node), fresh = tree_node_ino(own);
+        __atomic_store_n(&own->data.file->ino, ino, __ATOMIC_RELAXED);
+        __atomic_store_n(&node->data.file->ino, fresh, __ATOMIC_RELAXED);
+        fs_inode_put(&fs->alloc.inodes, ino, own, dir->id);
+        fs_inode_put(&fs->alloc.inodes, fresh, node, (owner == UINT64_MAX) ? dir->id : owner);
+    }
+    fs_journal_lock(fs);
+    directory_mark_dirty(dir);
+    if (keep)
+        for (Directory *d = dir->clone_next; d != dir; d = d->clone_next)
+            if (directory_reachable(d) && btree_search(d->tree, name) == node)
+                directory_mark_dirty(d);
+    if (fs->journal)
+        fs_journal_log_unshare(dir, own, node);
+    fs_journal_unlock(fs);
+    pthread_mutex_unlock(&fs->clones_lock);
+
+    btree_replace(dir->tree, own);
+    dcache_invalidate(dir, name);
+    btree_release_item(dir->tree, node);
+    return own;
+}
+
+// Um checkpoint ou uma imagem grava em cada diretório, por inteiro, a entrada
+// que ele divide com cópias (snapshot, cp -r), com o mesmo número de inode. Se
+// 'ino' já é de um arquivo de um nome só, com o mesmo nome e tamanho, devolve
+// esse arquivo, agora dividido também com 'dir': os dois diretórios voltam a
+// estar no mesmo anel, e a tabela aponta o de menor id (a origem). Senão, NULL.
+TreeNode *directory_reshare_file(Directory *dir, const char *name, uint64_t ino, uint64_t size)
+{
+    FileSystem *fs = dir->fs;
+    TreeNode *node = fs_inode_get(&fs->alloc.inodes, ino);
+    if (!node || node->type != FILE_TYPE || node->data.file->nlink != 1 ||
+        strcmp(tree_node_name(node), name) != 0 || file_size(node->data.file) != size)
+        return NULL;
+    uint64_t parent = 0;
+    fs_inode_visit(&fs->alloc.inodes, ino, inode_parent_visit, &parent);
+    TreeNode *other = fs_inode_get(&fs->alloc.inodes, parent);
+    if (parent == FS_ROOT_DIR_ID)
+        directory_join_clones(dir, fs->root);
+    else if (other && other->type == DIRECTORY_TYPE)
+        directory_join_clones(dir, other->data.directory);
+    if (dir->id < parent)
+        fs_inode_put(&fs->alloc.inodes, ino, node, dir->id);
+    __atomic_fetch_add(&node->refs, 1, __ATOMIC_RELAXED);
+    return node;
+}
+
+// Põe 'dir' no anel das cópias de 'other' (os dois passam a estar no mesmo)
+void directory_join_clones(Directory *dir, Directory *other)
+{
+    pthread_mutex_lock(&dir->fs->clones_lock);
+    bool joined = (dir == other);
+    for (Directory *d = dir->clone_next; d != dir && !joined; d = d->clone_next)
+        joined = (d == other);
+    if (!joined)
+    {
+        Directory *next = dir->clone_next;
+        dir->clone_next = other->clone_next;
+        other->clone_next->clone_prev = dir;
+        other->clone_next = next;
+        next->clone_prev = other;
+    }
+    pthread_mutex_unlock(&dir->fs->clones_lock);
+}
+
+// Escreve no arquivo 'node' de 'dir' a partir de 'offset' (no máximo o tamanho
+// atual; no tamanho, acrescenta no fim). Quem chama segura a trava de 'dir'.
+// Se o item é compartilhado com uma cópia do diretório, ele é trocado antes
+// (directory_unshare_file). Num arquivo com vários nomes, a escrita vale para
+// todos: os totais e a data de cada um mudam, e as escritas vindas de
+// diretórios diferentes passam uma de cada vez, com a trava dos nomes.
+bool directory_file_write(Directory *dir, TreeNode *node, size_t offset, const char *data, size_t len)
+{
+    if (node->type != FILE_TYPE || offset > node->data.file->size)
+        return false;
+    // Um arquivo com vários nomes nunca está numa cópia (directory_clone_links):
+    // a referência a mais que o item pode ter é a da cópia que acabou de
+    // soltá-lo, ainda esperando os leitores
+    bool linked = __atomic_load_n(&node->data.file->links, __ATOMIC_ACQUIRE) != NULL;
+    if (!linked)
+        node = directory_unshare_file(dir, node);
+    FileSystem *fs = dir->fs;
+    File *file = node->data.file;
+    if (linked)
+        fs_links_lock(fs);
+    FileLinks *links = file->links;
+    size_t old_size = file->size;
+    file_write(&fs->alloc, file, offset, data, len);
+
+    time_t now = fs_clock_now();
+    if (links)
+    {
+        for (uint32_t i = 0; i < file->nlink; i++)
+            directory_file_resized(links->items[i].dir, old_size, file->size);
+        file_links_touch(file, now);
+    }
+    else
+    {
+        directory_file_resized(dir, old_size, file->size);
+        __atomic_store_n(&node->modification_time, now, __ATOMIC_RELAXED);
+    }
+    fs_journal_lock(fs);
+    if (links)
+        for (uint32_t i = 0; i < file->nlink; i++)
+            directory_mark_dirty(links->items[i].dir);
+    else
+        directory_mark_dirty(dir);
+    if (fs->journal)
+        fs_journal_log_write(dir, node, offset, data, len);
+    fs_journal_unlock(fs);
+    if (linked)
+        fs_links_unlock(fs);
+    return true;
+}
+
+// Põe em 'dir' o nome 'name' para o arquivo 'src' de 'src_dir' (ln). Se a
+// entrada de origem está compartilhada com uma cópia do diretório, ela ganha
+// antes um arquivo só dela, e é dele que o nome novo passa a ser. Quem chama
+// segura a trava de 'dir' e garante que ninguém mexe em 'src_dir' (no modo
+// servidor, a trava global exclusiva).
+TreeNode *directory_add_link(Directory *dir, const char *name, Directory *src_dir, TreeNode *src)
 {
-    if (dir && dir->parent)
+    if (!src->data.file->links)
+        src = directory_unshare_file(src_dir, src);
+    TreeNode *node = link_txt_file(src, src_dir, name, dir);
+    directory_add_entry(dir, node);
+
+    // O número de nomes também vai para o checkpoint dos outros diretórios
+    FileSystem *fs = dir->fs;
+    File *file = node->data.file;
+    fs_links_lock(fs);
+    fs_journal_lock(fs);
+    for (uint32_t i = 0; i < file->nlink; i++)
+        directory_mark_dirty(file->links->items[i].dir);
+    fs_journal_unlock(fs);
+    fs_links_unlock(fs);
+    return node;
+}
+
+static int directory_name_cmp(const void *a, const void *b)
+{
+    return strcmp((*(Directory *const *)a)->name, (*(Directory *const *)b)->name);
+}
+
+// Cópia de 'src' com o nome 'name', para entrar em 'parent'. A Árvore B da
+// cópia começa como a de 'src' (mesma raiz, com uma referência a mais), e os
+// nós só são copiados quando um dos lados escrever neles. Os subdiretórios
+// precisam de um Directory próprio (pai, id e trava são de cada um): são
+// copiados do mesmo jeito, e o item de cada um é trocado na cópia, o que copia
+// só os nós do caminho até ele. Assim o custo é o dos subdiretórios, e não o
+// das entradas. Os diretórios novos recebem ids seguidos, em pré-ordem e com
+// os subdiretórios em ordem de nome (a reaplicação do journal refaz os mesmos).
+static TreeNode *directory_clone(Directory *src, const char *name, Directory *parent)
+{
+    TreeNode *node = create_directory(name, parent);
+    Directory *dir = node->data.directory;
+    if (src->node)
+    {
+        node->creation_time = src->node->creation_time;
+        node->modification_time = __atomic_load_n(&src->node->modification_time, __ATOMIC_RELAXED);
+        node->last_access_time = __atomic_load_n(&src->node->last_access_time, __ATOMIC_RELAXED);
+    }
+    btree_share(dir->tree, src->tree);
+    directory_join_clones(dir, src);
+    dir->totals = directory_totals_load(src);
+
+    size_t count = 0;
+    for (Directory *sub = src->subdirs; sub; sub = sub->sibling_next)
+        count++;
+    if (count > 0)
     {
-        TreeNode *dir_node_in_parent = btree_search(dir->parent->tree, dir->name);
-        if (dir_node_in_parent) {
-             dir_node_in_parent->modification_time = time(NULL);
+        Directory **subdirs = (Directory **)malloc(count * sizeof(Directory *));
+        count = 0;
+        for (Directory *sub = src->subdirs; sub; sub = sub->sibling_next)
+            subdirs[count++] = sub;
+        qsort(subdirs, count, sizeof(Directory *), directory_name_cmp);
+        for (size_t i = 0; i < count; i++)
+        {
+            TreeNode *child = directory_clone(subdirs[i], subdirs[i]->name, dir);
+            btree_release_item(dir->tree, btree_replace(dir->tree, child));
+            directory_link_child(dir, child->data.directory);
         }
+        free(subdirs);
     }
+
+    fs_journal_lock(dir->fs);
+    directory_mark_dirty(dir);
+    fs_journal_unlock(dir->fs);
+    return node;
 }
 
-void show_metadata(Directory *dir, const char *name)
+typedef struct CloneLink {
+    Directory *dir; // na cópia
+    TreeNode *node; // o nome na origem
+} CloneLink;
+
+static int clone_link_cmp(const void *a, const void *b)
 {
-    TreeNode *node = btree_search(dir->tree, name);
+    const CloneLink *x = (const CloneLink *)a, *y = (const CloneLink *)b;
+    if (x->dir->id != y->dir->id)
+        return (x->dir->id < y->dir->id) ? -1 : 1;
+    return strcmp(tree_node_name(x->node), tree_node_name(y->node));
+}
 
-    if (!node)
+// O diretório da cópia 'copy' de 'src' que corresponde a 'dir' (abaixo de
+// 'src'): os mesmos nomes, do topo para baixo
+static Directory *clone_find_dir(Directory *src, Directory *copy, Directory *dir)
+{
+    if (dir == src)
+        return copy;
+    Directory *parent = clone_find_dir(src, copy, dir->parent);
+    TreeNode *node = parent ? btree_search(parent->tree, dir->name) : NULL;
+    return (node && node->type == DIRECTORY_TYPE) ? node->data.directory : NULL;
+}
+
+// Na cópia 'copy' de 'src', os nomes de arquivos com mais de um nome (que a
+// cópia compartilha com a origem) viram arquivos à parte, com inodes novos: o
+// ln não atravessa cópias, e as entradas desses arquivos não ficam
+// compartilhadas. Em ordem de id do diretório e de nome, para que a
+// reaplicação do journal dê os mesmos números.
+static void directory_clone_links(Directory *src, Directory *copy)
+{
+    FileSystem *fs = src->fs;
+    CloneLink *found = NULL;
+    size_t count = 0, capacity = 0;
+    fs_links_lock(fs);
+    for (FileLinks *links = fs->links; links; links = links->next)
+        for (uint32_t i = 0; i < links->file->nlink; i++)
+        {
+            if (!directory_contains(src, links->items[i].dir))
+                continue;
+            if (count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 16;
+                found = (CloneLink *)realloc(found, capacity * sizeof(CloneLink));
+                if (!found)
+                {
+                    perror("Erro ao reservar memória");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            found[count].dir = clone_find_dir(src, copy, links->items[i].dir);
+            found[count].node = links->items[i].node;
+            if (found[count].dir)
+                count++;
+        }
+    fs_links_unlock(fs);
+
+    if (count > 1)
+        qsort(found, count, sizeof(CloneLink), clone_link_cmp);
+    for (size_t i = 0; i < count; i++)
     {
-        printf("stat: não foi possível encontrar o arquivo ou diretório '%s'\n", name);
-        return;
+        Directory *dir = found[i].dir;
+        TreeNode *own = copy_txt_file(found[i].node, tree_node_name(found[i].node), dir);
+        btree_release_item(dir->tree, btree_replace(dir->tree, own));
     }
+    free(found);
+}
 
-    char created_buf[20], modified_buf[20], accessed_buf[20];
-    strftime(created_buf, sizeof(created_buf), "%d-%m-%Y %H:%M:%S", localtime(&node->creation_time));
-    strftime(modified_buf, sizeof(modified_buf), "%d-%m-%Y %H:%M:%S", localtime(&node->modification_time));
-    strftime(accessed_buf, sizeof(accessed_buf), "%d-%m-%Y %H:%M:%S", localtime(&node->last_access_time));
+// Põe em 'dir' uma cópia de 'src' chamada 'name' (cp -r, snapshot). Quem chama
+// segura a trava de 'dir' e garante que ninguém escreve na subárvore de 'src'
+// durante a cópia (no modo servidor, a trava global exclusiva).
+TreeNode *directory_add_clone(Directory *dir, const char *name, Directory *src)
+{
+    TreeNode *node = directory_clone(src, name, dir);
+    if (src->fs->links)
+        directory_clone_links(src, node->data.directory);
+    btree_insert(dir->tree, node);
+    directory_link_child(dir, node->data.directory);
+    DirectoryTotals delta = entry_totals(node);
+    directory_totals_apply(dir, &delta, true);
+    fs_journal_lock(dir->fs);
+    directory_mark_dirty(dir);
+    if (dir->fs->journal)
+        fs_journal_log_clone(dir, node, src);
+    fs_journal_unlock(dir->fs);
+    return node;
+}
 
-    printf("  Arquivo: %s\n", node->name);
-    printf("     Tipo: %s\n", (node->type == FILE_TYPE) ? "Arquivo .txt" : "Diretório");
-    if (node->type == FILE_TYPE)
+// Recalcula os totais de 'dir' a partir das entradas dele, para diretórios
+// montados de uma vez (btree_bulk_load) e não entrada por entrada. Os totais
+// dos subdiretórios já precisam estar certos.
+void directory_recount(Directory *dir)
+{
+    memset(&dir->totals, 0, sizeof(DirectoryTotals));
+    dir->subdirs = NULL;
+    BTreeCursor cursor;
+    btree_cursor_open(&cursor, dir->tree);
+    TreeNode *item;
+    while ((item = btree_cursor_next(&cursor)) != NULL)
     {
-        printf("   Tamanho: %ld Bytes\n", node->data.file->size);
-        printf("  Conteúdo: %s\n", node->data.file->content);
+        if (item->type == DIRECTORY_TYPE)
+            directory_link_child(dir, item->data.directory);
+        DirectoryTotals t = entry_totals(item);
+        dir->totals.bytes += t.bytes;
+        dir->totals.files += t.files;
+        dir->totals.dirs += t.dirs;
     }
-    printf("    Acesso: %s (Última vez aberto/consultado)\n", accessed_buf);
-    printf("Modificado: %s (Última alteração no conteúdo)\n", modified_buf);
-    printf("   Criação: %s (Data de criação)\n", created_buf);
+}
+
+// Muda a data de modificação do diretório (guardada no TreeNode dele, no pai)
+void directory_set_mtime(Directory *dir, time_t mtime)
+{
+    if (!dir || !dir->node)
+        return;
+    __atomic_store_n(&dir->node->modification_time, mtime, __ATOMIC_RELAXED);
+    fs_journal_lock(dir->fs);
+    directory_mark_dirty(dir->parent);
+    if (dir->fs->journal)
+        fs_journal_log_mtime(dir, mtime);
+    fs_journal_unlock(dir->fs);
+}
+
+// Põe o diretório na lista dos que precisam ir para o próximo checkpoint.
+// Sem journal não há checkpoint, então não há o que marcar.
+void directory_mark_dirty(Directory *dir)
+{
+    FileSystem *fs = dir->fs;
+    if (!fs->journal || dir->dirty)
+        return;
+    dir->dirty = true;
+    dir->dirty_prev = NULL;
+    dir->dirty_next = fs->dirty_head;
+    if (fs->dirty_head)
+        fs->dirty_head->dirty_prev = dir;
+    fs->dirty_head = dir;
+}
+
+void directory_clear_dirty(Directory *dir)
+{
+    if (!dir->dirty)
+        return;
+    if (dir->dirty_prev)
+        dir->dirty_prev->dirty_next = dir->dirty_next;
+    else
+        dir->fs->dirty_head = dir->dirty_next;
+    if (dir->dirty_next)
+        dir->dirty_next->dirty_prev = dir->dirty_prev;
+    dir->dirty = false;
+    dir->dirty_prev = NULL;
+    dir->dirty_next = NULL;
+}
+
+// --- Cache de Entradas e Resolução de Caminhos ---
+
+static uint64_t dcache_hash(uint64_t dir_id, const char *name)
+{
+    uint64_t h = 14695981039346656037ULL ^ (dir_id * 0x9E3779B97F4A7C15ULL);
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+        h = (h ^ *p) * 1099511628211ULL;
+    return h;
+}
+
+static DentryCacheSlot *dcache_slot(DentryCache *cache, uint64_t hash)
+{
+    return &cache->slots[(hash ^ (hash >> 32)) & (DCACHE_SLOTS - 1)];
+}
+
+static void dcache_count(const FileSystem *fs, uint64_t *counter)
+{
+    if (fs->concurrent)
+        __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+    else
+        (*counter)++;
+}
+
+// Copia a posição sem travas; a cópia só vale se a versão era par (ninguém
+// gravando) e não mudou durante a leitura
+static bool dcache_read(const DentryCacheSlot *slot, DentryCacheSlot *copy)
+{
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+        return false;
+    copy->dir_id = __atomic_load_n(&slot->dir_id, __ATOMIC_RELAXED);
+    copy->hash = __atomic_load_n(&slot->hash, __ATOMIC_RELAXED);
+    copy->node = __atomic_load_n(&slot->node, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+// Reserva a posição para gravar (versão ímpar). Se outra thread estiver
+// gravando nela, desiste (o cache só perde uma entrada), a não ser com 'wait',
+// usado na invalidação.
+static bool dcache_begin_write(DentryCacheSlot *slot, uint32_t *seq, bool wait)
+{
+    *seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    while ((*seq & 1) || !__atomic_compare_exchange_n(&slot->seq, seq, *seq + 1, false,
+                                                      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+        if (!wait)
+            return false;
+        *seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return true;
+}
+
+static void dcache_set(DentryCacheSlot *slot, uint64_t dir_id, uint64_t hash, TreeNode *node)
+{
+    __atomic_store_n(&slot->dir_id, dir_id, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->hash, hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->node, node, __ATOMIC_RELAXED);
+}
+
+static void dcache_end_write(DentryCacheSlot *slot, uint32_t seq)
+{
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Busca 'name' em 'dir', passando primeiro pelo cache de entradas. Não precisa
+// de trava: no modo concorrente, quem chama está numa seção de leitura, e uma
+// posição com o id de 'dir' nunca aponta para uma entrada já liberada (a
+// remoção invalida a posição antes de aposentar o item).
+TreeNode *directory_lookup(Directory *dir, const char *name)
+{
+    DentryCache *cache = &dir->fs->dcache;
+    uint64_t hash = dcache_hash(dir->id, name);
+    DentryCacheSlot *slot = dcache_slot(cache, hash);
+    DentryCacheSlot copy;
+    if (dcache_read(slot, &copy) && copy.dir_id == dir->id && copy.hash == hash && strcmp(tree_node_name(copy.node), name) == 0)
+    {
+        dcache_count(dir->fs, &cache->hits);
+        return copy.node;
+    }
+
+    dcache_count(dir->fs, &cache->misses);
+    uint64_t gen = __atomic_load_n(&dir->tree->gen, __ATOMIC_SEQ_CST);
+    TreeNode *node = btree_search(dir->tree, name);
+    uint32_t seq;
+    if (node && dcache_begin_write(slot, &seq, false))
+    {
+        // Se a árvore mudou desde a busca, o item pode ter sido removido e a
+        // invalidação já ter passado por aqui: gravá-lo agora o deixaria no
+        // cache. A versão é conferida com a posição reservada, e a invalidação
+        // reserva a posição depois de publicar a nova versão.
+        if (__atomic_load_n(&dir->tree->gen, __ATOMIC_SEQ_CST) == gen)
+            dcache_set(slot, dir->id, hash, node);
+        dcache_end_write(slot, seq);
+    }
+    return node;
+}
+
+static void dcache_invalidate(Directory *dir, const char *name)
+{
+    DentryCache *cache = &dir->fs->dcache;
+    uint64_t hash = dcache_hash(dir->id, name);
+    DentryCacheSlot *slot = dcache_slot(cache, hash);
+    uint32_t seq;
+    dcache_begin_write(slot, &seq, true);
+    if (slot->dir_id == dir->id && slot->hash == hash && strcmp(tree_node_name(slot->node), name) == 0)
+    {
+        dcache_set(slot, 0, 0, NULL);
+        dcache_count(dir->fs, &cache->invalidations);
+    }
+    dcache_end_write(slot, seq);
+}
+
+// Resolve um caminho absoluto ou relativo a 'cwd', com vários componentes,
+// "." e "..". Todos os componentes menos o último precisam ser diretórios
+// existentes; o último pode não existir (lookup->node fica NULL), para que
+// mkdir e touch saibam onde criar. Devolve false se o caminho não leva a lugar
+// nenhum. Sempre chame path_lookup_free depois.
+//
+// No modo concorrente, a busca desce sem travas, numa seção de leitura que só
+// termina no path_lookup_free: até lá, nada do que ela encontrou é liberado.
+// Com LOOKUP_WRITE, o pai do último componente fica travado (lookup->locked);
+// se ele já tiver sido removido, a busca falha.
+bool path_lookup(Directory *cwd, const char *path, PathLookup *lookup, LookupMode mode)
+{
+    memset(lookup, 0, sizeof(*lookup));
+    lookup->buffer = strdup(path);
+    if (cwd->fs->concurrent)
+    {
+        fs_epoch_enter();
+        lookup->epoch = true;
+    }
+    Directory *dir = (path[0] == '/') ? cwd->fs->root : cwd;
+
+    // "a/b/" é o mesmo que "a/b"
+    size_t len = strlen(lookup->buffer);
+    while (len > 1 && lookup->buffer[len - 1] == '/')
+        lookup->buffer[--len] = '\0';
+
+    char *last = strrchr(lookup->buffer, '/');
+    char *name = last ? last + 1 : lookup->buffer;
+    bool special = name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+    // O nome fica disponível mesmo se o caminho não existir, para as mensagens
+    lookup->name = special ? NULL : name;
+    if (last)
+    {
+        *last = '\0';
+        char *save = NULL;
+        for (char *comp = strtok_r(lookup->buffer, "/", &save); comp; comp = strtok_r(NULL, "/", &save))
+        {
+            if (strcmp(comp, ".") == 0)
+                continue;
+            if (strcmp(comp, "..") == 0)
+            {
+                if (dir->parent)
+                    dir = dir->parent;
+                continue;
+            }
+            TreeNode *node = directory_lookup(dir, comp);
+            if (!node || node->type != DIRECTORY_TYPE)
+                return false;
+            dir = node->data.directory;
+        }
+    }
+
+    if (special)
+    {
+        if (strcmp(name, "..") == 0 && dir->parent)
+            dir = dir->parent;
+        lookup->dir = dir;
+        lookup->parent = dir->parent;
+        lookup->node = dir->node;
+        return true;
+    }
+
+    if (mode == LOOKUP_WRITE)
+    {
+        directory_lock(dir);
+        lookup->locked = dir;
+        // rmdir marca o diretório com a trava dele: o que se vê aqui é definitivo
+        if (__atomic_load_n(&dir->removed, __ATOMIC_ACQUIRE))
+            return false;
+    }
+    lookup->parent = dir;
+    lookup->node = directory_lookup(dir, name);
+    if (lookup->node && lookup->node->type == DIRECTORY_TYPE)
+        lookup->dir = lookup->node->data.directory;
+    return true;
+}
+
+void path_lookup_free(PathLookup *lookup)
+{
+    if (lookup->locked)
+    {
+        directory_unlock(lookup->locked);
+        lookup->locked = NULL;
+    }
+    if (lookup->epoch)
+    {
+        fs_epoch_exit();
+        lookup->epoch = false;
+    }
+    free(lookup->buffer);
+    lookup->buffer = NULL;
+    lookup->name = NULL;
+}
+
+// --- Sistema de Arquivos ---
+
+FileSystem *fs_create()
+{
+    FileSystem *fs = (FileSystem *)malloc(sizeof(FileSystem));
+    fs_alloc_init(&fs->alloc);
+
+    Directory *root = (Directory *)slab_alloc(&fs->alloc.directories);
+    root->name = "/";
+    root->parent = NULL;
+    root->tree = btree_create(&fs->alloc);
+    root->fs = fs;
+    root->node = NULL;
+    root->path = NULL;
+    root->path_len = 0;
+    root->id = FS_ROOT_DIR_ID;
+    memset(&root->totals, 0, sizeof(DirectoryTotals));
+    pthread_mutex_init(&root->lock, NULL);
+    root->pins = 0;
+    root->removed = false;
+    root->dirty = false;
+    root->clone_prev = root;
+    root->clone_next = root;
+    root->dirty_prev = NULL;
+    root->dirty_next = NULL;
+    root->subdirs = NULL;
+    root->sibling_prev = NULL;
+    root->sibling_next = NULL;
+    fs->root = root;
+    fs->next_ino = FS_ROOT_DIR_ID + 1;
+    fs->links = NULL;
+    fs->dirty_head = NULL;
+    fs->journal = NULL;
+    fs->atime_policy = ATIME_RELATIME;
+    fs->reclaimer = NULL;
+    pthread_mutex_init(&fs->clones_lock, NULL);
+    fs->dcache.slots = (DentryCacheSlot *)calloc(DCACHE_SLOTS, sizeof(DentryCacheSlot));
+    fs->dcache.hits = 0;
+    fs->dcache.misses = 0;
+    fs->dcache.invalidations = 0;
+    fs->concurrent = false;
+    return fs;
+}
+
+void fs_destroy(FileSystem *fs)
+{
+    if (fs)
+    {
+        fs_journal_close(fs->journal);
+        fs_reclaim_stop(fs);
+        // As listas de nomes vão antes da árvore; os arquivos, com o último nome
+        while (fs->links)
+        {
+            FileLinks *next = fs->links->next;
+            free(fs->links->items);
+            free(fs->links);
+            fs->links = next;
+        }
+        delete_directory_recursive(fs->root);
+        free(fs->dcache.slots);
+        // Sem sessões, nada mais pode estar lendo o que foi aposentado
+        if (fs->concurrent)
+            fs_epoch_drain();
+        // O que foi aposentado também sai dos anéis
+        pthread_mutex_destroy(&fs->clones_lock);
+        fs_alloc_destroy(&fs->alloc);
+        if (fs->concurrent)
+        {
+            pthread_rwlock_destroy(&fs->lock);
+            pthread_mutex_destroy(&fs->journal_lock);
+            pthread_mutex_destroy(&fs->links_lock);
+        }
+        free(fs);
+    }
+}
+
+// --- Modo Concorrente ---
+
+// Liga o modo concorrente. Precisa ser chamado antes de as outras threads
+// começarem a usar o sistema de arquivos; fora dele, as funções de trava e de
+// pin abaixo não fazem nada.
+void fs_set_concurrent(FileSystem *fs)
+{
+    if (fs->concurrent)
+        return;
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    // Com preferência pelos leitores, um fluxo contínuo de comandos comuns
+    // deixaria um save ou um checkpoint esperando para sempre
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&fs->lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    pthread_mutex_init(&fs->journal_lock, NULL);
+    pthread_mutex_init(&fs->links_lock, NULL);
+    fs_alloc_set_concurrent(&fs->alloc);
+    fs->concurrent = true;
+}
+
+// Trava global: compartilhada pelos comandos comuns, exclusiva para os que
+// percorrem ou gravam a árvore inteira
+void fs_lock(FileSystem *fs, bool exclusive)
+{
+    if (!fs->concurrent)
+        return;
+    if (exclusive)
+        pthread_rwlock_wrlock(&fs->lock);
+    else
+        pthread_rwlock_rdlock(&fs->lock);
+}
+
+void fs_unlock(FileSystem *fs)
+{
+    if (fs->concurrent)
+        pthread_rwlock_unlock(&fs->lock);
+}
+
+// --- Data de Acesso e Relógio ---
+
+static const char *const atime_policy_names[] = {"strict", "relatime", "noatime"};
+
+const char *fs_atime_policy_name(AtimePolicy policy)
+{
+    return atime_policy_names[policy];
+}
+
+bool fs_parse_atime_policy(const char *name, AtimePolicy *policy)
+{
+    for (int p = ATIME_STRICT; p <= ATIME_NOATIME; p++)
+    {
+        if (strcmp(name, atime_policy_names[p]) == 0)
+        {
+            *policy = (AtimePolicy)p;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Registra uma leitura do item, conforme a política. Só escreve quando a data
+// muda de fato, para não sujar a linha de cache que as outras sessões leem.
+void node_touch_atime(FileSystem *fs, TreeNode *node)
+{
+    AtimePolicy policy = __atomic_load_n(&fs->atime_policy, __ATOMIC_RELAXED);
+    if (policy == ATIME_NOATIME)
+        return;
+    time_t accessed = __atomic_load_n(&node->last_access_time, __ATOMIC_RELAXED);
+    time_t now = fs_clock_now();
+    if (policy == ATIME_RELATIME && accessed > __atomic_load_n(&node->modification_time, __ATOMIC_RELAXED) &&
+        now - accessed < FS_RELATIME_WINDOW)
+        return;
+    if (accessed != now)
+        __atomic_store_n(&node->last_access_time, now, __ATOMIC_RELAXED);
+}
+
+// Hora parada do comando em andamento nesta thread (0: nenhum)
+static __thread time_t clock_frozen;
+
+void fs_clock_begin(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    clock_frozen = ts.tv_sec;
+}
+
+void fs_clock_end(void)
+{
+    clock_frozen = 0;
+}
+
+time_t fs_clock_now(void)
+{
+    return clock_frozen ? clock_frozen : time(NULL);
+}
+
+// Trava de quem altera a Árvore B de um diretório; quem só lê não a usa.
+// Para evitar deadlock, quem segura uma trava só pede outra descendo na
+// árvore (pai e depois filho, como no rmdir).
+void directory_lock(Directory *dir)
+{
+    if (dir->fs->concurrent)
+        pthread_mutex_lock(&dir->lock);
+}
+
+void directory_unlock(Directory *dir)
+{
+    if (dir->fs->concurrent)
+        pthread_mutex_unlock(&dir->lock);
+}
+
+// Um diretório pinado não pode ser removido: o diretório atual de cada sessão
+// fica pinado. O pin falha (devolve false) se o diretório já foi marcado como
+// removido. O pin e a marca são gravados antes de o outro ser conferido, então
+// quando os dois se cruzam ao menos um dos lados vê o outro. O pin conta
+// também nos ancestrais: num número só, o rm -r vê se há alguma sessão dentro
+// da subárvore.
+bool directory_pin(Directory *dir)
+{
+    if (!dir->fs->concurrent)
+        return true;
+    for (Directory *d = dir; d; d = d->parent)
+        __atomic_fetch_add(&d->pins, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&dir->removed, __ATOMIC_SEQ_CST))
+        return true;
+    for (Directory *d = dir; d; d = d->parent)
+        __atomic_fetch_sub(&d->pins, 1, __ATOMIC_RELEASE);
+    return false;
+}
+
+void directory_unpin(Directory *dir)
+{
+    if (!dir->fs->concurrent)
+        return;
+    for (Directory *d = dir; d; d = d->parent)
+        __atomic_fetch_sub(&d->pins, 1, __ATOMIC_RELEASE);
+}
+
+// Marca o diretório como removido, se ninguém o estiver segurando; senão
+// devolve false e deixa como estava. Quem chama segura a trava dele.
+bool directory_mark_removed(Directory *dir)
+{
+    __atomic_store_n(&dir->removed, true, __ATOMIC_SEQ_CST);
+    if (dir->fs->concurrent && __atomic_load_n(&dir->pins, __ATOMIC_SEQ_CST) > 0)
+    {
+        __atomic_store_n(&dir->removed, false, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+// --- Funções de Navegação e Comandos ---
+
+// A saída do ls é montada em blocos e gravada com fwrite, em vez de um printf
+// por entrada
+#define LIST_BUFFER_SIZE 16384
+
+typedef struct ListOutput {
+    char data[LIST_BUFFER_SIZE];
+    size_t size;
+    FILE *fp;
+} ListOutput;
+
+static void list_output_flush(ListOutput *out)
+{
+    fwrite(out->data, 1, out->size, out->fp);
+    out->size = 0;
+}
+
+static void list_output_write(ListOutput *out, const char *src, size_t len)
+{
+    if (out->size + len > LIST_BUFFER_SIZE)
+        list_output_flush(out);
+    if (len > LIST_BUFFER_SIZE)
+    {
+        fwrite(src, 1, len, out->fp);
+        return;
+    }
+    memcpy(out->data + out->size, src, len);
+    out->size += len;
+}
+
+// Escreve a data 't' em 'buf' no formato 'format' e devolve o tamanho. Uma data
+// que localtime_r não converte ou que não cabe em 'buf' (vinda de uma imagem
+// ou de um checkpoint, que não a conferem) sai como um marcador.
+static size_t format_time(char *buf, size_t size, const char *format, time_t t)
+{
+    struct tm tm;
+    size_t len = localtime_r(&t, &tm) ? strftime(buf, size, format, &tm) : 0;
+    if (len == 0)
+        len = (size_t)snprintf(buf, size, "(data inválida)");
+    return len;
+}
+
+static void list_output_entry(ListOutput *out, const TreeNode *item, bool long_format)
+{
+    if (long_format)
+    {
+        char time_buf[20];
+        time_t mtime = __atomic_load_n(&item->modification_time, __ATOMIC_RELAXED);
+        size_t time_len = format_time(time_buf, sizeof(time_buf), "%d-%m-%Y %H:%M", mtime);
+        list_output_write(out, time_buf, time_len);
+        list_output_write(out, "  ", 2);
+    }
+    list_output_write(out, tree_node_name(item), strlen(tree_node_name(item)));
+    if (item->type == DIRECTORY_TYPE)
+        list_output_write(out, "/", 1);
+    list_output_write(out, long_format ? "\n" : "  ", long_format ? 1 : 2);
+}
+
+// Primeiro nome depois de todos os que começam com 'prefix': o prefixo sem os
+// bytes 0xFF finais e com o último byte incrementado. NULL se não houver limite.
+static char *prefix_upper_bound(const char *prefix)
+{
+    size_t len = strlen(prefix);
+    while (len > 0 && (unsigned char)prefix[len - 1] == 0xFF)
+        len--;
+    if (len == 0)
+        return NULL;
+    char *bound = strndup(prefix, len);
+    bound[len - 1]++;
+    return bound;
+}
+
+// Parte literal do início de um padrão glob, antes do primeiro metacaractere
+static char *glob_literal_prefix(const char *pattern)
+{
+    return strndup(pattern, strcspn(pattern, "*?[\\"));
+}
+
+static const char *max_bound(const char *a, const char *b)
+{
+    if (!a) return b;
+    if (!b) return a;
+    return strcmp(a, b) >= 0 ? a : b;
+}
+
+static const char *min_bound(const char *a, const char *b)
+{
+    if (!a) return b;
+    if (!b) return a;
+    return strcmp(a, b) <= 0 ? a : b;
+}
+
+// Intervalo [from, to) de nomes que pode conter entradas do filtro: o prefixo,
+// a parte literal do glob e o 'after' viram limites. 'owned' guarda os limites
+// alocados aqui.
+typedef struct FilterBounds {
+    const char *from;
+    const char *to;
+    char *owned[3];
+} FilterBounds;
+
+// Devolve false se o intervalo for vazio
+static bool filter_bounds(const ListFilter *f, FilterBounds *b)
+{
+    memset(b, 0, sizeof(*b));
+    b->from = max_bound(f->from, f->after);
+    b->to = f->to;
+    if (f->prefix)
+    {
+        b->owned[0] = prefix_upper_bound(f->prefix);
+        b->from = max_bound(b->from, f->prefix);
+        b->to = min_bound(b->to, b->owned[0]);
+    }
+    if (f->pattern)
+    {
+        b->owned[1] = glob_literal_prefix(f->pattern);
+        b->owned[2] = prefix_upper_bound(b->owned[1]);
+        b->from = max_bound(b->from, b->owned[1]);
+        b->to = min_bound(b->to, b->owned[2]);
+    }
+    return !b->from || !b->to || strcmp(b->from, b->to) < 0;
+}
+
+static void filter_bounds_free(FilterBounds *b)
+{
+    for (int i = 0; i < 3; i++)
+        free(b->owned[i]);
+}
+
+// Posição (em ordem) da primeira entrada do intervalo, descontando o 'after'
+static size_t filter_first_rank(BTree *tree, const ListFilter *f, const FilterBounds *b)
+{
+    if (!b->from)
+        return 0;
+    size_t rank = btree_rank(tree, b->from);
+    if (f->after && strcmp(b->from, f->after) == 0 && btree_search(tree, f->after))
+        rank++;
+    return rank;
+}
+
+// Lista as entradas que passam pelo filtro (NULL lista todas). O cursor
+// começa direto no primeiro nome candidato (ou, com --offset, na posição pedida,
+// achada pelas contagens das subárvores) e para no primeiro que passa do
+// intervalo ou ao completar a página. Devolve quantas entradas foram listadas.
+// No modo concorrente, quem chama está numa seção de leitura (ver path_lookup).
+size_t list_directory_contents(FILE *fp, Directory *dir, bool long_format, const ListFilter *filter)
+{
+    ListFilter f = {NULL, NULL, NULL, NULL, NULL, 0, 0};
+    if (filter)
+        f = *filter;
+    FilterBounds bounds;
+    bool nonempty = filter_bounds(&f, &bounds);
+    const char *to = bounds.to;
+
+    ListOutput *out = (ListOutput *)malloc(sizeof(ListOutput));
+    out->size = 0;
+    out->fp = fp;
+    size_t count = 0;
+    const TreeNode *last = NULL;
+    bool more = false;
+    if (nonempty)
+    {
+        // Sem glob, cada posição é uma entrada: o offset vira um salto direto
+        size_t skip = f.offset;
+        BTreeCursor cursor;
+        if (skip > 0 && !f.pattern)
+        {
+            btree_cursor_seek_rank(&cursor, dir->tree, filter_first_rank(dir->tree, &f, &bounds) + skip);
+            skip = 0;
+        }
+        else
+        {
+            btree_cursor_seek(&cursor, dir->tree, bounds.from);
+        }
+        TreeNode *item;
+        while ((item = btree_cursor_next(&cursor)) != NULL)
+        {
+            if (to && strcmp(tree_node_name(item), to) >= 0)
+                break;
+            if ((f.after && strcmp(tree_node_name(item), f.after) == 0) ||
+                (f.pattern && fnmatch(f.pattern, tree_node_name(item), 0) != 0))
+                continue;
+            if (skip > 0)
+            {
+                skip--;
+                continue;
+            }
+            if (f.limit && count == f.limit)
+            {
+                more = true;
+                break;
+            }
+            if (count++ == 0)
+            {
+                list_output_write(out, "Conteúdo de ", strlen("Conteúdo de "));
+                list_output_write(out, dir->name, strlen(dir->name));
+                list_output_write(out, ":\n", 2);
+            }
+            list_output_entry(out, item, long_format);
+            last = item;
+        }
+    }
+    if (count > 0 && !long_format)
+        list_output_write(out, "\n", 1);
+    list_output_flush(out);
+    free(out);
+
+    if (more)
+        fprintf(fp, "-- mais entradas: continue com --after %s\n", tree_node_name(last));
+    else if (count == 0 && !filter)
+        fprintf(fp, "Diretório %s está vazio.\n", dir->name);
+
+    filter_bounds_free(&bounds);
+    if (dir->node != NULL)
+        node_touch_atime(dir->fs, dir->node);
+    return count;
+}
+
+// Quantas entradas passam pelo filtro (NULL: todas). Sem glob, é a diferença
+// entre as posições dos limites do intervalo, O(log n); com glob, só o
+// intervalo da parte literal é percorrido.
+size_t directory_count(Directory *dir, const ListFilter *filter)
+{
+    if (!filter)
+        return btree_count(dir->tree);
+
+    FilterBounds bounds;
+    size_t count = 0;
+    if (filter_bounds(filter, &bounds))
+    {
+        size_t first = filter_first_rank(dir->tree, filter, &bounds);
+        if (!filter->pattern)
+        {
+            size_t end = bounds.to ? btree_rank(dir->tree, bounds.to) : btree_count(dir->tree);
+            count = end > first ? end - first : 0;
+        }
+        else
+        {
+            BTreeCursor cursor;
+            btree_cursor_seek_rank(&cursor, dir->tree, first);
+            TreeNode *item;
+            while ((item = btree_cursor_next(&cursor)) != NULL)
+            {
+                if (bounds.to && strcmp(tree_node_name(item), bounds.to) >= 0)
+                    break;
+                if (fnmatch(filter->pattern, tree_node_name(item), 0) == 0)
+                    count++;
+            }
+        }
+    }
+    filter_bounds_free(&bounds);
+    return count;
+}
+
+void change_directory(FILE *out, Directory **current_dir, const char *path)
+{
+    PathLookup lookup;
+    bool found;
+    // O diretório atual fica pinado enquanto a sessão estiver nele. Se o pin
+    // falhar, um rmdir está no meio: busca de novo, até ele desistir (o
+    // diretório continua lá) ou terminar (não está mais).
+    while ((found = path_lookup(*current_dir, path, &lookup, LOOKUP_READ) && lookup.dir) &&
+           !directory_pin(lookup.dir))
+        path_lookup_free(&lookup);
+    if (found)
+    {
+        if (lookup.node && lookup.dir != *current_dir)
+            node_touch_atime(lookup.dir->fs, lookup.node);
+        directory_unpin(*current_dir);
+        *current_dir = lookup.dir;
+    }
+    else
+    {
+        fprintf(out, "cd: diretório não encontrado: %s\n", path);
+    }
+    path_lookup_free(&lookup);
+}
+
+// O caminho é montado uma única vez, a partir do caminho (já guardado) do
+// pai, e fica no próprio diretório: diretórios não mudam de nome nem de lugar,
+// então ele só precisa ser montado quando o diretório é usado pela primeira vez.
+// No modo concorrente, duas sessões podem montá-lo ao mesmo tempo: vale o
+// primeiro publicado.
+const char *get_current_path(Directory *dir)
+{
+    char *path = __atomic_load_n(&dir->path, __ATOMIC_ACQUIRE);
+    if (path)
+        return path;
+
+    size_t len;
+    if (dir->parent == NULL)
+    {
+        path = strdup("/");
+        len = 1;
+    }
+    else
+    {
+        const char *parent_path = get_current_path(dir->parent);
+        size_t parent_len = (dir->parent->parent == NULL) ? 0 : __atomic_load_n(&dir->parent->path_len, __ATOMIC_RELAXED);
+        size_t name_len = strlen(dir->name);
+        path = (char *)malloc(parent_len + name_len + 2);
+        memcpy(path, parent_path, parent_len);
+        path[parent_len] = '/';
+        memcpy(path + parent_len + 1, dir->name, name_len + 1);
+        len = parent_len + 1 + name_len;
+    }
+
+    __atomic_store_n(&dir->path_len, len, __ATOMIC_RELAXED);
+    char *expected = NULL;
+    if (!__atomic_compare_exchange_n(&dir->path, &expected, path, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+    {
+        free(path);
+        return expected;
+    }
+    return path;
+}
+
+void update_parent_modification_time(Directory *dir)
+{
+    directory_set_mtime(dir, fs_clock_now());
+}
+
+// Os metadados de 'node'; com 'path', também o caminho (stat -i)
+static void print_metadata(FILE *out, const TreeNode *node, const char *path)
+{
+    // As datas de acesso e modificação mudam sem a trava do diretório
+    time_t modified = __atomic_load_n(&node->modification_time, __ATOMIC_RELAXED);
+    time_t accessed = __atomic_load_n(&node->last_access_time, __ATOMIC_RELAXED);
+    char created_buf[20], modified_buf[20], accessed_buf[20];
+    format_time(created_buf, sizeof(created_buf), "%d-%m-%Y %H:%M:%S", node->creation_time);
+    format_time(modified_buf, sizeof(modified_buf), "%d-%m-%Y %H:%M:%S", modified);
+    format_time(accessed_buf, sizeof(accessed_buf), "%d-%m-%Y %H:%M:%S", accessed);
+
+    fprintf(out, "  Arquivo: %s\n", tree_node_name(node));
+    if (path)
+        fprintf(out, "  Caminho: %s\n", path);
+    fprintf(out, "     Tipo: %s\n", (node->type == FILE_TYPE) ? "Arquivo .txt" : "Diretório");
+    fprintf(out, "     Inode: %llu\n", (unsigned long long)tree_node_ino(node));
+    if (node->type == FILE_TYPE)
+    {
+        fprintf(out, "  Ligações: %u\n", __atomic_load_n(&node->data.file->nlink, __ATOMIC_RELAXED));
+        fprintf(out, "   Tamanho: %zu Bytes\n", file_size(node->data.file));
+        fprintf(out, "  Conteúdo: ");
+        file_print(out, node->data.file, 0, SIZE_MAX);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "    Acesso: %s (Última vez aberto/consultado)\n", accessed_buf);
+    fprintf(out, "Modificado: %s (Última alteração no conteúdo)\n", modified_buf);
+    fprintf(out, "   Criação: %s (Data de criação)\n", created_buf);
+}
+
+// A raiz não tem TreeNode (nem datas): só o nome, o tipo e o inode
+static void print_root_metadata(FILE *out)
+{
+    fprintf(out, "  Arquivo: /\n");
+    fprintf(out, "  Caminho: /\n");
+    fprintf(out, "     Tipo: Diretório\n");
+    fprintf(out, "     Inode: %llu\n", (unsigned long long)FS_ROOT_DIR_ID);
+}
+
+void show_metadata(FILE *out, Directory *dir, const char *path)
+{
+    PathLookup lookup;
+    bool found = path_lookup(dir, path, &lookup, LOOKUP_READ);
+    TreeNode *node = found ? lookup.node : NULL;
+    if (found && !node && lookup.dir == dir->fs->root)
+    {
+        print_root_metadata(out);
+        path_lookup_free(&lookup);
+        return;
+    }
+    if (!node)
+    {
+        fprintf(out, "stat: não foi possível encontrar o arquivo ou diretório '%s'\n", path);
+        path_lookup_free(&lookup);
+        return;
+    }
+    print_metadata(out, node, NULL);
+    node_touch_atime(dir->fs, node);
+    path_lookup_free(&lookup);
+}
+
+typedef struct InodeMetadata {
+    FILE *out;
+    FileSystem *fs;
+    uint64_t parent; // diretório em que o arquivo foi posto
+    Directory *dir;  // ... se ainda está na tabela
+    bool found;
+} InodeMetadata;
+
+static void inode_dir_visit(TreeNode *node, uint64_t parent, void *ctx)
+{
+    (void)parent;
+    if (node->type == DIRECTORY_TYPE)
+        ((InodeMetadata *)ctx)->dir = node->data.directory;
+}
+
+// O arquivo 'node' está em 'dir' ou numa cópia dele (snapshot, cp -r) que
+// ainda tem caminho, e não só numa subárvore do rm -r na fila de liberação.
+// Com a trava dos anéis.
+static bool directory_holds(Directory *dir, TreeNode *node)
+{
+    if (!dir->clone_next)
+        return false;
+    const char *name = tree_node_name(node);
+    Directory *d = dir;
+    do
+    {
+        if (directory_reachable(d) && btree_search(d->tree, name) == node)
+            return true;
+        d = d->clone_next;
+    } while (d != dir);
+    return false;
+}
+
+static void inode_metadata_visit(TreeNode *node, uint64_t parent, void *ctx)
+{
+    (void)parent;
+    InodeMetadata *m = (InodeMetadata *)ctx;
+    const char *path = NULL;
+    if (node->type == DIRECTORY_TYPE)
+    {
+        if (!directory_reachable(node->data.directory))
+            return;
+        path = get_current_path(node->data.directory);
+    }
+    else if (m->dir && !directory_holds(m->dir, node))
+        return;
+    m->found = true;
+    print_metadata(m->out, node, path);
+    node_touch_atime(m->fs, node);
+}
+
+// stat -i: acha o item pelo número do inode, sem descer em Árvore B nenhuma.
+// A seção de leitura segura o que um comando concorrente aposentar no meio
+// (os ancestrais do diretório, os blocos do arquivo).
+bool show_inode_metadata(FILE *out, FileSystem *fs, uint64_t ino)
+{
+    if (ino == FS_ROOT_DIR_ID)
+    {
+        print_root_metadata(out);
+        return true;
+    }
+    InodeMetadata m = {out, fs, 0, NULL, false};
+    if (fs->concurrent)
+        fs_epoch_enter();
+    // Os itens de um diretório saem da tabela antes dele (free_tree_node): se
+    // o diretório do arquivo já saiu, o item ficou vivo numa cópia. A trava
+    // dos anéis segura o diretório até o fim (ele sai do anel antes de ser
+    // liberado).
+    pthread_mutex_lock(&fs->clones_lock);
+    fs_inode_visit(&fs->alloc.inodes, ino, inode_parent_visit, &m.parent);
+    if (m.parent == FS_ROOT_DIR_ID)
+        m.dir = fs->root;
+    else
+        fs_inode_visit(&fs->alloc.inodes, m.parent, inode_dir_visit, &m);
+    fs_inode_visit(&fs->alloc.inodes, ino, inode_metadata_visit, &m);
+    pthread_mutex_unlock(&fs->clones_lock);
+    if (fs->concurrent)
+        fs_epoch_exit();
+    return m.found;
+}
+
+static void print_usage_line(FILE *out, const DirectoryTotals *t, const char *path, const char *name)
+{
+    fprintf(out, "%12llu  %10llu  %10llu  %s%s%s\n",
+           (unsigned long long)t->bytes, (unsigned long long)t->files, (unsigned long long)t->dirs,
+           path, (name && strcmp(path, "/") != 0) ? "/" : "", name ? name : "");
+}
+
+// Mostra os totais guardados no diretório (sem percorrer nada). Com 'all',
+// mostra antes o total de cada entrada, percorrendo só o próprio diretório.
+void show_disk_usage(FILE *out, Directory *dir, bool all)
+{
+    const char *path = get_current_path(dir);
+    fprintf(out, "%12s  %10s  %10s  %s\n", "bytes", "arquivos", "diretórios", "caminho");
+    if (all)
+    {
+        BTreeCursor cursor;
+        btree_cursor_open(&cursor, dir->tree);
+        TreeNode *item;
+        while ((item = btree_cursor_next(&cursor)) != NULL)
+        {
+            DirectoryTotals t = entry_totals(item);
+            if (item->type == DIRECTORY_TYPE)
+                t.dirs--; // a linha do subdiretório mostra o que está abaixo dele
+            print_usage_line(out, &t, path, tree_node_name(item));
+        }
+    }
+    DirectoryTotals totals = directory_totals_load(dir);
+    print_usage_line(out, &totals, path, NULL);
+}
+
+/* ============================================================================= */
+/* --- FUNÇÕES AUXILIARES (IMPLEMENTAÇÃO INTERNA DA ÁRVORE B) --- */
+/* ============================================================================= */
+
+BTree *btree_create(FsAllocator *alloc)
+{
+    BTree *tree = (BTree *)slab_alloc(&alloc->btrees);
+    tree->alloc = alloc;
+    tree->splits = 0;
+    tree->merges = 0;
+    tree->borrows = 0;
+    tree->count = 0;
+    tree->gen = 0;
+    tree->retired = NULL;
+    tree->retired_count = 0;
+    tree->retired_capacity = 0;
+    tree->root = btree_create_node(alloc, true);
+    return tree;
+}
+
+void btree_destroy(BTree *tree)
+{
+    if (tree)
+    {
+        if (tree->root)
+        {
+            btree_destroy_node(tree->alloc, tree->root);
+        }
+        free(tree->retired);
+        slab_free(&tree->alloc->btrees, tree);
+    }
+}
+
+// Solta uma referência ao nó; a última libera o nó e solta as dele (filhos e itens)
+static void btree_destroy_node(FsAllocator *alloc, BTreeNode *node)
+{
+    if (node && __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        for (int i = 0; i < node->num_keys; i++)
+        {
+            free_tree_node(alloc, node->keys[i]);
+        }
+        if (!node->leaf)
+        {
+            for (int i = 0; i <= node->num_keys; i++)
+            {
+                btree_destroy_node(alloc, node->children[i]);
+            }
+        }
+        slab_free(&alloc->btree_nodes, node);
+    }
+}
+
+static BTreeNode *btree_create_node(FsAllocator *alloc, bool leaf)
+{
+    // sizeof(BTreeNode) já é múltiplo de CACHE_LINE_SIZE por causa do alinhamento,
+    // e o cache de nós entrega objetos alinhados a ele
+    BTreeNode *node = (BTreeNode *)slab_alloc(&alloc->btree_nodes);
+    node->leaf = leaf;
+    node->num_keys = 0;
+    node->refs = 1;
+    node->gen = 0;
+    memset(node->prefix_hi, 0, sizeof(node->prefix_hi));
+    memset(node->prefix_lo, 0, sizeof(node->prefix_lo));
+    for(int i = 0; i < BTREE_MAX_CHILDREN; i++) node->children[i] = NULL;
+    for(int i = 0; i < BTREE_MAX_KEYS; i++) node->keys[i] = NULL;
+    return node;
+}
+
+/* --- Cópia na escrita (modo concorrente) --- */
+
+// No modo concorrente, os leitores descem nas árvores sem trava. Quem escreve
+// (com a trava do diretório) nunca altera um nó já publicado: copia cada nó
+// que vai mudar, monta a nova versão ao lado da antiga e a publica de uma vez,
+// trocando a raiz. Os nós substituídos vão para tree->retired e, depois da
+// publicação, para a fila de fs_epoch, que só os libera quando os leitores
+// que podem estar neles tiverem saído.
+//
+// Os nós criados ou copiados durante a escrita levam gen = tree->gen + 1 e
+// podem ser alterados à vontade até a publicação, que incrementa tree->gen.
+//
+// Com ou sem o modo concorrente, um nó com refs > 1 é compartilhado com a
+// árvore de outro diretório (ver directory_clone) e também é sempre copiado
+// antes de mudar. Aí os filhos e itens dele ganham uma referência a mais (a da
+// cópia), e a desta árvore ao nó é solta depois da publicação.
+
+// Na lista tree->retired, nós compartilhados que saíram desta árvore vêm com
+// este bit ligado: só perdem uma referência (os nós são alinhados a linhas de
+// cache, então o bit mais baixo do endereço está sempre livre)
+#define BTREE_RETIRED_SHARED ((uintptr_t)1)
+
+static bool btree_cow(const BTree *tree)
+{
+    return tree->alloc->concurrent;
+}
+
+static BTreeNode *btree_root(const BTree *tree)
+{
+    return __atomic_load_n(&tree->root, __ATOMIC_ACQUIRE);
+}
+
+static BTreeNode *btree_new_node(BTree *tree, bool leaf)
+{
+    BTreeNode *node = btree_create_node(tree->alloc, leaf);
+    node->gen = tree->gen + 1;
+    return node;
+}
+
+static bool btree_shared(const BTreeNode *node)
+{
+    return __atomic_load_n(&node->refs, __ATOMIC_ACQUIRE) > 1;
+}
+
+static void btree_retire_later(BTree *tree, BTreeNode *node, uintptr_t flags)
+{
+    if (tree->retired_count == tree->retired_capacity)
+    {
+        tree->retired_capacity = tree->retired_capacity ? tree->retired_capacity * 2 : 16;
+        tree->retired = (BTreeNode **)realloc(tree->retired, tree->retired_capacity * sizeof(BTreeNode *));
+    }
+    tree->retired[tree->retired_count++] = (BTreeNode *)((uintptr_t)node | flags);
+}
+
+// O nó saiu da árvore nesta escrita, e o que havia nele (filhos e itens) foi
+// para outros nós dela. Se ele ainda não foi publicado, nenhum leitor o viu e
+// ele volta na hora para o alocador. Se é compartilhado, continua na outra
+// árvore: o que foi levado dele ganha uma referência, e ele perde uma.
+static void btree_free_node(BTree *tree, BTreeNode *node)
+{
+    if (btree_shared(node))
+    {
+        for (int i = 0; i < node->num_keys; i++)
+            __atomic_fetch_add(&node->keys[i]->refs, 1, __ATOMIC_RELAXED);
+        if (!node->leaf)
+            for (int i = 0; i <= node->num_keys; i++)
+                __atomic_fetch_add(&node->children[i]->refs, 1, __ATOMIC_RELAXED);
+        btree_retire_later(tree, node, BTREE_RETIRED_SHARED);
+        return;
+    }
+    if (!btree_cow(tree) || node->gen == tree->gen + 1)
+    {
+        slab_free(&tree->alloc->btree_nodes, node);
+        return;
+    }
+    btree_retire_later(tree, node, 0);
+}
+
+// Versão de 'node' que esta escrita pode alterar
+static BTreeNode *btree_writable(BTree *tree, BTreeNode *node)
+{
+    if (!btree_shared(node) && (!btree_cow(tree) || node->gen == tree->gen + 1))
+        return node;
+    BTreeNode *copy = (BTreeNode *)slab_alloc(&tree->alloc->btree_nodes);
+    memcpy(copy, node, sizeof(BTreeNode));
+    copy->refs = 1;
+    copy->gen = tree->gen + 1;
+    btree_free_node(tree, node);
+    return copy;
+}
+
+// Troca o i-ésimo filho de 'node' (que já pode ser alterado) por uma versão
+// que também pode
+static BTreeNode *btree_writable_child(BTree *tree, BTreeNode *node, int i)
+{
+    node->children[i] = btree_writable(tree, node->children[i]);
+    return node->children[i];
+}
+
+static void btree_reclaim_node(void *ctx, void *ptr)
+{
+    slab_free(&((FsAllocator *)ctx)->btree_nodes, ptr);
+}
+
+static void btree_reclaim_shared(void *ctx, void *ptr)
+{
+    btree_destroy_node((FsAllocator *)ctx, (BTreeNode *)ptr);
+}
+
+static void btree_reclaim_item(void *ctx, void *ptr)
+{
+    free_tree_node((FsAllocator *)ctx, (TreeNode *)ptr);
+}
+
+// Publica a nova versão: os leitores que chegarem depois já descem por 'root'
+static void btree_publish(BTree *tree, BTreeNode *root)
+{
+    __atomic_store_n(&tree->root, root, __ATOMIC_RELEASE);
+    __atomic_store_n(&tree->gen, tree->gen + 1, __ATOMIC_SEQ_CST);
+    for (size_t i = 0; i < tree->retired_count; i++)
+    {
+        BTreeNode *node = (BTreeNode *)((uintptr_t)tree->retired[i] & ~BTREE_RETIRED_SHARED);
+        bool shared = ((uintptr_t)tree->retired[i] & BTREE_RETIRED_SHARED) != 0;
+        if (!btree_cow(tree))
+            btree_destroy_node(tree->alloc, node); // só os compartilhados vêm para a lista
+        else
+            fs_epoch_retire(shared ? btree_reclaim_shared : btree_reclaim_node, tree->alloc, node);
+    }
+    tree->retired_count = 0;
+}
+
+// Libera um item que já saiu da árvore (e do cache de entradas)
+static void btree_release_item(BTree *tree, TreeNode *item)
+{
+    if (!item)
+        return;
+    if (btree_cow(tree))
+        fs_epoch_retire(btree_reclaim_item, tree->alloc, item);
+    else
+        free_tree_node(tree->alloc, item);
+}
+
+/* --- Prefixos das chaves --- */
+
+// Monta o prefixo normalizado de 'name': os primeiros BTREE_PREFIX_LEN bytes,
+// completados com zeros, lidos em big-endian. Com o bit de sinal invertido,
+// comparar as palavras como inteiros com sinal dá a mesma ordem do strcmp.
+static BTreeKey btree_make_key(const char *name)
+{
+    BTreeKey key;
+    uint64_t words[2] = {0, 0};
+    int i = 0;
+    for (; i < BTREE_PREFIX_LEN && name[i] != '\0'; i++)
+        words[i / 8] |= (uint64_t)(unsigned char)name[i] << (56 - 8 * (i % 8));
+
+    key.name = name;
+    key.hi = (int64_t)(words[0] ^ 0x8000000000000000ULL);
+    key.lo = (int64_t)(words[1] ^ 0x8000000000000000ULL);
+    // Se o nome acabou dentro do prefixo, prefixos iguais já significam nomes iguais
+    key.complete = (i < BTREE_PREFIX_LEN);
+    return key;
+}
 
-    node->last_access_time = time(NULL);
+// Grava 'item' na posição i do nó, junto com o seu prefixo
+static void btree_set_key(BTreeNode *node, int i, TreeNode *item)
+{
+    BTreeKey key = btree_make_key(tree_node_name(item));
+    node->keys[i] = item;
+    node->prefix_hi[i] = key.hi;
+    node->prefix_lo[i] = key.lo;
 }
 
-/* ============================================================================= */
-/* --- FUNÇÕES AUXILIARES (IMPLEMENTAÇÃO INTERNA DA ÁRVORE B) --- */
-/* ============================================================================= */
+// Copia n chaves (ponteiros e prefixos) de src[si..] para dst[di..]; aceita sobreposição
+static void btree_move_keys(BTreeNode *dst, int di, BTreeNode *src, int si, int n)
+{
+    if (n <= 0) return;
+    memmove(&dst->keys[di], &src->keys[si], n * sizeof(TreeNode *));
+    memmove(&dst->prefix_hi[di], &src->prefix_hi[si], n * sizeof(int64_t));
+    memmove(&dst->prefix_lo[di], &src->prefix_lo[si], n * sizeof(int64_t));
+}
 
-BTree *btree_create()
+// Compara só os prefixos: <0, 0 ou >0
+static inline int btree_prefix_cmp(const BTreeNode *node, int i, const BTreeKey *key)
 {
-    BTree *tree = (BTree *)malloc(sizeof(BTree));
-    tree->root = btree_create_node(true);
-    return tree;
+    if (node->prefix_hi[i] != key->hi)
+        return node->prefix_hi[i] < key->hi ? -1 : 1;
+    if (node->prefix_lo[i] != key->lo)
+        return node->prefix_lo[i] < key->lo ? -1 : 1;
+    return 0;
 }
 
-void btree_destroy(BTree *tree)
+// Compara a chave i do nó com key: prefixo primeiro, strcmp só no empate
+static int btree_key_cmp(const BTreeNode *node, int i, const BTreeKey *key)
 {
-    if (tree)
+    int c = btree_prefix_cmp(node, i, key);
+    if (c != 0 || key->complete)
+        return c;
+    return strcmp(tree_node_name(node->keys[i]) + BTREE_PREFIX_LEN, key->name + BTREE_PREFIX_LEN);
+}
+
+// Conta, dentro de [lo, hi), as chaves com prefixo < key (*lt) e o fim das
+// chaves com prefixo <= key (*le). As chaves estão ordenadas, então os dois
+// valores são índices no nó. A versão usada é escolhida na compilação.
+#if defined(BTREE_SIMD_AVX2)
+
+static void btree_prefix_scan(const BTreeNode *node, int lo, int hi, const BTreeKey *key, int *lt, int *le)
+{
+    const __m256i kh = _mm256_set1_epi64x(key->hi);
+    const __m256i kl = _mm256_set1_epi64x(key->lo);
+    *lt = -1;
+    *le = hi;
+    for (int i = lo; i < hi; i += 4)
     {
-        if (tree->root)
+        __m256i h = _mm256_loadu_si256((const __m256i *)&node->prefix_hi[i]);
+        __m256i l = _mm256_loadu_si256((const __m256i *)&node->prefix_lo[i]);
+        __m256i heq = _mm256_cmpeq_epi64(h, kh);
+        __m256i less = _mm256_or_si256(_mm256_cmpgt_epi64(kh, h), _mm256_and_si256(heq, _mm256_cmpgt_epi64(kl, l)));
+        __m256i greater = _mm256_or_si256(_mm256_cmpgt_epi64(h, kh), _mm256_and_si256(heq, _mm256_cmpgt_epi64(l, kl)));
+        unsigned valid = (hi - i >= 4) ? 0xFu : (1u << (hi - i)) - 1;
+        unsigned m_lt = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(less)) & valid;
+        unsigned m_gt = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(greater)) & valid;
+        if (*lt < 0 && m_lt != valid)
+            *lt = i + __builtin_popcount(m_lt);
+        if (m_gt)
         {
-            btree_destroy_node(tree->root);
+            *le = i + __builtin_ctz(m_gt);
+            break;
         }
-        free(tree);
     }
+    if (*lt < 0)
+        *lt = hi;
 }
 
-static void btree_destroy_node(BTreeNode *node)
+#elif defined(BTREE_SIMD_SSE2)
+
+// SSE2 não tem comparação de 64 bits: combina as metades de 32 bits
+// (alta com sinal, baixa sem sinal).
+static inline __m128i sse2_cmpgt_epi64(__m128i a, __m128i b)
 {
-    if (node)
+    const __m128i low_sign = _mm_set_epi32(0, (int)0x80000000, 0, (int)0x80000000);
+    __m128i gt = _mm_cmpgt_epi32(_mm_xor_si128(a, low_sign), _mm_xor_si128(b, low_sign));
+    __m128i eq = _mm_cmpeq_epi32(a, b);
+    __m128i gt_lo = _mm_shuffle_epi32(gt, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128i gt_hi = _mm_shuffle_epi32(gt, _MM_SHUFFLE(3, 3, 1, 1));
+    __m128i eq_hi = _mm_shuffle_epi32(eq, _MM_SHUFFLE(3, 3, 1, 1));
+    return _mm_or_si128(gt_hi, _mm_and_si128(eq_hi, gt_lo));
+}
+
+static inline __m128i sse2_cmpeq_epi64(__m128i a, __m128i b)
+{
+    __m128i eq = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+static void btree_prefix_scan(const BTreeNode *node, int lo, int hi, const BTreeKey *key, int *lt, int *le)
+{
+    const __m128i kh = _mm_set1_epi64x(key->hi);
+    const __m128i kl = _mm_set1_epi64x(key->lo);
+    *lt = -1;
+    *le = hi;
+    for (int i = lo; i < hi; i += 2)
     {
-        for (int i = 0; i < node->num_keys; i++)
-        {
-            free_tree_node(node->keys[i]);
-        }
-        if (!node->leaf)
+        __m128i h = _mm_loadu_si128((const __m128i *)&node->prefix_hi[i]);
+        __m128i l = _mm_loadu_si128((const __m128i *)&node->prefix_lo[i]);
+        __m128i heq = sse2_cmpeq_epi64(h, kh);
+        __m128i less = _mm_or_si128(sse2_cmpgt_epi64(kh, h), _mm_and_si128(heq, sse2_cmpgt_epi64(kl, l)));
+        __m128i greater = _mm_or_si128(sse2_cmpgt_epi64(h, kh), _mm_and_si128(heq, sse2_cmpgt_epi64(l, kl)));
+        unsigned valid = (hi - i >= 2) ? 0x3u : 0x1u;
+        unsigned m_lt = (unsigned)_mm_movemask_pd(_mm_castsi128_pd(less)) & valid;
+        unsigned m_gt = (unsigned)_mm_movemask_pd(_mm_castsi128_pd(greater)) & valid;
+        if (*lt < 0 && m_lt != valid)
+            *lt = i + __builtin_popcount(m_lt);
+        if (m_gt)
         {
-            for (int i = 0; i <= node->num_keys; i++)
-            {
-                btree_destroy_node(node->children[i]);
-            }
+            *le = i + __builtin_ctz(m_gt);
+            break;
         }
-        free(node);
     }
+    if (*lt < 0)
+        *lt = hi;
 }
 
-static BTreeNode *btree_create_node(bool leaf)
-{
-    BTreeNode *node = (BTreeNode *)malloc(sizeof(BTreeNode));
-    node->leaf = leaf;
-    node->num_keys = 0;
-    for(int i = 0; i < 2 * BTREE_ORDER; i++) node->children[i] = NULL;
-    for(int i = 0; i < 2 * BTREE_ORDER - 1; i++) node->keys[i] = NULL;
-    return node;
-}
+#else
 
-TreeNode *btree_search(BTree *tree, const char *name)
+static void btree_prefix_scan(const BTreeNode *node, int lo, int hi, const BTreeKey *key, int *lt, int *le)
 {
-    if (!tree || !tree->root)
-        return NULL;
-    return btree_search_in_node(tree->root, name);
+    int i = lo;
+    while (i < hi && btree_prefix_cmp(node, i, key) < 0)
+        i++;
+    *lt = i;
+    while (i < hi && btree_prefix_cmp(node, i, key) == 0)
+        i++;
+    *le = i;
 }
 
-static TreeNode *btree_search_in_node(BTreeNode *node, const char *name)
+#endif
+
+// Devolve o índice da primeira chave >= key (num_keys se todas forem menores)
+// e diz em *found se ela é igual. Só segue o ponteiro para o TreeNode quando
+// os prefixos empatam e o nome é maior que o prefixo.
+static int btree_find_key(BTreeNode *node, const BTreeKey *key, bool *found)
 {
-    int i = 0;
-    while (i < node->num_keys && strcmp(name, node->keys[i]->name) > 0)
+    int lo = 0, hi = node->num_keys;
+
+    // Nós grandes: busca binária nos prefixos até sobrar uma janela pequena
+    while (hi - lo > BTREE_SCAN_WINDOW)
     {
-        i++;
+        int mid = (lo + hi) / 2;
+        int c = btree_prefix_cmp(node, mid, key);
+        if (c < 0)
+            lo = mid + 1;
+        else if (c > 0)
+            hi = mid;
+        else
+            break;
     }
-    if (i < node->num_keys && strcmp(name, node->keys[i]->name) == 0)
+
+    int lt, le;
+    btree_prefix_scan(node, lo, hi, key, &lt, &le);
+
+    *found = false;
+    if (lt == le)
+        return lt;
+    if (key->complete)
     {
-        return node->keys[i];
+        *found = true;
+        return lt;
     }
-    if (node->leaf)
+    // Empate de prefixo com nome longo: desempata pelo restante do nome
+    for (int i = lt; i < le; i++)
     {
+        int c = strcmp(tree_node_name(node->keys[i]) + BTREE_PREFIX_LEN, key->name + BTREE_PREFIX_LEN);
+        if (c >= 0)
+        {
+            *found = (c == 0);
+            return i;
+        }
+    }
+    return le;
+}
+
+TreeNode *btree_search(BTree *tree, const char *name)
+{
+    if (!tree)
         return NULL;
+    BTreeKey key = btree_make_key(name);
+    return btree_search_in_node(btree_root(tree), &key);
+}
+
+static TreeNode *btree_search_in_node(BTreeNode *node, const BTreeKey *key)
+{
+    while (node)
+    {
+        bool found;
+        int i = btree_find_key(node, key, &found);
+        if (found)
+        {
+            return node->keys[i];
+        }
+        if (node->leaf)
+        {
+            return NULL;
+        }
+        node = node->children[i];
     }
-    return btree_search_in_node(node->children[i], name);
+    return NULL;
 }
 
 void btree_insert(BTree *tree, TreeNode *item)
 {
+    BTreeKey key = btree_make_key(tree_node_name(item));
     BTreeNode *root = tree->root;
-    if (root->num_keys == 2 * BTREE_ORDER - 1)
+    if (root->num_keys == BTREE_MAX_KEYS)
     {
-        BTreeNode *new_root = btree_create_node(false);
-        tree->root = new_root;
+        BTreeNode *new_root = btree_new_node(tree, false);
         new_root->children[0] = root;
-        btree_split_child(new_root, 0, root);
-        btree_insert_non_full(new_root, item);
+        btree_split_child(tree, new_root, 0);
+        root = new_root;
     }
     else
     {
-        btree_insert_non_full(root, item);
+        root = btree_writable(tree, root);
     }
+    btree_insert_non_full(tree, root, item, &key);
+    btree_publish(tree, root);
+    __atomic_store_n(&tree->count, tree->count + 1, __ATOMIC_RELAXED);
 }
 
-static void btree_insert_non_full(BTreeNode *node, TreeNode *item)
+static void btree_insert_non_full(BTree *tree, BTreeNode *node, TreeNode *item, const BTreeKey *key)
 {
-    int i = node->num_keys - 1;
+    bool found;
+    int i = btree_find_key(node, key, &found);
     if (node->leaf)
     {
-        while (i >= 0 && strcmp(item->name, node->keys[i]->name) < 0)
-        {
-            node->keys[i + 1] = node->keys[i];
-            i--;
-        }
-        node->keys[i + 1] = item;
+        btree_move_keys(node, i + 1, node, i, node->num_keys - i);
+        node->keys[i] = item;
+        node->prefix_hi[i] = key->hi;
+        node->prefix_lo[i] = key->lo;
         node->num_keys++;
     }
     else
     {
-        while (i >= 0 && strcmp(item->name, node->keys[i]->name) < 0)
+        if (node->children[i]->num_keys == BTREE_MAX_KEYS)
         {
-            i--;
-        }
-        i++;
-        if (node->children[i]->num_keys == 2 * BTREE_ORDER - 1)
-        {
-            btree_split_child(node, i, node->children[i]);
-            if (strcmp(item->name, node->keys[i]->name) > 0)
+            btree_split_child(tree, node, i);
+            if (btree_key_cmp(node, i, key) < 0)
             {
                 i++;
             }
         }
-        btree_insert_non_full(node->children[i], item);
+        node->counts[i]++;
+        btree_insert_non_full(tree, btree_writable_child(tree, node, i), item, key);
     }
 }
 
-static void btree_split_child(BTreeNode *parent, int index, BTreeNode *child)
+static void btree_split_child(BTree *tree, BTreeNode *parent, int index)
 {
-    BTreeNode *new_child = btree_create_node(child->leaf);
+    tree->splits++;
+    BTreeNode *child = btree_writable_child(tree, parent, index);
+    BTreeNode *new_child = btree_new_node(tree, child->leaf);
     new_child->num_keys = BTREE_ORDER - 1;
 
-    for (int j = 0; j < BTREE_ORDER - 1; j++)
-    {
-        new_child->keys[j] = child->keys[j + BTREE_ORDER];
-    }
+    btree_move_keys(new_child, 0, child, BTREE_ORDER, BTREE_ORDER - 1);
 
     if (!child->leaf)
     {
         for (int j = 0; j < BTREE_ORDER; j++)
         {
             new_child->children[j] = child->children[j + BTREE_ORDER];
+            new_child->counts[j] = child->counts[j + BTREE_ORDER];
         }
     }
 
@@ -367,42 +2685,116 @@ static void btree_split_child(BTreeNode *parent, int index, BTreeNode *child)
     for (int j = parent->num_keys; j >= index + 1; j--)
     {
         parent->children[j + 1] = parent->children[j];
+        parent->counts[j + 1] = parent->counts[j];
     }
     parent->children[index + 1] = new_child;
+    parent->counts[index] = btree_node_count(child);
+    parent->counts[index + 1] = btree_node_count(new_child);
 
-    for (int j = parent->num_keys - 1; j >= index; j--)
-    {
-        parent->keys[j + 1] = parent->keys[j];
-    }
-    parent->keys[index] = child->keys[BTREE_ORDER - 1];
+    btree_move_keys(parent, index + 1, parent, index, parent->num_keys - index);
+    btree_move_keys(parent, index, child, BTREE_ORDER - 1, 1);
     parent->num_keys++;
 }
 
 void btree_delete(BTree *tree, const char *name)
 {
-    if (!tree->root) return;
+    // Só libera o item depois que ele saiu da árvore: quando a chave estava
+    // num nó interno, o predecessor/sucessor sobe para o lugar dela e continua
+    // sendo usado.
+    btree_release_item(tree, btree_remove(tree, name));
+}
+
+// Tira a chave da árvore e devolve o item, sem liberar (NULL se não existir)
+static TreeNode *btree_remove(BTree *tree, const char *name)
+{
+    BTreeKey key = btree_make_key(name);
+    // Sem a chave não há o que mudar: nada de copiar o caminho (nem de
+    // rebalancear na descida) à toa
+    if (!tree->root || !btree_search_in_node(tree->root, &key))
+        return NULL;
+
+    BTreeNode *root = btree_writable(tree, tree->root);
+    TreeNode *removed = btree_delete_from_node(tree, root, &key);
+    if (root->num_keys == 0 && !root->leaf)
+    {
+        BTreeNode *old_root = root;
+        root = root->children[0];
+        btree_free_node(tree, old_root);
+    }
+    btree_publish(tree, root);
+    __atomic_store_n(&tree->count, tree->count - 1, __ATOMIC_RELAXED);
+    return removed;
+}
 
-    btree_delete_from_node(tree->root, name);
+// Troca o item com o nome de 'item' por ele e devolve o antigo (sem liberar),
+// ou NULL se não existir. Só os nós do caminho até ele são copiados.
+static TreeNode *btree_replace(BTree *tree, TreeNode *item)
+{
+    BTreeKey key = btree_make_key(tree_node_name(item));
+    BTreeNode *root = btree_writable(tree, tree->root);
+    TreeNode *old = NULL;
+    for (BTreeNode *node = root;;)
+    {
+        bool found;
+        int i = btree_find_key(node, &key, &found);
+        if (found)
+        {
+            old = node->keys[i];
+            btree_set_key(node, i, item);
+            break;
+        }
+        if (node->leaf)
+            break;
+        node = btree_writable_child(tree, node, i);
+    }
+    btree_publish(tree, root);
+    return old;
+}
 
-    if (tree->root->num_keys == 0 && !tree->root->leaf)
+// O item 'name' pode ser visto também por outra árvore: ele mesmo, ou algum nó
+// do caminho até ele, tem mais de uma referência
+static bool btree_item_shared(const BTree *tree, const char *name)
+{
+    BTreeKey key = btree_make_key(name);
+    BTreeNode *node = tree->root;
+    while (node && !btree_shared(node))
     {
-        BTreeNode *old_root = tree->root;
-        tree->root = tree->root->children[0];
-        free(old_root);
+        bool found;
+        int i = btree_find_key(node, &key, &found);
+        if (found)
+            return __atomic_load_n(&node->keys[i]->refs, __ATOMIC_ACQUIRE) > 1;
+        if (node->leaf)
+            return false;
+        node = node->children[i];
     }
+    return node != NULL;
 }
 
-static void btree_delete_from_node(BTreeNode *node, const char *name)
+// Faz a árvore vazia 'dst' começar igual a 'src', dividindo a raiz com ela
+static void btree_share(BTree *dst, const BTree *src)
 {
-    int idx = btree_find_key(node, name);
+    btree_destroy_node(dst->alloc, dst->root);
+    dst->root = src->root;
+    __atomic_fetch_add(&dst->root->refs, 1, __ATOMIC_RELAXED);
+    dst->count = btree_count(src);
+    // Os nós de 'src' já estão publicados (gen <= src->gen): 'dst' os copia
+    // antes de mudar, mesmo quando deixarem de ser compartilhados
+    dst->gen = src->gen;
+}
+
+// Remove a chave da subárvore e devolve o TreeNode retirado (sem liberar),
+// ou NULL se ela não existir.
+static TreeNode *btree_delete_from_node(BTree *tree, BTreeNode *node, const BTreeKey *key)
+{
+    bool found;
+    int idx = btree_find_key(node, key, &found);
 
-    if (idx < node->num_keys && strcmp(node->keys[idx]->name, name) == 0)
+    if (found)
     {
+        TreeNode *removed = node->keys[idx];
         if (node->leaf)
         {
-            free_tree_node(node->keys[idx]);
-            for (int i = idx + 1; i < node->num_keys; ++i)
-                node->keys[i - 1] = node->keys[i];
+            btree_move_keys(node, idx, node, idx + 1, node->num_keys - idx - 1);
             node->num_keys--;
         }
         else
@@ -410,140 +2802,236 @@ static void btree_delete_from_node(BTreeNode *node, const char *name)
             if (node->children[idx]->num_keys >= BTREE_ORDER)
             {
                 TreeNode *pred = btree_get_predecessor(node, idx);
-                free_tree_node(node->keys[idx]);
-                node->keys[idx] = pred;
-                btree_delete_from_node(node->children[idx], pred->name);
+                btree_set_key(node, idx, pred);
+                BTreeKey pred_key = btree_make_key(tree_node_name(pred));
+                btree_delete_from_node(tree, btree_writable_child(tree, node, idx), &pred_key);
+                node->counts[idx]--;
             }
             else if (node->children[idx + 1]->num_keys >= BTREE_ORDER)
             {
                 TreeNode *succ = btree_get_successor(node, idx);
-                free_tree_node(node->keys[idx]);
-                node->keys[idx] = succ;
-                btree_delete_from_node(node->children[idx + 1], succ->name);
+                btree_set_key(node, idx, succ);
+                BTreeKey succ_key = btree_make_key(tree_node_name(succ));
+                btree_delete_from_node(tree, btree_writable_child(tree, node, idx + 1), &succ_key);
+                node->counts[idx + 1]--;
             }
             else
             {
-                btree_merge(node, idx);
-                btree_delete_from_node(node->children[idx], name);
+                btree_merge(tree, node, idx);
+                btree_delete_from_node(tree, btree_writable_child(tree, node, idx), key);
+                node->counts[idx]--;
             }
         }
+        return removed;
     }
     else
     {
-        if (node->leaf) return;
+        if (node->leaf) return NULL;
 
         bool flag = (idx == node->num_keys);
 
         if (node->children[idx]->num_keys < BTREE_ORDER)
-            btree_fill(node, idx);
-
-        if (flag && idx > node->num_keys)
-            btree_delete_from_node(node->children[idx - 1], name);
-        else
-            btree_delete_from_node(node->children[idx], name);
+            btree_fill(tree, node, idx);
+
+        // Se o último filho se fundiu com o anterior, a chave está no anterior
+        int child = (flag && idx > node->num_keys) ? idx - 1 : idx;
+        TreeNode *removed = btree_delete_from_node(tree, btree_writable_child(tree, node, child), key);
+        if (removed)
+            node->counts[child]--;
+        return removed;
     }
 }
 
-static int btree_find_key(BTreeNode *node, const char *name)
-{
-    int idx = 0;
-    while (idx < node->num_keys && strcmp(node->keys[idx]->name, name) < 0)
-        ++idx;
-    return idx;
-}
-
-static void btree_merge(BTreeNode *node, int idx)
+static void btree_merge(BTree *tree, BTreeNode *node, int idx)
 {
-    BTreeNode *child = node->children[idx];
-    BTreeNode *sibling = node->children[idx + 1];
+    tree->merges++;
+    BTreeNode *child = btree_writable_child(tree, node, idx);
+    BTreeNode *sibling = node->children[idx + 1]; // só lido: sai da árvore
 
-    child->keys[BTREE_ORDER - 1] = node->keys[idx];
-
-    for (int i = 0; i < sibling->num_keys; ++i)
-        child->keys[i + BTREE_ORDER] = sibling->keys[i];
+    btree_move_keys(child, BTREE_ORDER - 1, node, idx, 1);
+    btree_move_keys(child, BTREE_ORDER, sibling, 0, sibling->num_keys);
 
     if (!child->leaf)
     {
         for (int i = 0; i <= sibling->num_keys; ++i)
+        {
             child->children[i + BTREE_ORDER] = sibling->children[i];
+            child->counts[i + BTREE_ORDER] = sibling->counts[i];
+        }
     }
 
-    for (int i = idx + 1; i < node->num_keys; ++i)
-        node->keys[i - 1] = node->keys[i];
+    btree_move_keys(node, idx, node, idx + 1, node->num_keys - idx - 1);
 
+    node->counts[idx] += 1 + node->counts[idx + 1];
     for (int i = idx + 2; i <= node->num_keys; ++i)
+    {
         node->children[i - 1] = node->children[i];
+        node->counts[i - 1] = node->counts[i];
+    }
 
     child->num_keys += sibling->num_keys + 1;
     node->num_keys--;
 
-    free(sibling);
+    btree_free_node(tree, sibling);
 }
 
-static void btree_fill(BTreeNode *node, int idx)
+static void btree_fill(BTree *tree, BTreeNode *node, int idx)
 {
     if (idx != 0 && node->children[idx - 1]->num_keys >= BTREE_ORDER)
-        btree_borrow_from_prev(node, idx);
+        btree_borrow_from_prev(tree, node, idx);
     else if (idx != node->num_keys && node->children[idx + 1]->num_keys >= BTREE_ORDER)
-        btree_borrow_from_next(node, idx);
+        btree_borrow_from_next(tree, node, idx);
     else
     {
         if (idx != node->num_keys)
-            btree_merge(node, idx);
+            btree_merge(tree, node, idx);
         else
-            btree_merge(node, idx - 1);
+            btree_merge(tree, node, idx - 1);
     }
 }
 
-static void btree_borrow_from_prev(BTreeNode *node, int idx)
+static void btree_borrow_from_prev(BTree *tree, BTreeNode *node, int idx)
 {
-    BTreeNode *child = node->children[idx];
-    BTreeNode *sibling = node->children[idx - 1];
+    tree->borrows++;
+    BTreeNode *child = btree_writable_child(tree, node, idx);
+    BTreeNode *sibling = btree_writable_child(tree, node, idx - 1);
 
-    for (int i = child->num_keys - 1; i >= 0; --i)
-        child->keys[i + 1] = child->keys[i];
+    btree_move_keys(child, 1, child, 0, child->num_keys);
 
     if (!child->leaf)
     {
         for (int i = child->num_keys; i >= 0; --i)
+        {
             child->children[i + 1] = child->children[i];
+            child->counts[i + 1] = child->counts[i];
+        }
     }
 
-    child->keys[0] = node->keys[idx - 1];
+    btree_move_keys(child, 0, node, idx - 1, 1);
 
+    // A chave do pai desce para o filho, junto com o último filho do irmão
+    size_t moved = 1;
     if (!child->leaf)
+    {
         child->children[0] = sibling->children[sibling->num_keys];
+        child->counts[0] = sibling->counts[sibling->num_keys];
+        moved += child->counts[0];
+    }
+    node->counts[idx] += moved;
+    node->counts[idx - 1] -= moved;
 
-    node->keys[idx - 1] = sibling->keys[sibling->num_keys - 1];
+    btree_move_keys(node, idx - 1, sibling, sibling->num_keys - 1, 1);
 
     child->num_keys += 1;
     sibling->num_keys -= 1;
 }
 
-static void btree_borrow_from_next(BTreeNode *node, int idx)
+static void btree_borrow_from_next(BTree *tree, BTreeNode *node, int idx)
 {
-    BTreeNode *child = node->children[idx];
-    BTreeNode *sibling = node->children[idx + 1];
+    tree->borrows++;
+    BTreeNode *child = btree_writable_child(tree, node, idx);
+    BTreeNode *sibling = btree_writable_child(tree, node, idx + 1);
 
-    child->keys[child->num_keys] = node->keys[idx];
+    btree_move_keys(child, child->num_keys, node, idx, 1);
 
+    // A chave do pai desce para o filho, junto com o primeiro filho do irmão
+    size_t moved = 1;
     if (!child->leaf)
+    {
         child->children[child->num_keys + 1] = sibling->children[0];
+        child->counts[child->num_keys + 1] = sibling->counts[0];
+        moved += sibling->counts[0];
+    }
+    node->counts[idx] += moved;
+    node->counts[idx + 1] -= moved;
 
-    node->keys[idx] = sibling->keys[0];
+    btree_move_keys(node, idx, sibling, 0, 1);
 
-    for (int i = 1; i < sibling->num_keys; ++i)
-        sibling->keys[i - 1] = sibling->keys[i];
+    btree_move_keys(sibling, 0, sibling, 1, sibling->num_keys - 1);
 
     if (!sibling->leaf)
     {
         for (int i = 1; i <= sibling->num_keys; ++i)
+        {
             sibling->children[i - 1] = sibling->children[i];
+            sibling->counts[i - 1] = sibling->counts[i];
+        }
     }
     child->num_keys += 1;
     sibling->num_keys -= 1;
 }
 
+// Maior quantidade de chaves que cabe numa subárvore com 'levels' níveis:
+// (2t)^levels - 1. Satura em SIZE_MAX para não estourar.
+static size_t btree_capacity(int levels)
+{
+    size_t cap = 1;
+    for (int i = 0; i < levels; i++)
+    {
+        if (cap > SIZE_MAX / BTREE_MAX_CHILDREN)
+            return SIZE_MAX;
+        cap *= BTREE_MAX_CHILDREN;
+    }
+    return cap - 1;
+}
+
+// Monta de baixo para cima uma Árvore B a partir de itens já ordenados (sem
+// repetição), sem nenhuma comparação de nomes. A árvore precisa estar vazia.
+void btree_bulk_load(BTree *tree, TreeNode **items, size_t count)
+{
+    if (count == 0)
+        return;
+
+    int levels = 1;
+    while (btree_capacity(levels) < count)
+        levels++;
+
+    btree_free_node(tree, tree->root);
+    btree_publish(tree, btree_build(tree->alloc, items, count, levels, true));
+    __atomic_store_n(&tree->count, count, __ATOMIC_RELAXED);
+}
+
+// Constrói uma subárvore com exatamente 'levels' níveis. Os itens são
+// repartidos por igual entre os filhos, o que garante que cada filho fique
+// entre o mínimo (t^L - 1) e o máximo ((2t)^L - 1) de chaves do seu nível.
+static BTreeNode *btree_build(FsAllocator *alloc, TreeNode **items, size_t count, int levels, bool is_root)
+{
+    BTreeNode *node = btree_create_node(alloc, levels == 1);
+    if (levels == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            btree_set_key(node, (int)i, items[i]);
+        node->num_keys = (int)count;
+        return node;
+    }
+
+    size_t child_cap = btree_capacity(levels - 1);
+    size_t children = (count + 1 + child_cap) / (child_cap + 1);
+    if (!is_root && children < BTREE_ORDER)
+        children = BTREE_ORDER;
+    if (children < 2)
+        children = 2;
+
+    size_t child_keys = count - (children - 1);
+    size_t base = child_keys / children;
+    size_t extra = child_keys % children;
+    size_t pos = 0;
+    for (size_t c = 0; c < children; c++)
+    {
+        size_t n = base + (c < extra ? 1 : 0);
+        node->children[c] = btree_build(alloc, items + pos, n, levels - 1, false);
+        node->counts[c] = n;
+        pos += n;
+        if (c + 1 < children)
+        {
+            btree_set_key(node, (int)c, items[pos]);
+            pos++;
+        }
+    }
+    node->num_keys = (int)(children - 1);
+    return node;
+}
+
 static TreeNode *btree_get_predecessor(BTreeNode *node, int idx)
 {
     BTreeNode *cur = node->children[idx];
@@ -560,6 +3048,20 @@ static TreeNode *btree_get_successor(BTreeNode *node, int idx)
     return cur->keys[0];
 }
 
+static void print_entry(const TreeNode *item, bool long_format)
+{
+    if (long_format)
+    {
+        char time_buf[20];
+        format_time(time_buf, sizeof(time_buf), "%d-%m-%Y %H:%M", item->modification_time);
+        printf("%s  %s%s\n", time_buf, tree_node_name(item), (item->type == DIRECTORY_TYPE) ? "/" : "");
+    }
+    else
+    {
+        printf("%s%s  ", tree_node_name(item), (item->type == DIRECTORY_TYPE) ? "/" : "");
+    }
+}
+
 void btree_traverse(BTreeNode *node, bool long_format)
 {
     if (node != NULL)
@@ -571,22 +3073,342 @@ void btree_traverse(BTreeNode *node, bool long_format)
             {
                 btree_traverse(node->children[i], long_format);
             }
+            print_entry(node->keys[i], long_format);
+        }
+
+        if (!node->leaf)
+        {
+            btree_traverse(node->children[i], long_format);
+        }
+    }
+}
+
+/* --- Contagens e posições --- */
+
+// Chaves na subárvore de 'node': as do nó mais as contagens dos filhos
+static size_t btree_node_count(const BTreeNode *node)
+{
+    size_t n = (size_t)node->num_keys;
+    if (!node->leaf)
+        for (int i = 0; i <= node->num_keys; i++)
+            n += node->counts[i];
+    return n;
+}
+
+size_t btree_count(const BTree *tree)
+{
+    return tree ? __atomic_load_n(&tree->count, __ATOMIC_RELAXED) : 0;
+}
+
+// Quantas chaves são menores que 'name' (a posição em que ele está ou
+// entraria). Soma as contagens dos filhos à esquerda em cada nível da descida.
+size_t btree_rank(const BTree *tree, const char *name)
+{
+    if (!tree)
+        return 0;
+    BTreeKey key = btree_make_key(name);
+    BTreeNode *node = btree_root(tree);
+    size_t rank = 0;
+    for (;;)
+    {
+        bool found;
+        int i = btree_find_key(node, &key, &found);
+        rank += (size_t)i;
+        if (node->leaf)
+            break;
+        for (int j = 0; j < i; j++)
+            rank += node->counts[j];
+        if (found)
+        {
+            rank += node->counts[i];
+            break;
+        }
+        node = node->children[i];
+    }
+    return rank;
+}
+
+/* --- Cursor --- */
+
+// Desce pelos primeiros filhos a partir de 'node', empilhando cada nível
+static void btree_cursor_descend(BTreeCursor *cursor, BTreeNode *node)
+{
+    for (;;)
+    {
+        cursor->stack[cursor->depth].node = node;
+        cursor->stack[cursor->depth].index = 0;
+        cursor->depth++;
+        if (node->leaf)
+            break;
+        node = node->children[0];
+    }
+}
+
+// Posiciona o cursor antes da primeira chave da árvore
+void btree_cursor_open(BTreeCursor *cursor, const BTree *tree)
+{
+    cursor->depth = 0;
+    BTreeNode *root = tree ? btree_root(tree) : NULL;
+    if (root && root->num_keys > 0)
+        btree_cursor_descend(cursor, root);
+}
+
+// Posiciona o cursor antes da primeira chave >= name (NULL: a primeira de
+// todas). Só desce um caminho da raiz até a folha.
+void btree_cursor_seek(BTreeCursor *cursor, const BTree *tree, const char *name)
+{
+    if (!name)
+    {
+        btree_cursor_open(cursor, tree);
+        return;
+    }
+    cursor->depth = 0;
+    BTreeNode *node = tree ? btree_root(tree) : NULL;
+    if (!node || node->num_keys == 0)
+        return;
+
+    BTreeKey key = btree_make_key(name);
+    for (;;)
+    {
+        bool found;
+        int i = btree_find_key(node, &key, &found);
+        cursor->stack[cursor->depth].node = node;
+        cursor->stack[cursor->depth].index = i;
+        cursor->depth++;
+        if (found || node->leaf)
+            break;
+        node = node->children[i];
+    }
+}
+
+// Posiciona o cursor antes da chave de posição 'rank' (0 é a primeira), usando
+// as contagens das subárvores para escolher o filho em cada nível
+void btree_cursor_seek_rank(BTreeCursor *cursor, const BTree *tree, size_t rank)
+{
+    // A raiz é lida uma vez só: o total vem dela, e não de tree->count, que no
+    // modo concorrente pode já ser o de outra versão
+    cursor->depth = 0;
+    BTreeNode *node = tree ? btree_root(tree) : NULL;
+    if (!node || rank >= btree_node_count(node))
+        return;
 
-            if (long_format)
+    for (;;)
+    {
+        int i = 0;
+        bool at_key = node->leaf;
+        if (node->leaf)
+        {
+            i = (int)rank;
+        }
+        else
+        {
+            // Pula filhos inteiros (e a chave depois de cada um) até a posição
+            while (rank >= node->counts[i])
             {
-                char time_buf[20];
-                strftime(time_buf, sizeof(time_buf), "%d-%m-%Y %H:%M", localtime(&node->keys[i]->modification_time));
-                printf("%s  %s%s\n", time_buf, node->keys[i]->name, (node->keys[i]->type == DIRECTORY_TYPE) ? "/" : "");
+                rank -= node->counts[i];
+                if (rank == 0)
+                {
+                    at_key = true;
+                    break;
+                }
+                rank--;
+                i++;
             }
-            else
+        }
+        cursor->stack[cursor->depth].node = node;
+        cursor->stack[cursor->depth].index = i;
+        cursor->depth++;
+        if (at_key)
+            break;
+        node = node->children[i];
+    }
+}
+
+// Devolve a próxima chave em ordem e avança, ou NULL no fim da árvore
+TreeNode *btree_cursor_next(BTreeCursor *cursor)
+{
+    // Níveis já esgotados: a próxima chave está num ancestral
+    while (cursor->depth > 0 &&
+           cursor->stack[cursor->depth - 1].index >= cursor->stack[cursor->depth - 1].node->num_keys)
+        cursor->depth--;
+    if (cursor->depth == 0)
+        return NULL;
+
+    BTreeNode *node = cursor->stack[cursor->depth - 1].node;
+    int i = cursor->stack[cursor->depth - 1].index++;
+    // Depois de uma chave interna vêm as chaves da subárvore à sua direita
+    if (!node->leaf)
+        btree_cursor_descend(cursor, node->children[i + 1]);
+    return node->keys[i];
+}
+
+// Percorre os nós somando a forma da subárvore; 'depth' é o nível de 'node'
+static void btree_shape_node(const BTreeNode *node, int depth, BTreeShape *shape)
+{
+    shape->nodes++;
+    shape->keys += (size_t)node->num_keys;
+    if (depth > shape->height)
+        shape->height = depth;
+    if (node->leaf)
+    {
+        shape->leaves++;
+        return;
+    }
+    for (int i = 0; i <= node->num_keys; i++)
+        btree_shape_node(node->children[i], depth + 1, shape);
+}
+
+void btree_shape(const BTree *tree, BTreeShape *shape)
+{
+    memset(shape, 0, sizeof(*shape));
+    if (tree->root)
+        btree_shape_node(tree->root, 1, shape);
+    shape->splits = tree->splits;
+    shape->merges = tree->merges;
+    shape->borrows = tree->borrows;
+}
+
+static void directory_stats_add(Directory *dir, bool recursive, DirectoryStats *stats);
+
+static void directory_stats_children(BTreeNode *node, DirectoryStats *stats)
+{
+    for (int i = 0; i < node->num_keys; i++)
+    {
+        if (!node->leaf)
+            directory_stats_children(node->children[i], stats);
+        if (node->keys[i]->type == DIRECTORY_TYPE)
+            directory_stats_add(node->keys[i]->data.directory, true, stats);
+    }
+    if (!node->leaf)
+        directory_stats_children(node->children[node->num_keys], stats);
+}
+
+static void directory_stats_add(Directory *dir, bool recursive, DirectoryStats *stats)
+{
+    BTreeShape shape;
+    btree_shape(dir->tree, &shape);
+    stats->directories++;
+    if (shape.height > stats->tree.height)
+        stats->tree.height = shape.height;
+    stats->tree.nodes += shape.nodes;
+    stats->tree.keys += shape.keys;
+    stats->tree.leaves += shape.leaves;
+    stats->tree.splits += shape.splits;
+    stats->tree.merges += shape.merges;
+    stats->tree.borrows += shape.borrows;
+    if (recursive)
+        directory_stats_children(dir->tree->root, stats);
+}
+
+// Soma a forma e os contadores das Árvores B de 'dir' (e de todos os
+// diretórios abaixo dele, se 'recursive'). A altura é a maior encontrada.
+void directory_stats(Directory *dir, bool recursive, DirectoryStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    directory_stats_add(dir, recursive, stats);
+}
+
+/* --- Verificação --- */
+
+// Confere a subárvore de 'node': quantidade de chaves por nó, ordem estrita
+// dentro de (lo, hi), prefixos, contagens dos filhos e folhas no mesmo nível.
+// Devolve o número de chaves, ou -1 com a descrição do problema em 'msg'.
+static long btree_check_node(const BTreeNode *node, bool is_root, const char *lo, const char *hi,
+                             int depth, int *leaf_depth, char *msg, size_t size)
+{
+    if (node->num_keys > BTREE_MAX_KEYS || (!is_root && node->num_keys < BTREE_ORDER - 1))
+    {
+        snprintf(msg, size, "nó da Árvore B com %d chaves", node->num_keys);
+        return -1;
+    }
+    long total = node->num_keys;
+    for (int i = 0; i <= node->num_keys; i++)
+    {
+        const char *left = (i == 0) ? lo : tree_node_name(node->keys[i - 1]);
+        const char *right = (i == node->num_keys) ? hi : tree_node_name(node->keys[i]);
+        if (left && right && strcmp(left, right) >= 0)
+        {
+            snprintf(msg, size, "chaves fora de ordem: '%s' antes de '%s'", left, right);
+            return -1;
+        }
+        if (i < node->num_keys)
+        {
+            BTreeKey key = btree_make_key(tree_node_name(node->keys[i]));
+            if (node->prefix_hi[i] != key.hi || node->prefix_lo[i] != key.lo)
             {
-                printf("%s%s  ", node->keys[i]->name, (node->keys[i]->type == DIRECTORY_TYPE) ? "/" : "");
+                snprintf(msg, size, "prefixo desatualizado para '%s'", tree_node_name(node->keys[i]));
+                return -1;
             }
         }
+        if (node->leaf)
+            continue;
 
-        if (!node->leaf)
+        long n = btree_check_node(node->children[i], false, left, right, depth + 1, leaf_depth, msg, size);
+        if (n < 0)
+            return -1;
+        if ((size_t)n != node->counts[i])
         {
-            btree_traverse(node->children[i], long_format);
+            snprintf(msg, size, "contagem da subárvore %zu, esperado %ld", node->counts[i], n);
+            return -1;
+        }
+        total += n;
+    }
+    if (node->leaf)
+    {
+        if (*leaf_depth < 0)
+            *leaf_depth = depth;
+        else if (*leaf_depth != depth)
+        {
+            snprintf(msg, size, "folhas em níveis diferentes (%d e %d)", *leaf_depth, depth);
+            return -1;
+        }
+    }
+    return total;
+}
+
+// Confere as invariantes de um diretório: a Árvore B, as ligações com os
+// subdiretórios e os totais (comparados com a soma das entradas, o que basta
+// para que os totais de uma subárvore inteira estejam certos se todos os
+// diretórios passarem). Só lê; devolve false com o problema em 'msg'.
+bool directory_check(Directory *dir, char *msg, size_t size)
+{
+    int leaf_depth = -1;
+    long keys = btree_check_node(dir->tree->root, true, NULL, NULL, 0, &leaf_depth, msg, size);
+    if (keys < 0)
+        return false;
+    if ((size_t)keys != dir->tree->count)
+    {
+        snprintf(msg, size, "a Árvore B diz ter %zu chaves, mas tem %ld", dir->tree->count, keys);
+        return false;
+    }
+
+    DirectoryTotals sum = {0, 0, 0};
+    BTreeCursor cursor;
+    btree_cursor_open(&cursor, dir->tree);
+    TreeNode *item;
+    while ((item = btree_cursor_next(&cursor)) != NULL)
+    {
+        if (item->type == DIRECTORY_TYPE)
+        {
+            Directory *child = item->data.directory;
+            if (child->parent != dir || child->node != item || child->name != tree_node_name(item) || child->fs != dir->fs)
+            {
+                snprintf(msg, size, "subdiretório '%s' com ligações erradas", tree_node_name(item));
+                return false;
+            }
         }
+        DirectoryTotals t = entry_totals(item);
+        sum.bytes += t.bytes;
+        sum.files += t.files;
+        sum.dirs += t.dirs;
+    }
+    if (memcmp(&sum, &dir->totals, sizeof(sum)) != 0)
+    {
+        snprintf(msg, size, "totais guardados (%llu bytes, %llu arquivos, %llu diretórios) diferentes da soma (%llu, %llu, %llu)",
+                 (unsigned long long)dir->totals.bytes, (unsigned long long)dir->totals.files,
+                 (unsigned long long)dir->totals.dirs, (unsigned long long)sum.bytes,
+                 (unsigned long long)sum.files, (unsigned long long)sum.dirs);
+        return false;
     }
-}
\ No newline at end of file
+    return true;
+}
@@ -5,27 +5,95 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
+#include <pthread.h>
 
-#define BTREE_ORDER 3 // Ordem da Árvore B
+#include "fs_alloc.h"
 
-// Enum para os tipos de nós
-typedef enum { FILE_TYPE, DIRECTORY_TYPE } NodeType;
+// Ordem da Árvore B (grau mínimo t): cada nó guarda de t-1 a 2t-1 chaves.
+// Pode ser escolhida na compilação, ex.: make BTREE_ORDER=32
+#ifndef BTREE_ORDER
+#define BTREE_ORDER 3
+#endif
 
-// Estrutura para um arquivo
+#if BTREE_ORDER < 2
+#error "BTREE_ORDER deve ser pelo menos 2"
+#endif
+
+#define BTREE_MAX_KEYS (2 * BTREE_ORDER - 1)
+#define BTREE_MAX_CHILDREN (2 * BTREE_ORDER)
+
+// Os nós da Árvore B são alinhados e dimensionados em múltiplos de linha de cache
+#define CACHE_LINE_SIZE 64
+
+// Cada nó guarda, junto das chaves, os primeiros BTREE_PREFIX_LEN bytes de cada
+// nome já normalizados, para comparar sem acessar o TreeNode. O vetor tem 3
+// posições de folga (arredondado para múltiplo de 4) para as leituras SIMD.
+#define BTREE_PREFIX_LEN 16
+#define BTREE_PREFIX_SLOTS ((BTREE_MAX_KEYS + 6) & ~3)
+
+// Enum para os tipos de nós (um byte, para caber no TreeNode)
+typedef enum __attribute__((packed)) { FILE_TYPE, DIRECTORY_TYPE } NodeType;
+
+// Nomes com menos de TREE_NODE_INLINE_NAME bytes ficam dentro do próprio
+// TreeNode; os maiores vão para a arena de nomes (fs_alloc.h)
+#define TREE_NODE_INLINE_NAME 24
+
+// Conteúdo dos arquivos: blocos de FILE_CHUNK_SIZE bytes
+// Todos os blocos menos o último estão cheios. O último tem a capacidade da
+// menor potência de 2 (de FILE_CHUNK_MIN a FILE_CHUNK_SIZE) que cabe o que ele
+// guarda, e dobra quando enche; o vetor de blocos também dobra. Assim as duas
+// capacidades saem do tamanho do arquivo, e acrescentar no fim custa O(1)
+// amortizado. Ler ou escrever um trecho só passa pelos blocos dele.
+#define FILE_CHUNK_SIZE 4096
+#define FILE_CHUNK_MIN 16
+
+// Arquivos com pelo menos FILE_DEDUP_MIN bytes têm os blocos guardados no
+// armazenamento por conteúdo (fs_content.h) ao serem criados, e os blocos que
+// enchem com acréscimos no fim também. Nos menores, procurar um igual custa
+// mais do que o bloco. Pode ser trocado na compilação (SIZE_MAX desliga).
+#ifndef FILE_DEDUP_MIN
+#define FILE_DEDUP_MIN 64
+#endif
+
+// Blocos completos com pelo menos FILE_COMPRESS_MIN bytes são guardados
+// comprimidos (fs_lz.h) quando isso economiza 1/8 ou mais, e descomprimidos a
+// cada leitura ('cat', imagem, journal). Quem escreve num deles escreve numa
+// cópia sem compressão. Pode ser trocado na compilação (SIZE_MAX desliga).
+#ifndef FILE_COMPRESS_MIN
+#define FILE_COMPRESS_MIN 512
+#endif
+
+_Static_assert(FILE_CHUNK_SIZE <= FS_CONTENT_PACK_MAX, "blocos maiores que os que fs_content_pack comprime");
+
+// Estrutura para um arquivo: o conteúdo e o número do inode. O nome fica no
+// TreeNode; um arquivo com vários nomes (ln) tem um TreeNode para cada um.
 typedef struct File {
-    char* name;
-    char* content;
+    FileChunk** chunks; // Blocos do conteúdo (aponta para 'first' enquanto há um só)
+    FileChunk* first;
     size_t size;
+    uint64_t ino;
+    struct FileLinks* links; // Os nomes, quando há mais de um (NULL: um só)
+    uint32_t refs;           // TreeNodes que apontam para o arquivo
+    uint32_t nlink;          // Nomes (lido sem trava; muda com a trava dos nomes)
 } File;
 
 // Declaração antecipada da estrutura Directory
 struct Directory;
 
 // Nó que pode ser arquivo ou diretório
+// Ocupa uma linha de cache: o nome curto, o tipo e as datas vêm juntos na
+// mesma leitura. O nome é guardado uma vez só (o Directory aponta para ele) e
+// lido com tree_node_name.
 typedef struct TreeNode {
-    char* name;
+    uint32_t refs; // nós de Árvore B que apontam para o item (mais de um só depois de um snapshot)
     NodeType type;
+    bool name_inline; // nome em name.local (senão, em name.heap)
+    union {
+        char local[TREE_NODE_INLINE_NAME];
+        char* heap;
+    } name;
     union {
         File* file;
         struct Directory* directory;
@@ -33,52 +101,319 @@ typedef struct TreeNode {
     time_t creation_time;
     time_t modification_time;
     time_t last_access_time;
-} TreeNode;
+} __attribute__((aligned(CACHE_LINE_SIZE))) TreeNode;
+
+_Static_assert(sizeof(TreeNode) == CACHE_LINE_SIZE, "TreeNode maior que uma linha de cache");
+
+static inline const char* tree_node_name(const TreeNode* node)
+{
+    return node->name_inline ? node->name.local : node->name.heap;
+}
 
 // Nó da Árvore B
+// O cabeçalho e os prefixos ficam juntos nas primeiras linhas de cache, e o nó
+// inteiro é alinhado/arredondado para linhas de cache (ver btree_create_node).
+// prefix_hi/prefix_lo[i] são os bytes 0-7 e 8-15 do nome de keys[i].
 typedef struct BTreeNode {
-    bool leaf;
     int num_keys;
-    TreeNode* keys[2 * BTREE_ORDER - 1];
-    struct BTreeNode* children[2 * BTREE_ORDER];
-} BTreeNode;
+    bool leaf;
+    uint32_t refs; // árvores ou nós que apontam para este (mais de um: compartilhado por um snapshot)
+    uint64_t gen;  // versão da árvore em que o nó foi criado ou copiado (ver btree_insert)
+    int64_t prefix_hi[BTREE_PREFIX_SLOTS];
+    int64_t prefix_lo[BTREE_PREFIX_SLOTS];
+    TreeNode* keys[BTREE_MAX_KEYS];
+    struct BTreeNode* children[BTREE_MAX_CHILDREN];
+    size_t counts[BTREE_MAX_CHILDREN]; // chaves na subárvore de cada filho (nós internos)
+} __attribute__((aligned(CACHE_LINE_SIZE))) BTreeNode;
 
 // Estrutura da Árvore B
 typedef struct BTree {
     BTreeNode* root;
+    FsAllocator* alloc; // De onde saem os nós e para onde voltam os itens removidos
+    size_t count;     // Total de chaves
+    uint64_t splits;  // Contadores de rebalanceamento (sempre ligados; ver 'stats')
+    uint64_t merges;
+    uint64_t borrows;
+    uint64_t gen;     // versões publicadas (cada inserção ou remoção publica uma)
+    struct BTreeNode** retired; // nós substituídos na escrita em andamento
+    size_t retired_count;
+    size_t retired_capacity;
 } BTree;
 
+// Altura máxima suportada pelo cursor: com pelo menos 2 filhos por nó interno,
+// 64 níveis bastam para qualquer quantidade de chaves endereçável
+#define BTREE_CURSOR_MAX_DEPTH 64
+
+// Cursor sobre uma Árvore B, com a pilha do caminho explícita: pode ser
+// pausado e retomado entre chamadas. O nó do topo da pilha, na posição
+// 'index', tem a próxima chave a devolver. Qualquer alteração na árvore
+// invalida os cursores abertos sobre ela.
+typedef struct BTreeCursor {
+    int depth;
+    struct {
+        BTreeNode* node;
+        int index;
+    } stack[BTREE_CURSOR_MAX_DEPTH];
+} BTreeCursor;
+
+// Forma de uma Árvore B, calculada sob demanda percorrendo os nós
+typedef struct BTreeShape {
+    int height;
+    size_t nodes;
+    size_t leaves;
+    size_t keys;
+    uint64_t splits;
+    uint64_t merges;
+    uint64_t borrows;
+} BTreeShape;
+
+// Soma das Árvores B de um diretório ou de uma subárvore de diretórios
+typedef struct DirectoryStats {
+    size_t directories;
+    BTreeShape tree;
+} DirectoryStats;
+
+// Filtros do ls; campos NULL (ou 0) não filtram. As entradas listadas são as
+// com from <= nome < to, nome > after, que começam com 'prefix' e casam com o
+// glob 'pattern'; no máximo 'limit' delas (uma página), pulando as 'offset'
+// primeiras.
+typedef struct ListFilter {
+    const char* from;
+    const char* to;
+    const char* prefix;
+    const char* pattern;
+    const char* after;
+    size_t limit;
+    size_t offset;
+} ListFilter;
+
+// Declaração antecipada da estrutura FileSystem
+struct FileSystem;
+
+// Somas de uma subárvore de diretórios, mantidas a cada alteração
+typedef struct DirectoryTotals {
+    uint64_t bytes; // conteúdo dos arquivos
+    uint64_t files;
+    uint64_t dirs;  // subdiretórios (sem contar o próprio)
+} DirectoryTotals;
+
 // Estrutura de um diretório, que contém uma Árvore B
 typedef struct Directory {
-    char* name; // Nome do diretório
+    const char* name; // Nome do diretório (guardado no TreeNode que o representa; "/" na raiz)
     struct Directory* parent; // Ponteiro para o diretório pai
+    TreeNode* node; // TreeNode que representa o diretório no pai (NULL na raiz)
+    char* path; // Caminho completo, montado no primeiro uso (ver get_current_path)
+    size_t path_len;
     BTree* tree; // Árvore B com os filhos
+    struct FileSystem* fs; // Sistema de arquivos ao qual o diretório pertence
+    uint64_t id; // Identificador estável (usado pelo journal para achar o diretório)
+    DirectoryTotals totals; // Tudo o que está abaixo do diretório (ver 'du')
+    pthread_mutex_t lock; // Serializa quem altera a Árvore B do diretório (só no modo concorrente)
+    uint32_t pins; // Sessões com o diretório atual nele ou abaixo dele; com pins, ele não pode ser removido
+    bool removed; // Já removido do pai (ver directory_mark_removed)
+    bool dirty; // Alterado desde o último checkpoint
+    struct Directory* clone_prev; // Anel dos diretórios ligados por cópias, que podem ter entradas em comum
+    struct Directory* clone_next; // (ver directory_unshare_file); sozinho, aponta para si mesmo, e fora dele (sendo liberado) é nulo
+    struct Directory* dirty_prev; // Lista de diretórios sujos do sistema de arquivos
+    struct Directory* dirty_next;
+    struct Directory* subdirs; // Lista dos subdiretórios (sem ordem), para copiar sem varrer as entradas
+    struct Directory* sibling_prev;
+    struct Directory* sibling_next;
 } Directory;
 
+// Número do inode do item (o de um diretório é o seu id; ver fs_inode.h)
+static inline uint64_t tree_node_ino(const TreeNode* node)
+{
+    return node->type == FILE_TYPE ? __atomic_load_n(&node->data.file->ino, __ATOMIC_RELAXED)
+                                   : node->data.directory->id;
+}
+
+// Um dos nomes de um arquivo: o diretório e a entrada
+typedef struct FileLink {
+    Directory* dir;
+    TreeNode* node;
+} FileLink;
+
+// Os nomes de um arquivo que tem mais de um (ln). Com eles, uma escrita por
+// qualquer nome acerta os totais, a data de modificação e o checkpoint dos
+// diretórios de todos. Quando sobra um nome só, o arquivo volta a ser comum
+// (links = NULL). As entradas desses arquivos nunca ficam divididas com uma
+// cópia de diretório (snapshot, cp -r): a cópia ganha arquivos próprios.
+typedef struct FileLinks {
+    File* file;
+    FileLink* items; // file->nlink nomes
+    uint32_t capacity;
+    struct FileLinks* prev; // lista FileSystem::links
+    struct FileLinks* next;
+} FileLinks;
+
+// Cache de entradas (dentry cache): (id do diretório, nome) -> TreeNode.
+// Tabela de mapeamento direto consultada antes de descer na Árvore B do
+// diretório, o que evita refazer as buscas de cada nível em caminhos longos.
+// A chave usa o id (nunca reaproveitado), e não o ponteiro do diretório.
+// Cada posição tem um contador de versão (seqlock): quem grava o deixa ímpar
+// durante a escrita, e quem lê descarta a leitura se ele mudou no meio.
+#define DCACHE_SLOTS 4096
+
+typedef struct DentryCacheSlot {
+    uint32_t seq;
+    uint64_t dir_id; // 0 marca posição vazia
+    uint64_t hash;
+    TreeNode* node;
+} DentryCacheSlot;
+
+typedef struct DentryCache {
+    DentryCacheSlot* slots;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+} DentryCache;
+
+// Como a resolução de um caminho deixa as travas (no modo concorrente)
+typedef enum {
+    LOOKUP_READ,  // não trava nada: a busca fica numa seção de leitura (ver fs_epoch.h)
+    LOOKUP_WRITE  // trava o pai, para criar ou remover o último componente
+} LookupMode;
+
+// Resultado da resolução de um caminho
+typedef struct PathLookup {
+    Directory* parent; // diretório que contém o último componente
+    char* name;        // último componente (NULL para "/", "." e "..")
+    TreeNode* node;    // o item, se existir (NULL para a raiz)
+    Directory* dir;    // o diretório apontado, se for um diretório
+    char* buffer;      // cópia do caminho onde 'name' aponta
+    Directory* locked; // diretório travado até o path_lookup_free (LOOKUP_WRITE)
+    bool epoch;        // dentro de uma seção de leitura até o path_lookup_free
+} PathLookup;
+
+// Identificador da raiz; os demais diretórios e os arquivos recebem números
+// de inode crescentes (o de um diretório é o seu id)
+#define FS_ROOT_DIR_ID 1
+
+// Quando ls, cd, stat e cat atualizam a data de último acesso (como as opções
+// de montagem do Linux). Com relatime, uma leitura só escreve no item se a
+// data for anterior à última modificação ou tiver mais de FS_RELATIME_WINDOW
+// segundos: leituras repetidas não sujam os metadados.
+typedef enum {
+    ATIME_STRICT,   // a cada acesso
+    ATIME_RELATIME, // padrão
+    ATIME_NOATIME   // nunca
+} AtimePolicy;
+
+#define FS_RELATIME_WINDOW (24 * 60 * 60)
+
+// Um sistema de arquivos: a raiz e o alocador de onde saem todas as estruturas
+typedef struct FileSystem {
+    Directory* root;
+    FsAllocator alloc;
+    uint64_t next_ino; // Próximo número de inode (ids de diretório inclusive)
+    Directory* dirty_head; // Diretórios a gravar no próximo checkpoint
+    DentryCache dcache;
+    struct FsJournal* journal; // NULL quando não há persistência
+    AtimePolicy atime_policy;
+    struct FsReclaimer* reclaimer; // liberação das subárvores do rm -r (NULL até o primeiro)
+    FileLinks* links; // Arquivos com mais de um nome
+    // Modo concorrente (servidor): vários comandos ao mesmo tempo. Os comandos
+    // comuns seguram 'lock' para leitura, leem sem travas e travam só os
+    // diretórios que alteram; os que percorrem ou gravam a árvore inteira o
+    // seguram para escrita.
+    bool concurrent;
+    pthread_rwlock_t lock;
+    pthread_mutex_t journal_lock; // journal e lista de diretórios sujos
+    pthread_mutex_t links_lock;   // nomes dos arquivos com mais de um (FileLinks) e as escritas neles
+    // Anéis das cópias (Directory.clone_next). Sempre usada: a thread do rm -r
+    // também tira diretórios dos anéis, mesmo fora do modo concorrente.
+    pthread_mutex_t clones_lock;
+} FileSystem;
+
 // --- Funções da Árvore B ---
-BTree* btree_create();
+BTree* btree_create(FsAllocator* alloc);
 void btree_destroy(BTree* tree);
 void btree_insert(BTree* tree, TreeNode* node);
 void btree_delete(BTree* tree, const char* name);
 TreeNode* btree_search(BTree* tree, const char* name);
+void btree_bulk_load(BTree* tree, TreeNode** items, size_t count);
 void btree_traverse(BTreeNode* node, bool long_format); 
+void btree_cursor_open(BTreeCursor* cursor, const BTree* tree);
+void btree_cursor_seek(BTreeCursor* cursor, const BTree* tree, const char* name);
+void btree_cursor_seek_rank(BTreeCursor* cursor, const BTree* tree, size_t rank);
+TreeNode* btree_cursor_next(BTreeCursor* cursor);
+size_t btree_count(const BTree* tree);
+size_t btree_rank(const BTree* tree, const char* name);
+void btree_shape(const BTree* tree, BTreeShape* shape);
 
 // --- Funções de Arquivos e Diretórios ---
-TreeNode* delete_txt_file(const char* name, const char* content);
+TreeNode* create_txt_file(const char* name, const char* content, Directory* parent);
 TreeNode* create_directory(const char* name, Directory* parent);
-void delete_txt_file(TreeNode* node); 
+TreeNode* copy_txt_file(const TreeNode* src, const char* name, Directory* parent);
+TreeNode* link_txt_file(TreeNode* src, Directory* src_dir, const char* name, Directory* parent);
+void delete_txt_file(FsAllocator* alloc, TreeNode* node);
 void delete_directory_recursive(Directory* dir);
-void free_tree_node(TreeNode* node); 
+void free_tree_node(FsAllocator* alloc, TreeNode* node);
+size_t file_size(const File* file);
+size_t file_read(const File* file, size_t offset, size_t len, char* dst);
+size_t file_print(FILE* out, const File* file, size_t offset, size_t len);
+void file_set_mtime(FileSystem* fs, TreeNode* node, time_t mtime);
+void tree_node_set_ino(FileSystem* fs, TreeNode* node, uint64_t ino);
+
+// --- Alterações em Diretórios (registradas no journal, se houver) ---
+void directory_add_entry(Directory* dir, TreeNode* node);
+void directory_remove_entry(Directory* dir, const char* name);
+void directory_remove_tree(Directory* dir, const char* name);
+bool directory_contains(const Directory* dir, const Directory* other);
+void directory_set_mtime(Directory* dir, time_t mtime);
+void directory_mark_dirty(Directory* dir);
+void directory_clear_dirty(Directory* dir);
+void directory_file_resized(Directory* dir, size_t old_size, size_t new_size);
+bool directory_file_write(Directory* dir, TreeNode* node, size_t offset, const char* data, size_t len);
+TreeNode* directory_unshare_file(Directory* dir, TreeNode* node);
+TreeNode* directory_reshare_file(Directory* dir, const char* name, uint64_t ino, uint64_t size);
+void directory_join_clones(Directory* dir, Directory* other);
+TreeNode* directory_add_clone(Directory* dir, const char* name, Directory* src);
+TreeNode* directory_add_link(Directory* dir, const char* name, Directory* src_dir, TreeNode* src);
+void directory_recount(Directory* dir);
+
+// --- Resolução de Caminhos ---
+TreeNode* directory_lookup(Directory* dir, const char* name);
+bool path_lookup(Directory* cwd, const char* path, PathLookup* lookup, LookupMode mode);
+void path_lookup_free(PathLookup* lookup);
+
+// --- Sistema de Arquivos ---
+FileSystem* fs_create();
+void fs_destroy(FileSystem* fs);
+void fs_set_concurrent(FileSystem* fs);
+void fs_lock(FileSystem* fs, bool exclusive);
+void fs_unlock(FileSystem* fs);
+const char* fs_atime_policy_name(AtimePolicy policy);
+bool fs_parse_atime_policy(const char* name, AtimePolicy* policy);
+void node_touch_atime(FileSystem* fs, TreeNode* node);
+
+// --- Relógio ---
+// Entre fs_clock_begin e fs_clock_end (um comando), fs_clock_now devolve
+// sempre a mesma hora, lida uma vez só com o relógio grosso do sistema. Fora
+// disso (ou em outra thread), lê o relógio a cada chamada.
+void fs_clock_begin(void);
+void fs_clock_end(void);
+time_t fs_clock_now(void);
+void directory_lock(Directory* dir);
+void directory_unlock(Directory* dir);
+bool directory_pin(Directory* dir);
+void directory_unpin(Directory* dir);
+bool directory_mark_removed(Directory* dir);
 
 // --- Funções de Navegação e Comandos ---
-Directory* get_root_directory();
-void list_directory_contents(Directory* dir, bool long_format);
-void change_directory(Directory** current_dir, const char* path);
-char* get_current_path(Directory* dir); 
+size_t list_directory_contents(FILE* out, Directory* dir, bool long_format, const ListFilter* filter);
+size_t directory_count(Directory* dir, const ListFilter* filter);
+void change_directory(FILE* out, Directory** current_dir, const char* path);
+const char* get_current_path(Directory* dir);
 
 // --- Funções de Manipulação de Imagem do Sistema de Arquivos ---
 void update_parent_modification_time(Directory* dir);
-void show_metadata(Directory* dir, const char* name);
+void show_metadata(FILE* out, Directory* dir, const char* path);
+bool show_inode_metadata(FILE* out, FileSystem* fs, uint64_t ino);
+void show_disk_usage(FILE* out, Directory* dir, bool all);
+void directory_stats(Directory* dir, bool recursive, DirectoryStats* stats);
+bool directory_check(Directory* dir, char* msg, size_t size);
 
 
 #endif // FILESYSTEM_H
\ No newline at end of file
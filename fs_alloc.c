@@ -0,0 +1,217 @@
+#include "fs_alloc.h"
+#include "filesystem.h"
+
+/* ============================================================================= */
+/* --- CACHES DE OBJETOS (SLABS) --- */
+/* ============================================================================= */
+
+void slab_cache_init(SlabCache *cache, size_t obj_size, size_t align)
+{
+    // O objeto precisa caber o ponteiro da lista livre
+    if (obj_size < sizeof(void *))
+        obj_size = sizeof(void *);
+    if (align < sizeof(void *))
+        align = sizeof(void *);
+
+    cache->obj_size = (obj_size + align - 1) & ~(align - 1);
+    cache->align = align;
+    cache->free_list = NULL;
+    cache->bump = NULL;
+    cache->bump_end = NULL;
+    cache->slabs = NULL;
+    cache->in_use = 0;
+    cache->slab_count = 0;
+    cache->lock = NULL;
+}
+
+void slab_cache_destroy(SlabCache *cache)
+{
+    Slab *slab = cache->slabs;
+    while (slab)
+    {
+        Slab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    pthread_mutex_t *lock = cache->lock;
+    slab_cache_init(cache, cache->obj_size, cache->align);
+    cache->lock = lock;
+}
+
+// Reserva um novo slab. O cabeçalho ocupa o primeiro bloco alinhado e os
+// objetos são entregues depois dele, um a um, conforme forem pedidos.
+static void slab_cache_grow(SlabCache *cache)
+{
+    size_t header = (sizeof(Slab) + cache->align - 1) & ~(cache->align - 1);
+    size_t size = SLAB_SIZE;
+    if (size < header + cache->obj_size)
+        size = header + cache->obj_size;
+    size = (size + cache->align - 1) & ~(cache->align - 1);
+
+    Slab *slab = (Slab *)aligned_alloc(cache->align, size);
+    if (!slab)
+    {
+        perror("Erro ao reservar memória");
+        exit(EXIT_FAILURE);
+    }
+    slab->next = cache->slabs;
+    cache->slabs = slab;
+    cache->slab_count++;
+
+    cache->bump = (char *)slab + header;
+    cache->bump_end = (char *)slab + size;
+}
+
+void *slab_alloc(SlabCache *cache)
+{
+    if (cache->lock)
+        pthread_mutex_lock(cache->lock);
+    void *obj = cache->free_list;
+    if (obj)
+    {
+        cache->free_list = *(void **)obj;
+    }
+    else
+    {
+        if (cache->bump == NULL || cache->bump + cache->obj_size > cache->bump_end)
+            slab_cache_grow(cache);
+        obj = cache->bump;
+        cache->bump += cache->obj_size;
+    }
+    cache->in_use++;
+    if (cache->lock)
+        pthread_mutex_unlock(cache->lock);
+    return obj;
+}
+
+void slab_free(SlabCache *cache, void *obj)
+{
+    if (!obj) return;
+    if (cache->lock)
+        pthread_mutex_lock(cache->lock);
+    *(void **)obj = cache->free_list;
+    cache->free_list = obj;
+    cache->in_use--;
+    if (cache->lock)
+        pthread_mutex_unlock(cache->lock);
+}
+
+/* ============================================================================= */
+/* --- ALOCADOR DO SISTEMA DE ARQUIVOS --- */
+/* ============================================================================= */
+
+void fs_alloc_init(FsAllocator *alloc)
+{
+    slab_cache_init(&alloc->tree_nodes, sizeof(TreeNode), _Alignof(TreeNode));
+    slab_cache_init(&alloc->btree_nodes, sizeof(BTreeNode), _Alignof(BTreeNode));
+    slab_cache_init(&alloc->btrees, sizeof(BTree), _Alignof(BTree));
+    slab_cache_init(&alloc->files, sizeof(File), _Alignof(File));
+    slab_cache_init(&alloc->directories, sizeof(Directory), _Alignof(Directory));
+    for (int i = 0; i < NAME_CLASS_COUNT; i++)
+        slab_cache_init(&alloc->names[i], (size_t)NAME_CLASS_MIN << i, 1);
+    alloc->large_names = 0;
+    fs_content_init(&alloc->content);
+    fs_inode_init(&alloc->inodes);
+    alloc->locked = false;
+    alloc->concurrent = false;
+}
+
+// Liga a trava do alocador: a partir daqui ele pode ser usado por várias
+// threads ao mesmo tempo. Todos os caches dividem a mesma trava.
+void fs_alloc_set_locked(FsAllocator *alloc)
+{
+    if (alloc->locked)
+        return;
+    pthread_mutex_init(&alloc->lock, NULL);
+    alloc->locked = true;
+    alloc->tree_nodes.lock = &alloc->lock;
+    alloc->btree_nodes.lock = &alloc->lock;
+    alloc->btrees.lock = &alloc->lock;
+    alloc->files.lock = &alloc->lock;
+    alloc->directories.lock = &alloc->lock;
+    for (int i = 0; i < NAME_CLASS_COUNT; i++)
+        alloc->names[i].lock = &alloc->lock;
+    fs_content_set_concurrent(&alloc->content);
+    fs_inode_set_concurrent(&alloc->inodes);
+}
+
+// Modo servidor: além das travas, as estruturas passam a ser trocadas com
+// cópia na escrita, para os leitores sem trava (ver btree_cow)
+void fs_alloc_set_concurrent(FsAllocator *alloc)
+{
+    fs_alloc_set_locked(alloc);
+    alloc->concurrent = true;
+}
+
+void fs_alloc_destroy(FsAllocator *alloc)
+{
+    slab_cache_destroy(&alloc->tree_nodes);
+    slab_cache_destroy(&alloc->btree_nodes);
+    slab_cache_destroy(&alloc->btrees);
+    slab_cache_destroy(&alloc->files);
+    slab_cache_destroy(&alloc->directories);
+    for (int i = 0; i < NAME_CLASS_COUNT; i++)
+        slab_cache_destroy(&alloc->names[i]);
+    fs_content_destroy(&alloc->content);
+    fs_inode_destroy(&alloc->inodes);
+    if (alloc->locked)
+        pthread_mutex_destroy(&alloc->lock);
+}
+
+// Classe da arena para uma string de 'size' bytes (com o '\0'), ou -1 se for grande demais
+static int name_class(size_t size)
+{
+    int c = 0;
+    size_t class_size = NAME_CLASS_MIN;
+    while (class_size < size)
+    {
+        class_size <<= 1;
+        if (++c == NAME_CLASS_COUNT)
+            return -1;
+    }
+    return c;
+}
+
+char *fs_alloc_name(FsAllocator *alloc, const char *name)
+{
+    size_t size = strlen(name) + 1;
+    int c = name_class(size);
+    char *copy;
+    if (c < 0)
+    {
+        copy = (char *)malloc(size);
+        __atomic_fetch_add(&alloc->large_names, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        copy = (char *)slab_alloc(&alloc->names[c]);
+    }
+    memcpy(copy, name, size);
+    return copy;
+}
+
+void fs_free_name(FsAllocator *alloc, char *name)
+{
+    if (!name) return;
+    int c = name_class(strlen(name) + 1);
+    if (c < 0)
+    {
+        free(name);
+        __atomic_fetch_sub(&alloc->large_names, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        slab_free(&alloc->names[c], name);
+    }
+}
+
+// Total de memória reservada pelos slabs (usado nos relatórios de memória)
+size_t fs_alloc_reserved_bytes(const FsAllocator *alloc)
+{
+    size_t slabs = alloc->tree_nodes.slab_count + alloc->btree_nodes.slab_count +
+                   alloc->btrees.slab_count + alloc->files.slab_count +
+                   alloc->directories.slab_count;
+    for (int i = 0; i < NAME_CLASS_COUNT; i++)
+        slabs += alloc->names[i].slab_count;
+    return slabs * SLAB_SIZE;
+}
@@ -0,0 +1,77 @@
+#ifndef FS_ALLOC_H
+#define FS_ALLOC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "fs_content.h"
+#include "fs_inode.h"
+
+// Alocador por sistema de arquivos: caches de tamanho fixo (slabs) para as
+// estruturas (TreeNode, BTreeNode, File, Directory, BTree) e uma arena de
+// nomes separada por classes de tamanho. Objetos liberados voltam para a
+// lista livre da sua classe e são reaproveitados; a memória dos slabs só é
+// devolvida ao sistema quando o sistema de arquivos é destruído. Os blocos de
+// conteúdo dos arquivos saem do armazenamento por conteúdo (fs_content.h), e
+// os itens liberados saem junto da tabela de inodes (fs_inode.h).
+
+// Tamanho de cada bloco grande pedido ao sistema
+#define SLAB_SIZE (64 * 1024)
+
+// Classes da arena de nomes: 16, 32, 64, 128 e 256 bytes. Nomes maiores vão
+// direto para o malloc.
+#define NAME_CLASS_COUNT 5
+#define NAME_CLASS_MIN 16
+#define NAME_CLASS_MAX (NAME_CLASS_MIN << (NAME_CLASS_COUNT - 1))
+
+// Bloco grande de onde os objetos de um cache são recortados
+typedef struct Slab {
+    struct Slab* next;
+} Slab;
+
+// Cache de objetos de um mesmo tamanho
+typedef struct SlabCache {
+    size_t obj_size;   // tamanho de cada objeto (já arredondado para o alinhamento)
+    size_t align;      // alinhamento dos objetos
+    void* free_list;   // objetos liberados (lista encadeada dentro dos próprios objetos)
+    char* bump;        // próximo objeto nunca usado do slab atual
+    char* bump_end;    // fim do slab atual
+    Slab* slabs;       // todos os slabs, para liberar no final
+    size_t in_use;     // objetos entregues e ainda não liberados
+    size_t slab_count; // slabs reservados
+    pthread_mutex_t* lock; // trava do alocador no modo concorrente (NULL fora dele)
+} SlabCache;
+
+// Conjunto de caches de um sistema de arquivos
+typedef struct FsAllocator {
+    SlabCache tree_nodes;
+    SlabCache btree_nodes;
+    SlabCache btrees;
+    SlabCache files;
+    SlabCache directories;
+    SlabCache names[NAME_CLASS_COUNT];
+    size_t large_names;  // nomes maiores que NAME_CLASS_MAX (alocados com malloc)
+    FsContentStore content;
+    FsInodeTable inodes;
+    pthread_mutex_t lock;
+    bool locked;     // travas ligadas (mais de uma thread usa o alocador)
+    bool concurrent; // modo servidor (travas e cópia na escrita)
+} FsAllocator;
+
+// --- Caches de objetos ---
+void slab_cache_init(SlabCache* cache, size_t obj_size, size_t align);
+void slab_cache_destroy(SlabCache* cache);
+void* slab_alloc(SlabCache* cache);
+void slab_free(SlabCache* cache, void* obj);
+
+// --- Alocador do sistema de arquivos ---
+void fs_alloc_init(FsAllocator* alloc);
+void fs_alloc_destroy(FsAllocator* alloc);
+char* fs_alloc_name(FsAllocator* alloc, const char* name);
+void fs_free_name(FsAllocator* alloc, char* name);
+size_t fs_alloc_reserved_bytes(const FsAllocator* alloc);
+void fs_alloc_set_locked(FsAllocator* alloc);
+void fs_alloc_set_concurrent(FsAllocator* alloc);
+
+#endif // FS_ALLOC_H
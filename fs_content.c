@@ -0,0 +1,311 @@
+#include "fs_content.h"
+#include "fs_lz.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ============================================================================= */
+/* --- HASH --- */
+/* ============================================================================= */
+
+#define HASH_P1 0x9E3779B185EBCA87ULL
+#define HASH_P2 0xC2B2AE3D27D4EB4FULL
+#define HASH_P3 0x165667B19E3779F9ULL
+
+static inline uint64_t hash_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash_read64(const char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t word)
+{
+    acc += word * HASH_P2;
+    acc = hash_rotl(acc, 31);
+    return acc * HASH_P1;
+}
+
+uint64_t fs_content_hash(const char *data, size_t len)
+{
+    const char *p = data;
+    const char *end = data + len;
+    uint64_t h;
+
+    // Os quatro acumuladores são independentes: o processador avança os quatro
+    // ao mesmo tempo
+    if (len >= 32)
+    {
+        uint64_t v1 = HASH_P1 + HASH_P2;
+        uint64_t v2 = HASH_P2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - HASH_P1;
+        while (p + 32 <= end)
+        {
+            v1 = hash_round(v1, hash_read64(p));
+            v2 = hash_round(v2, hash_read64(p + 8));
+            v3 = hash_round(v3, hash_read64(p + 16));
+            v4 = hash_round(v4, hash_read64(p + 24));
+            p += 32;
+        }
+        h = hash_rotl(v1, 1) + hash_rotl(v2, 7) + hash_rotl(v3, 12) + hash_rotl(v4, 18);
+    }
+    else
+    {
+        h = HASH_P3;
+    }
+    h += len;
+
+    while (p + 8 <= end)
+    {
+        h ^= hash_round(0, hash_read64(p));
+        h = hash_rotl(h, 27) * HASH_P1 + HASH_P3;
+        p += 8;
+    }
+    while (p < end)
+    {
+        h ^= (uint64_t)(unsigned char)*p * HASH_P3;
+        h = hash_rotl(h, 11) * HASH_P1;
+        p++;
+    }
+
+    // Mistura final: cada bit da entrada afeta todos os da saída
+    h ^= h >> 33;
+    h *= HASH_P2;
+    h ^= h >> 29;
+    h *= HASH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* ============================================================================= */
+/* --- TABELA --- */
+/* ============================================================================= */
+
+#define SHARD_MIN_CAPACITY 64
+
+// A parte sai dos bits altos do hash e a posição inicial, dos baixos
+static FsContentShard *shard_of(FsContentStore *store, uint64_t hash)
+{
+    return &store->shards[hash >> 60 & (FS_CONTENT_SHARDS - 1)];
+}
+
+static void shard_lock(FsContentStore *store, FsContentShard *shard)
+{
+    if (store->concurrent)
+        pthread_mutex_lock(&shard->lock);
+}
+
+static void shard_unlock(FsContentStore *store, FsContentShard *shard)
+{
+    if (store->concurrent)
+        pthread_mutex_unlock(&shard->lock);
+}
+
+static void shard_place(FsContentShard *shard, uint64_t hash, FileChunk *chunk)
+{
+    size_t mask = shard->capacity - 1;
+    size_t i = hash & mask;
+    while (shard->table[i].chunk)
+        i = (i + 1) & mask;
+    shard->table[i].hash = hash;
+    shard->table[i].chunk = chunk;
+}
+
+// Dobra a tabela quando passa da metade
+static void shard_grow(FsContentShard *shard)
+{
+    FsContentEntry *old = shard->table;
+    size_t old_capacity = shard->capacity;
+    shard->capacity = old_capacity ? old_capacity * 2 : SHARD_MIN_CAPACITY;
+    shard->table = (FsContentEntry *)calloc(shard->capacity, sizeof(FsContentEntry));
+    if (!shard->table)
+    {
+        perror("Erro ao reservar memória");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_capacity; i++)
+        if (old[i].chunk)
+            shard_place(shard, old[i].hash, old[i].chunk);
+    free(old);
+}
+
+// Tira 'chunk' da tabela. As entradas seguintes do mesmo grupo voltam uma
+// posição quando podem, para que nenhuma busca pare antes da hora.
+static void shard_remove(FsContentShard *shard, uint64_t hash, FileChunk *chunk)
+{
+    size_t mask = shard->capacity - 1;
+    size_t i = hash & mask;
+    while (shard->table[i].chunk != chunk)
+        i = (i + 1) & mask;
+    size_t hole = i;
+    for (;;)
+    {
+        i = (i + 1) & mask;
+        if (!shard->table[i].chunk)
+            break;
+        size_t home = shard->table[i].hash & mask;
+        // A entrada em i só pode ir para o buraco se a posição inicial dela
+        // não estiver entre o buraco (exclusive) e i (inclusive)
+        bool between = (hole <= i) ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!between)
+        {
+            shard->table[hole] = shard->table[i];
+            hole = i;
+        }
+    }
+    shard->table[hole].chunk = NULL;
+    shard->count--;
+}
+
+/* ============================================================================= */
+/* --- ARMAZENAMENTO --- */
+/* ============================================================================= */
+
+void fs_content_init(FsContentStore *store)
+{
+    memset(store, 0, sizeof(*store));
+    for (int i = 0; i < FS_CONTENT_SHARDS; i++)
+        pthread_mutex_init(&store->shards[i].lock, NULL);
+}
+
+// Liga as travas das partes. Precisa ser chamada antes de as outras threads
+// começarem a usar o armazenamento.
+void fs_content_set_concurrent(FsContentStore *store)
+{
+    store->concurrent = true;
+}
+
+// Os blocos já foram todos soltos pelos arquivos: só as tabelas ficam
+void fs_content_destroy(FsContentStore *store)
+{
+    for (int i = 0; i < FS_CONTENT_SHARDS; i++)
+    {
+        free(store->shards[i].table);
+        pthread_mutex_destroy(&store->shards[i].lock);
+    }
+    memset(store, 0, sizeof(*store));
+}
+
+FileChunk *fs_content_alloc(FsContentStore *store, size_t capacity)
+{
+    FileChunk *chunk = (FileChunk *)malloc(sizeof(FileChunk) + capacity);
+    if (!chunk)
+    {
+        perror("Erro ao reservar memória");
+        exit(EXIT_FAILURE);
+    }
+    chunk->refs = 1;
+    chunk->capacity = (uint32_t)capacity;
+    chunk->stored = 0;
+    chunk->packed = 0;
+    __atomic_fetch_add(&store->chunks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&store->chunk_bytes, capacity, __ATOMIC_RELAXED);
+    return chunk;
+}
+
+FileChunk *fs_content_pack(FsContentStore *store, const char *data, size_t len)
+{
+    char buf[FS_LZ_BOUND(FS_CONTENT_PACK_MAX)];
+    if (len > FS_CONTENT_PACK_MAX)
+        return NULL;
+    size_t packed = fs_lz_compress(data, len, buf, len - len / 8);
+    if (packed == 0)
+        return NULL;
+    FileChunk *chunk = fs_content_alloc(store, packed);
+    memcpy(chunk->data, buf, packed);
+    chunk->packed = (uint32_t)packed;
+    __atomic_fetch_add(&store->packed, 1, __ATOMIC_RELAXED);
+    return chunk;
+}
+
+static void content_free(FsContentStore *store, FileChunk *chunk)
+{
+    if (chunk->packed)
+        __atomic_fetch_sub(&store->packed, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&store->chunks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&store->chunk_bytes, chunk->capacity, __ATOMIC_RELAXED);
+    free(chunk);
+}
+
+// Um bloco guardado só chega a zero referências com a trava da parte dele:
+// assim uma busca nunca acha na tabela um bloco que já está sendo liberado.
+// O hash é calculado de novo (o bloco não o guarda), só na última referência.
+void fs_content_put(FsContentStore *store, FileChunk *chunk)
+{
+    uint32_t stored = __atomic_load_n(&chunk->stored, __ATOMIC_ACQUIRE);
+    if (stored == 0)
+    {
+        if (__atomic_sub_fetch(&chunk->refs, 1, __ATOMIC_ACQ_REL) == 0)
+            content_free(store, chunk);
+        return;
+    }
+
+    uint32_t refs = __atomic_load_n(&chunk->refs, __ATOMIC_RELAXED);
+    while (refs > 1)
+    {
+        if (__atomic_compare_exchange_n(&chunk->refs, &refs, refs - 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            return;
+    }
+
+    uint64_t hash = fs_content_hash(chunk->data, stored);
+    FsContentShard *shard = shard_of(store, hash);
+    shard_lock(store, shard);
+    bool last = __atomic_sub_fetch(&chunk->refs, 1, __ATOMIC_ACQ_REL) == 0;
+    if (last)
+    {
+        shard_remove(shard, hash, chunk);
+        __atomic_fetch_sub(&store->stored, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&store->stored_bytes, stored, __ATOMIC_RELAXED);
+    }
+    shard_unlock(store, shard);
+    if (last)
+        content_free(store, chunk);
+}
+
+FileChunk *fs_content_intern(FsContentStore *store, uint64_t hash, FileChunk *chunk, size_t len)
+{
+    FsContentShard *shard = shard_of(store, hash);
+    shard_lock(store, shard);
+    if (shard->capacity)
+    {
+        size_t mask = shard->capacity - 1;
+        for (size_t i = hash & mask; shard->table[i].chunk; i = (i + 1) & mask)
+        {
+            FileChunk *found = shard->table[i].chunk;
+            if (shard->table[i].hash == hash && found->stored == len && found->packed == chunk->packed &&
+                memcmp(found->data, chunk->data, len) == 0)
+            {
+                __atomic_fetch_add(&found->refs, 1, __ATOMIC_RELAXED);
+                shard_unlock(store, shard);
+                __atomic_fetch_add(&store->hits, 1, __ATOMIC_RELAXED);
+                return found;
+            }
+        }
+    }
+
+    if ((shard->count + 1) * 2 > shard->capacity)
+        shard_grow(shard);
+    shard_place(shard, hash, chunk);
+    shard->count++;
+    __atomic_store_n(&chunk->stored, (uint32_t)len, __ATOMIC_RELEASE);
+    shard_unlock(store, shard);
+    __atomic_fetch_add(&store->stored, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&store->stored_bytes, len, __ATOMIC_RELAXED);
+    return chunk;
+}
+
+void fs_content_stats(const FsContentStore *store, FsContentStats *stats)
+{
+    stats->chunks = __atomic_load_n(&store->chunks, __ATOMIC_RELAXED);
+    stats->chunk_bytes = __atomic_load_n(&store->chunk_bytes, __ATOMIC_RELAXED);
+    stats->stored = __atomic_load_n(&store->stored, __ATOMIC_RELAXED);
+    stats->stored_bytes = __atomic_load_n(&store->stored_bytes, __ATOMIC_RELAXED);
+    stats->packed = __atomic_load_n(&store->packed, __ATOMIC_RELAXED);
+    stats->hits = __atomic_load_n(&store->hits, __ATOMIC_RELAXED);
+}
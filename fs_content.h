@@ -0,0 +1,98 @@
+#ifndef FS_CONTENT_H
+#define FS_CONTENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Blocos de conteúdo dos arquivos e o armazenamento endereçado por conteúdo
+//
+// Todo bloco tem contagem de referências: cópias de arquivos (cp, snapshot)
+// dividem os blocos, e quem escreve num bloco dividido escreve numa cópia. Os
+// blocos completos de um arquivo também podem ser guardados no armazenamento,
+// uma tabela indexada por um hash de 64 bits do conteúdo: um bloco novo igual
+// a um já guardado é trocado pelo guardado, e arquivos com o mesmo corpo
+// acabam com os mesmos blocos. Um bloco guardado nunca é alterado (quem
+// escreve nele faz uma cópia própria) e sai da tabela com a última referência.
+//
+// Iguais no hash não bastam: o conteúdo é sempre comparado, então uma colisão
+// só custa uma comparação a mais. Um bloco comprimido (fs_lz.h) é guardado e
+// comparado pelos bytes comprimidos: a compressão é determinística, então
+// conteúdos iguais dão blocos iguais.
+
+// A tabela é dividida em partes com travas próprias (escolhidas pelo hash)
+#define FS_CONTENT_SHARDS 16
+
+// Maior bloco que fs_content_pack comprime (o tamanho dos blocos dos arquivos)
+#define FS_CONTENT_PACK_MAX 4096
+
+// Bloco de conteúdo
+typedef struct FileChunk {
+    uint32_t refs;
+    uint32_t capacity; // bytes reservados em 'data'
+    uint32_t stored;   // bytes guardados no armazenamento (0: bloco fora dele)
+    uint32_t packed;   // tamanho comprimido em 'data' (0: conteúdo sem compressão)
+    char data[];
+} FileChunk;
+
+typedef struct FsContentEntry {
+    uint64_t hash;
+    FileChunk* chunk; // NULL: posição livre
+} FsContentEntry;
+
+// Parte da tabela (endereçamento aberto, sondagem linear)
+typedef struct FsContentShard {
+    FsContentEntry* table;
+    size_t capacity; // potência de 2
+    size_t count;
+    pthread_mutex_t lock;
+} __attribute__((aligned(64))) FsContentShard;
+
+typedef struct FsContentStore {
+    FsContentShard shards[FS_CONTENT_SHARDS];
+    size_t chunks;       // blocos vivos (guardados ou não)
+    size_t chunk_bytes;  // soma das capacidades dos blocos vivos
+    size_t stored;       // blocos no armazenamento
+    size_t stored_bytes; // bytes desses blocos
+    size_t packed;       // blocos comprimidos
+    uint64_t hits;       // blocos trocados por um igual já guardado
+    bool concurrent;     // travas das partes ligadas
+} FsContentStore;
+
+// Números do armazenamento (ver 'stats')
+typedef struct FsContentStats {
+    size_t chunks;
+    size_t chunk_bytes;
+    size_t stored;
+    size_t stored_bytes;
+    size_t packed;
+    uint64_t hits;
+} FsContentStats;
+
+void fs_content_init(FsContentStore* store);
+void fs_content_destroy(FsContentStore* store);
+void fs_content_set_concurrent(FsContentStore* store);
+
+// Hash de 64 bits (no estilo do xxHash64: quatro acumuladores de 8 bytes)
+uint64_t fs_content_hash(const char* data, size_t len);
+
+// Bloco novo, fora do armazenamento, com uma referência
+FileChunk* fs_content_alloc(FsContentStore* store, size_t capacity);
+
+// Bloco comprimido com os 'len' bytes de 'data', ou NULL se a compressão não
+// economiza pelo menos 1/8 do tamanho
+FileChunk* fs_content_pack(FsContentStore* store, const char* data, size_t len);
+
+// Solta uma referência; a última libera o bloco (e o tira da tabela)
+void fs_content_put(FsContentStore* store, FileChunk* chunk);
+
+// Guarda os primeiros 'len' bytes de 'chunk' (com uma única referência, fora
+// do armazenamento). Se já havia um bloco igual, devolve esse, com uma
+// referência a mais, e 'chunk' continua com quem chamou; senão, 'chunk' passa
+// a estar guardado e é devolvido.
+FileChunk* fs_content_intern(FsContentStore* store, uint64_t hash, FileChunk* chunk, size_t len);
+
+void fs_content_stats(const FsContentStore* store, FsContentStats* stats);
+
+#endif // FS_CONTENT_H
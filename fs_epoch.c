@@ -0,0 +1,188 @@
+#include "fs_epoch.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ============================================================================= */
+/* --- SLOTS DOS LEITORES --- */
+/* ============================================================================= */
+
+// Época anunciada por uma thread (0: fora de qualquer seção de leitura). Um
+// slot por linha de cache: entrar e sair só escreve na linha da própria thread.
+typedef struct EpochSlot {
+    uint64_t epoch;
+    bool used;
+} __attribute__((aligned(64))) EpochSlot;
+
+// Objeto esperando a liberação
+typedef struct Retired {
+    FsEpochFree fn;
+    void *ctx;
+    void *ptr;
+} Retired;
+
+// Objetos aposentados numa mesma época
+typedef struct RetiredList {
+    Retired *items;
+    size_t count;
+    size_t capacity;
+} RetiredList;
+
+static uint64_t global_epoch = 1;
+static EpochSlot slots[FS_EPOCH_MAX_THREADS];
+static int slots_high; // slots já usados alguma vez (os demais não precisam ser olhados)
+
+// Uma lista por época, das três que podem ter objetos ao mesmo tempo (e, e-1
+// e e-2): a da época e vai para a posição e % 3
+static pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
+static RetiredList retired[3];
+static size_t retired_since_scan;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+
+static __thread EpochSlot *my_slot;
+static __thread int my_depth;
+
+// A thread terminou: o slot volta a ficar livre
+static void slot_release(void *arg)
+{
+    EpochSlot *slot = (EpochSlot *)arg;
+    __atomic_store_n(&slot->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->used, false, __ATOMIC_RELEASE);
+}
+
+static void key_create(void)
+{
+    pthread_key_create(&slot_key, slot_release);
+}
+
+static EpochSlot *slot_claim(void)
+{
+    pthread_once(&key_once, key_create);
+    for (;;)
+    {
+        for (int i = 0; i < FS_EPOCH_MAX_THREADS; i++)
+        {
+            bool expected = false;
+            if (!__atomic_load_n(&slots[i].used, __ATOMIC_RELAXED) &&
+                __atomic_compare_exchange_n(&slots[i].used, &expected, true, false,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            {
+                int high = __atomic_load_n(&slots_high, __ATOMIC_RELAXED);
+                while (high < i + 1 &&
+                       !__atomic_compare_exchange_n(&slots_high, &high, i + 1, false,
+                                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                    ;
+                pthread_setspecific(slot_key, &slots[i]);
+                return &slots[i];
+            }
+        }
+        // Todos ocupados: espera alguma thread terminar
+        sched_yield();
+    }
+}
+
+/* ============================================================================= */
+/* --- SEÇÕES DE LEITURA --- */
+/* ============================================================================= */
+
+void fs_epoch_enter(void)
+{
+    if (my_depth++ > 0)
+        return;
+    if (!my_slot)
+        my_slot = slot_claim();
+    // O anúncio precisa ficar visível antes de qualquer leitura da estrutura
+    uint64_t epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&my_slot->epoch, epoch, __ATOMIC_SEQ_CST);
+}
+
+void fs_epoch_exit(void)
+{
+    if (--my_depth > 0)
+        return;
+    __atomic_store_n(&my_slot->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* ============================================================================= */
+/* --- APOSENTADORIA --- */
+/* ============================================================================= */
+
+// Avança a época global se todos os leitores ativos já anunciaram a atual.
+// Com retired_lock, para que nada seja aposentado no meio da troca.
+static bool epoch_try_advance(uint64_t *epoch)
+{
+    *epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    int high = __atomic_load_n(&slots_high, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < high; i++)
+    {
+        uint64_t seen = __atomic_load_n(&slots[i].epoch, __ATOMIC_SEQ_CST);
+        if (seen != 0 && seen != *epoch)
+            return false;
+    }
+    __atomic_store_n(&global_epoch, *epoch + 1, __ATOMIC_SEQ_CST);
+    (*epoch)++;
+    return true;
+}
+
+static void retired_free(RetiredList *list)
+{
+    for (size_t i = 0; i < list->count; i++)
+        list->items[i].fn(list->items[i].ctx, list->items[i].ptr);
+    free(list->items);
+}
+
+void fs_epoch_retire(FsEpochFree fn, void *ctx, void *ptr)
+{
+    RetiredList ready = {NULL, 0, 0};
+
+    pthread_mutex_lock(&retired_lock);
+    RetiredList *list = &retired[__atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST) % 3];
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->items = (Retired *)realloc(list->items, list->capacity * sizeof(Retired));
+    }
+    list->items[list->count].fn = fn;
+    list->items[list->count].ctx = ctx;
+    list->items[list->count].ptr = ptr;
+    list->count++;
+
+    uint64_t epoch;
+    if (++retired_since_scan >= FS_EPOCH_BATCH && epoch_try_advance(&epoch))
+    {
+        // Com a global em 'epoch', os objetos de epoch-2 já podem ser liberados;
+        // a lista deles é a que vai receber os da próxima época
+        retired_since_scan = 0;
+        ready = retired[(epoch + 1) % 3];
+        memset(&retired[(epoch + 1) % 3], 0, sizeof(RetiredList));
+    }
+    pthread_mutex_unlock(&retired_lock);
+
+    // As liberações usam outras travas (a do alocador): ficam fora desta
+    retired_free(&ready);
+}
+
+void fs_epoch_drain(void)
+{
+    RetiredList lists[3];
+    pthread_mutex_lock(&retired_lock);
+    memcpy(lists, retired, sizeof(lists));
+    memset(retired, 0, sizeof(retired));
+    retired_since_scan = 0;
+    pthread_mutex_unlock(&retired_lock);
+
+    for (int i = 0; i < 3; i++)
+        retired_free(&lists[i]);
+}
+
+size_t fs_epoch_pending(void)
+{
+    pthread_mutex_lock(&retired_lock);
+    size_t count = retired[0].count + retired[1].count + retired[2].count;
+    pthread_mutex_unlock(&retired_lock);
+    return count;
+}
@@ -0,0 +1,48 @@
+#ifndef FS_EPOCH_H
+#define FS_EPOCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Recuperação de memória por épocas (estilo RCU) para os leitores sem trava
+// do modo servidor
+//
+// Quem lê estruturas que outra thread pode estar trocando (a raiz e os nós
+// das Árvores B, os TreeNodes) fica dentro de uma seção de leitura, entre
+// fs_epoch_enter e fs_epoch_exit. Quem tira um objeto do alcance dos leitores
+// não o libera na hora: entrega-o a fs_epoch_retire, que só chama a função de
+// liberação depois que todos os leitores que poderiam tê-lo visto saíram.
+//
+// Há uma época global. Ao entrar, o leitor anuncia a época que viu no seu
+// slot; a época só avança quando todos os leitores ativos já a anunciaram.
+// Um objeto aposentado com a global em e pode estar com leitores que anunciaram
+// e ou e-1, mas não com os que entraram depois de ela chegar a e+1 (ele já
+// estava fora da estrutura). A global só chega a e+2 quando nenhum leitor
+// ativo anunciou menos que e+1: aí ele pode ser liberado.
+//
+// O domínio é um só para o processo. Cada thread pega um slot na primeira
+// seção de leitura e o devolve ao terminar. As seções podem ser aninhadas.
+
+// Threads com seções de leitura ao mesmo tempo (as demais esperam um slot)
+#define FS_EPOCH_MAX_THREADS 256
+
+// A cada tantos objetos aposentados, tenta avançar a época e liberar os antigos
+#define FS_EPOCH_BATCH 64
+
+typedef void (*FsEpochFree)(void *ctx, void *ptr);
+
+void fs_epoch_enter(void);
+void fs_epoch_exit(void);
+
+// Libera 'ptr' com fn(ctx, ptr) quando nenhum leitor puder mais alcançá-lo.
+// Quem chama já o tirou da estrutura (a troca publicada antes desta chamada).
+void fs_epoch_retire(FsEpochFree fn, void *ctx, void *ptr);
+
+// Libera tudo o que estiver aposentado. Só pode ser chamada sem nenhum leitor
+// ativo (fim do servidor, destruição do sistema de arquivos).
+void fs_epoch_drain(void);
+
+// Objetos aposentados ainda não liberados
+size_t fs_epoch_pending(void);
+
+#endif // FS_EPOCH_H
@@ -0,0 +1,720 @@
+#include "fs_image.h"
+#include "fs_lz.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ============================================================================= */
+/* --- GRAVAÇÃO --- */
+/* ============================================================================= */
+
+// Buffer em memória que cresce conforme a imagem é montada
+typedef struct ImageBuffer {
+    char *data;
+    size_t size;
+    size_t capacity;
+} ImageBuffer;
+
+// Inode -> offset do conteúdo já gravado, para os arquivos com mais de um
+// nome (endereçamento aberto; o inode 0 marca posição vazia)
+typedef struct ImageLinkMap {
+    uint64_t *inos;
+    uint64_t *offsets;
+    size_t capacity;
+    size_t count;
+} ImageLinkMap;
+
+// Estado da gravação: as seções da imagem e a fila de diretórios (em largura)
+typedef struct ImageWriter {
+    ImageBuffer dirs;
+    ImageBuffer entries;
+    ImageBuffer names;
+    ImageBuffer data;
+    Directory **queue;
+    size_t queue_size;
+    size_t queue_capacity;
+    ImageLinkMap links;
+} ImageWriter;
+
+static void buffer_append(ImageBuffer *buf, const void *src, size_t len)
+{
+    if (buf->size + len > buf->capacity)
+    {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (capacity < buf->size + len)
+            capacity *= 2;
+        buf->data = (char *)realloc(buf->data, capacity);
+        buf->capacity = capacity;
+    }
+    if (src)
+        memcpy(buf->data + buf->size, src, len);
+    buf->size += len;
+}
+
+static uint64_t writer_enqueue_dir(ImageWriter *w, Directory *dir)
+{
+    if (w->queue_size == w->queue_capacity)
+    {
+        w->queue_capacity = w->queue_capacity ? w->queue_capacity * 2 : 64;
+        w->queue = (Directory **)realloc(w->queue, w->queue_capacity * sizeof(Directory *));
+    }
+    w->queue[w->queue_size] = dir;
+    return w->queue_size++;
+}
+
+// Posição de 'ino' no mapa, ou a posição livre onde ele entraria
+static size_t link_map_find(const ImageLinkMap *map, uint64_t ino)
+{
+    size_t mask = map->capacity - 1;
+    size_t i = (size_t)(ino * 0x9E3779B97F4A7C15ULL) & mask;
+    while (map->inos[i] && map->inos[i] != ino)
+        i = (i + 1) & mask;
+    return i;
+}
+
+// O offset do conteúdo do arquivo 'ino', já gravado por outro nome dele; se
+// ainda não foi, 'offset' passa a ser o dele e a função devolve false
+static bool link_map_get_or_put(ImageLinkMap *map, uint64_t ino, uint64_t *offset)
+{
+    if ((map->count + 1) * 2 > map->capacity)
+    {
+        ImageLinkMap bigger = {NULL, NULL, map->capacity ? map->capacity * 2 : 64, 0};
+        bigger.inos = (uint64_t *)calloc(bigger.capacity, sizeof(uint64_t));
+        bigger.offsets = (uint64_t *)calloc(bigger.capacity, sizeof(uint64_t));
+        for (size_t i = 0; i < map->capacity; i++)
+            if (map->inos[i])
+            {
+                size_t j = link_map_find(&bigger, map->inos[i]);
+                bigger.inos[j] = map->inos[i];
+                bigger.offsets[j] = map->offsets[i];
+                bigger.count++;
+            }
+        free(map->inos);
+        free(map->offsets);
+        *map = bigger;
+    }
+    size_t i = link_map_find(map, ino);
+    if (map->inos[i])
+    {
+        *offset = map->offsets[i];
+        return true;
+    }
+    map->inos[i] = ino;
+    map->offsets[i] = *offset;
+    map->count++;
+    return false;
+}
+
+// Percorre a Árvore B em ordem, gravando uma entrada por chave. Os nomes de
+// um arquivo com vários apontam todos para o mesmo conteúdo, gravado uma vez.
+static void writer_add_entries(ImageWriter *w, BTreeNode *node)
+{
+    if (!node)
+        return;
+    for (int i = 0; i <= node->num_keys; i++)
+    {
+        if (!node->leaf)
+            writer_add_entries(w, node->children[i]);
+        if (i == node->num_keys)
+            break;
+
+        TreeNode *item = node->keys[i];
+        ImageEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.name_offset = w->names.size;
+        entry.name_len = (uint32_t)strlen(tree_node_name(item));
+        entry.type = (uint32_t)item->type;
+        entry.creation_time = (int64_t)item->creation_time;
+        entry.modification_time = (int64_t)item->modification_time;
+        entry.last_access_time = (int64_t)item->last_access_time;
+        entry.ino = tree_node_ino(item);
+        buffer_append(&w->names, tree_node_name(item), entry.name_len + 1);
+
+        if (item->type == FILE_TYPE)
+        {
+            entry.data_offset = w->data.size;
+            entry.data_size = file_size(item->data.file);
+            if (item->data.file->nlink > 1 && link_map_get_or_put(&w->links, entry.ino, &entry.data_offset))
+            {
+                buffer_append(&w->entries, &entry, sizeof(entry));
+                continue;
+            }
+            // O conteúdo é copiado direto dos blocos, com o '\0' no fim
+            buffer_append(&w->data, NULL, entry.data_size + 1);
+            char *dst = w->data.data + w->data.size - entry.data_size - 1;
+            file_read(item->data.file, 0, entry.data_size, dst);
+            dst[entry.data_size] = '\0';
+        }
+        else
+        {
+            entry.data_offset = writer_enqueue_dir(w, item->data.directory);
+        }
+        buffer_append(&w->entries, &entry, sizeof(entry));
+    }
+}
+
+// Comprime a seção 'raw' em quadros (versão 4), em 'out'. Um quadro que não
+// diminui é gravado sem compressão.
+static void buffer_compress(const ImageBuffer *raw, ImageBuffer *out)
+{
+    for (size_t pos = 0; pos < raw->size; pos += FS_IMAGE_FRAME_SIZE)
+    {
+        size_t len = raw->size - pos;
+        if (len > FS_IMAGE_FRAME_SIZE)
+            len = FS_IMAGE_FRAME_SIZE;
+        uint32_t frame[2] = {(uint32_t)len, 0};
+        size_t at = out->size;
+        buffer_append(out, frame, sizeof(frame));
+        buffer_append(out, NULL, FS_LZ_BOUND(len));
+        char *dst = out->data + at + sizeof(frame);
+        size_t stored = fs_lz_compress(raw->data + pos, len, dst, len - 1);
+        if (stored == 0)
+        {
+            memcpy(dst, raw->data + pos, len);
+            frame[1] = (uint32_t)len | FS_IMAGE_FRAME_RAW;
+            stored = len;
+        }
+        else
+        {
+            frame[1] = (uint32_t)stored;
+        }
+        memcpy(out->data + at, frame, sizeof(frame));
+        out->size = at + sizeof(frame) + stored;
+    }
+}
+
+static bool write_all(FILE *fp, const void *src, size_t len)
+{
+    return len == 0 || fwrite(src, 1, len, fp) == len;
+}
+
+int fs_image_save(Directory *root, const char *filename, bool compress)
+{
+    ImageWriter w;
+    memset(&w, 0, sizeof(w));
+
+    // Diretórios em largura: as entradas de cada um ficam contíguas na imagem
+    writer_enqueue_dir(&w, root);
+    for (size_t d = 0; d < w.queue_size; d++)
+    {
+        ImageDir rec;
+        rec.first_entry = w.entries.size / sizeof(ImageEntry);
+        writer_add_entries(&w, w.queue[d]->tree->root);
+        rec.entry_count = w.entries.size / sizeof(ImageEntry) - rec.first_entry;
+        buffer_append(&w.dirs, &rec, sizeof(rec));
+    }
+
+    // O que vai para o arquivo: as próprias seções ou os quadros comprimidos
+    ImageBuffer *raw[4] = {&w.dirs, &w.entries, &w.names, &w.data};
+    ImageBuffer packed[4];
+    ImageBuffer *sections[4];
+    memset(packed, 0, sizeof(packed));
+    for (int i = 0; i < 4; i++)
+    {
+        sections[i] = raw[i];
+        if (compress)
+        {
+            buffer_compress(raw[i], &packed[i]);
+            sections[i] = &packed[i];
+        }
+    }
+
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FS_IMAGE_MAGIC, sizeof(FS_IMAGE_MAGIC));
+    header.version = compress ? FS_IMAGE_VERSION_LZ : FS_IMAGE_VERSION;
+    header.byte_order = FS_IMAGE_BYTE_ORDER;
+    header.dir_count = w.queue_size;
+    header.entry_count = w.entries.size / sizeof(ImageEntry);
+    header.dirs_offset = sizeof(ImageHeader);
+    header.entries_offset = header.dirs_offset + sections[0]->size;
+    header.names_offset = header.entries_offset + sections[1]->size;
+    header.names_size = w.names.size;
+    header.data_offset = header.names_offset + sections[2]->size;
+    header.data_size = w.data.size;
+    header.next_ino = __atomic_load_n(&root->fs->next_ino, __ATOMIC_RELAXED);
+
+    // Grava num arquivo temporário e troca no final, para não deixar uma
+    // imagem pela metade no lugar da anterior
+    size_t tmp_len = strlen(filename) + 5;
+    char *tmp_name = (char *)malloc(tmp_len);
+    snprintf(tmp_name, tmp_len, "%s.tmp", filename);
+
+    int result = -1;
+    FILE *fp = fopen(tmp_name, "wb");
+    if (!fp)
+    {
+        perror("Erro ao abrir imagem para escrita");
+    }
+    else
+    {
+        bool ok = write_all(fp, &header, sizeof(header)) &&
+                  write_all(fp, sections[0]->data, sections[0]->size) &&
+                  write_all(fp, sections[1]->data, sections[1]->size) &&
+                  write_all(fp, sections[2]->data, sections[2]->size) &&
+                  write_all(fp, sections[3]->data, sections[3]->size) &&
+                  fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+        if (fclose(fp) != 0)
+            ok = false;
+        if (ok && rename(tmp_name, filename) == 0)
+        {
+            result = 0;
+        }
+        else
+        {
+            perror("Erro ao gravar imagem");
+            remove(tmp_name);
+        }
+    }
+
+    free(tmp_name);
+    free(w.dirs.data);
+    free(w.entries.data);
+    free(w.names.data);
+    free(w.data.data);
+    for (int i = 0; i < 4; i++)
+        free(packed[i].data);
+    free(w.queue);
+    free(w.links.inos);
+    free(w.links.offsets);
+    return result;
+}
+
+/* ============================================================================= */
+/* --- CARGA --- */
+/* ============================================================================= */
+
+// Seções da imagem já descomprimidas (nas versões sem compressão, direto no
+// arquivo mapeado)
+typedef struct ImageSections {
+    const ImageDir *dirs;
+    const ImageEntry *entries;
+    const char *names;
+    const char *data;
+    char *buffers[4]; // buffers das seções descomprimidas ou convertidas
+} ImageSections;
+
+// Entrada das versões 1 e 2, sem o número do inode
+typedef struct ImageEntryNoIno {
+    uint64_t name_offset;
+    uint64_t data_offset;
+    uint64_t data_size;
+    int64_t creation_time;
+    int64_t modification_time;
+    int64_t last_access_time;
+    uint32_t name_len;
+    uint32_t type;
+} ImageEntryNoIno;
+
+static bool image_compressed(const ImageHeader *h)
+{
+    return h->version == FS_IMAGE_VERSION_LZ || h->version == FS_IMAGE_VERSION_NO_INO_LZ;
+}
+
+static bool image_has_inos(const ImageHeader *h)
+{
+    return h->version == FS_IMAGE_VERSION || h->version == FS_IMAGE_VERSION_LZ;
+}
+
+static size_t image_header_size(const ImageHeader *h)
+{
+    return image_has_inos(h) ? sizeof(ImageHeader) : offsetof(ImageHeader, next_ino);
+}
+
+static size_t image_entry_size(const ImageHeader *h)
+{
+    return image_has_inos(h) ? sizeof(ImageEntry) : sizeof(ImageEntryNoIno);
+}
+
+// Confere se [offset, offset + size) cabe num arquivo de 'file_size' bytes
+static bool image_range_ok(uint64_t offset, uint64_t size, uint64_t file_size)
+{
+    return offset <= file_size && size <= file_size - offset;
+}
+
+static bool image_header_ok(const ImageHeader *h, uint64_t file_size)
+{
+    if (memcmp(h->magic, FS_IMAGE_MAGIC, sizeof(FS_IMAGE_MAGIC)) != 0)
+    {
+        printf("load: não é uma imagem do sistema de arquivos\n");
+        return false;
+    }
+    if ((h->version < FS_IMAGE_VERSION_NO_INO || h->version > FS_IMAGE_VERSION_LZ) ||
+        h->byte_order != FS_IMAGE_BYTE_ORDER)
+    {
+        printf("load: versão de imagem não suportada (%u)\n", h->version);
+        return false;
+    }
+    size_t entry_size = image_entry_size(h);
+    if (image_compressed(h))
+    {
+        // Seções comprimidas, uma depois da outra; os tamanhos descomprimidos
+        // são conferidos nos quadros
+        if (h->dir_count == 0 ||
+            h->dir_count > SIZE_MAX / sizeof(ImageDir) ||
+            h->entry_count > SIZE_MAX / entry_size ||
+            h->dirs_offset != image_header_size(h) ||
+            h->entries_offset < h->dirs_offset ||
+            h->names_offset < h->entries_offset ||
+            h->data_offset < h->names_offset ||
+            h->data_offset > file_size)
+        {
+            printf("load: imagem corrompida (seções fora do arquivo)\n");
+            return false;
+        }
+        return true;
+    }
+    if (h->dir_count == 0 ||
+        h->dir_count > file_size / sizeof(ImageDir) ||
+        h->entry_count > file_size / entry_size ||
+        !image_range_ok(h->dirs_offset, h->dir_count * sizeof(ImageDir), file_size) ||
+        !image_range_ok(h->entries_offset, h->entry_count * entry_size, file_size) ||
+        !image_range_ok(h->names_offset, h->names_size, file_size) ||
+        !image_range_ok(h->data_offset, h->data_size, file_size))
+    {
+        printf("load: imagem corrompida (seções fora do arquivo)\n");
+        return false;
+    }
+    // Os registros são lidos direto do mapeamento (as seções comprimidas vão
+    // para buffers próprios, já alinhados)
+    if (h->dirs_offset % _Alignof(ImageDir) != 0 || h->entries_offset % _Alignof(ImageEntry) != 0)
+    {
+        printf("load: imagem corrompida (seções desalinhadas)\n");
+        return false;
+    }
+    return true;
+}
+
+// Descomprime a seção [src, src + len) das versões 2 e 4, que precisa dar exatamente
+// 'raw_size' bytes. Devolve NULL se ela estiver corrompida.
+static char *image_decompress(const char *src, uint64_t len, uint64_t raw_size)
+{
+    // Cada quadro tem pelo menos o cabeçalho e no máximo FS_IMAGE_FRAME_SIZE
+    // bytes descomprimidos: isso limita o que uma imagem corrompida pode pedir
+    uint64_t frame_header = 2 * sizeof(uint32_t);
+    if (raw_size > len / frame_header * FS_IMAGE_FRAME_SIZE)
+        return NULL;
+    char *out = (char *)malloc(raw_size ? raw_size : 1);
+    uint64_t pos = 0;
+    uint64_t done = 0;
+    while (pos < len)
+    {
+        uint32_t frame[2];
+        if (len - pos < frame_header)
+            break;
+        memcpy(frame, src + pos, sizeof(frame));
+        pos += frame_header;
+        uint32_t stored = frame[1] & ~FS_IMAGE_FRAME_RAW;
+        if (frame[0] > FS_IMAGE_FRAME_SIZE || frame[0] > raw_size - done || stored > len - pos)
+            break;
+        if (frame[1] & FS_IMAGE_FRAME_RAW)
+        {
+            if (stored != frame[0])
+                break;
+            memcpy(out + done, src + pos, stored);
+        }
+        else if (fs_lz_decompress(src + pos, stored, out + done, frame[0]) != frame[0])
+        {
+            break;
+        }
+        pos += stored;
+        done += frame[0];
+    }
+    if (pos != len || done != raw_size)
+    {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+// As entradas das versões 1 e 2 no formato atual, com o número 0 (a carga dá
+// um novo)
+static char *image_convert_entries(const char *src, uint64_t count)
+{
+    ImageEntry *out = (ImageEntry *)malloc((count ? count : 1) * sizeof(ImageEntry));
+    for (uint64_t i = 0; i < count; i++)
+    {
+        ImageEntryNoIno old;
+        memcpy(&old, src + i * sizeof(old), sizeof(old));
+        out[i].name_offset = old.name_offset;
+        out[i].data_offset = old.data_offset;
+        out[i].data_size = old.data_size;
+        out[i].creation_time = old.creation_time;
+        out[i].modification_time = old.modification_time;
+        out[i].last_access_time = old.last_access_time;
+        out[i].ino = 0;
+        out[i].name_len = old.name_len;
+        out[i].type = old.type;
+    }
+    return (char *)out;
+}
+
+// Aponta as seções para o arquivo mapeado (versões 1 e 3) ou para os buffers
+// descomprimidos (versões 2 e 4)
+static bool image_sections_open(const char *base, size_t file_size, const ImageHeader *h, ImageSections *s)
+{
+    if (!image_compressed(h))
+    {
+        s->dirs = (const ImageDir *)(base + h->dirs_offset);
+        s->entries = (const ImageEntry *)(base + h->entries_offset);
+        s->names = base + h->names_offset;
+        s->data = base + h->data_offset;
+    }
+    else
+    {
+        uint64_t offsets[5] = {h->dirs_offset, h->entries_offset, h->names_offset, h->data_offset, file_size};
+        uint64_t sizes[4] = {h->dir_count * sizeof(ImageDir), h->entry_count * image_entry_size(h),
+                             h->names_size, h->data_size};
+        for (int i = 0; i < 4; i++)
+        {
+            s->buffers[i] = image_decompress(base + offsets[i], offsets[i + 1] - offsets[i], sizes[i]);
+            if (!s->buffers[i])
+            {
+                printf("load: imagem corrompida (seção comprimida inválida)\n");
+                return false;
+            }
+        }
+        s->dirs = (const ImageDir *)s->buffers[0];
+        s->entries = (const ImageEntry *)s->buffers[1];
+        s->names = s->buffers[2];
+        s->data = s->buffers[3];
+    }
+    if (!image_has_inos(h))
+    {
+        char *entries = image_convert_entries((const char *)s->entries, h->entry_count);
+        free(s->buffers[1]);
+        s->buffers[1] = entries;
+        s->entries = (const ImageEntry *)entries;
+    }
+    return true;
+}
+
+static void image_sections_close(ImageSections *s)
+{
+    for (int i = 0; i < 4; i++)
+        free(s->buffers[i]);
+}
+
+// Arquivos já carregados, em ordem de offset do conteúdo: o conteúdo de um
+// arquivo novo sempre vem depois dos anteriores, e um offset que volta é o de
+// outro nome de um arquivo já carregado (ln)
+typedef struct ImageLoadedFile {
+    uint64_t offset;
+    TreeNode *node;
+    Directory *dir;
+} ImageLoadedFile;
+
+typedef struct ImageLinks {
+    ImageLoadedFile *files; // NULL se a imagem não tem arquivos com vários nomes
+    size_t count;
+    uint64_t data_end;      // fim do último conteúdo carregado
+} ImageLinks;
+
+// Só as imagens com algum offset que volta precisam guardar os arquivos
+static bool image_has_links(const ImageSections *s, const ImageHeader *h)
+{
+    uint64_t data_end = 0;
+    for (uint64_t i = 0; i < h->entry_count; i++)
+    {
+        const ImageEntry *e = &s->entries[i];
+        if (e->type != FILE_TYPE)
+            continue;
+        if (e->data_offset < data_end)
+            return true;
+        data_end = e->data_offset + e->data_size + 1;
+    }
+    return false;
+}
+
+static const ImageLoadedFile *image_find_file(const ImageLinks *links, uint64_t offset)
+{
+    size_t lo = 0, hi = links->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (links->files[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo < links->count && links->files[lo].offset == offset) ? &links->files[lo] : NULL;
+}
+
+// Devolve ao item criado o número 'ino' da imagem. O número que ele recebeu ao
+// ser criado, o último dado, volta a ficar livre: no fim, o próximo número é o
+// gravado.
+static void image_set_ino(FileSystem *fs, TreeNode *node, uint64_t ino)
+{
+    uint64_t fresh = tree_node_ino(node);
+    tree_node_set_ino(fs, node, ino);
+    if (tree_node_ino(node) != fresh && fs->next_ino == fresh + 1)
+        fs->next_ino = fresh;
+}
+
+// Cria as entradas de um diretório e monta a sua Árvore B de uma vez
+static bool image_load_dir(const ImageSections *s, const ImageHeader *h, uint64_t d,
+                           Directory **dirs, TreeNode **items, ImageLinks *links)
+{
+    const ImageDir *rec = s->dirs + d;
+    const ImageEntry *entries = s->entries;
+    const char *names = s->names;
+    const char *data = s->data;
+    Directory *dir = dirs[d];
+
+    if (rec->first_entry > h->entry_count || rec->entry_count > h->entry_count - rec->first_entry)
+        return false;
+
+    size_t count = 0;
+    bool ok = true;
+    for (uint64_t i = 0; i < rec->entry_count && ok; i++)
+    {
+        const ImageEntry *e = &entries[rec->first_entry + i];
+        ok = image_range_ok(e->name_offset, (uint64_t)e->name_len + 1, h->names_size) &&
+             names[e->name_offset + e->name_len] == '\0' && e->name_len > 0;
+        if (!ok)
+            break;
+        const char *name = names + e->name_offset;
+        if (count > 0 && strcmp(tree_node_name(items[count - 1]), name) >= 0)
+        {
+            ok = false; // as entradas precisam estar em ordem e sem repetição
+            break;
+        }
+
+        TreeNode *node;
+        if (e->type == FILE_TYPE)
+        {
+            ok = image_range_ok(e->data_offset, e->data_size + 1, h->data_size) &&
+                 data[e->data_offset + e->data_size] == '\0';
+            if (!ok)
+                break;
+            if (e->data_offset < links->data_end)
+            {
+                const ImageLoadedFile *first = links->files ? image_find_file(links, e->data_offset) : NULL;
+                ok = first && file_size(first->node->data.file) == e->data_size;
+                if (!ok)
+                    break;
+                node = link_txt_file(first->node, first->dir, name, dir);
+            }
+            else if (e->ino && (node = directory_reshare_file(dir, name, e->ino, e->data_size)) != NULL)
+            {
+                links->data_end = e->data_offset + e->data_size + 1;
+            }
+            else
+            {
+                node = create_txt_file(name, data + e->data_offset, dir);
+                image_set_ino(dir->fs, node, e->ino);
+                links->data_end = e->data_offset + e->data_size + 1;
+                if (links->files)
+                {
+                    ImageLoadedFile *f = &links->files[links->count++];
+                    f->offset = e->data_offset;
+                    f->node = node;
+                    f->dir = dir;
+                }
+            }
+        }
+        else if (e->type == DIRECTORY_TYPE)
+        {
+            // Diretórios são gravados em largura: o filho vem sempre depois do pai
+            ok = e->data_offset > d && e->data_offset < h->dir_count && dirs[e->data_offset] == NULL;
+            if (!ok)
+                break;
+            node = create_directory(name, dir);
+            image_set_ino(dir->fs, node, e->ino);
+            dirs[e->data_offset] = node->data.directory;
+        }
+        else
+        {
+            ok = false;
+            break;
+        }
+        node->creation_time = (time_t)e->creation_time;
+        node->modification_time = (time_t)e->modification_time;
+        node->last_access_time = (time_t)e->last_access_time;
+        items[count++] = node;
+    }
+
+    if (!ok)
+    {
+        for (size_t i = 0; i < count; i++)
+            free_tree_node(&dir->fs->alloc, items[i]);
+        return false;
+    }
+    btree_bulk_load(dir->tree, items, count);
+    return true;
+}
+
+FileSystem *fs_image_load(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Erro ao abrir imagem para leitura");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ImageHeader))
+    {
+        printf("load: imagem vazia ou ilegível\n");
+        close(fd);
+        return NULL;
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    char *base = (char *)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        perror("Erro ao mapear imagem");
+        return NULL;
+    }
+    madvise(base, file_size, MADV_SEQUENTIAL);
+    madvise(base, file_size, MADV_WILLNEED);
+
+    const ImageHeader *h = (const ImageHeader *)base;
+    ImageSections sections;
+    memset(&sections, 0, sizeof(sections));
+    if (!image_header_ok(h, file_size) || !image_sections_open(base, file_size, h, &sections))
+    {
+        image_sections_close(&sections);
+        munmap(base, file_size);
+        return NULL;
+    }
+
+    FileSystem *fs = fs_create();
+    Directory **dirs = (Directory **)calloc(h->dir_count, sizeof(Directory *));
+    TreeNode **items = (TreeNode **)malloc((h->entry_count ? h->entry_count : 1) * sizeof(TreeNode *));
+    dirs[0] = fs->root;
+    // Os números novos (das versões sem eles, ou de um número repetido) ficam
+    // depois de todos os da imagem
+    if (image_has_inos(h) && h->next_ino > fs->next_ino)
+        fs->next_ino = h->next_ino;
+    ImageLinks links = {NULL, 0, 0};
+    if (image_has_links(&sections, h))
+        links.files = (ImageLoadedFile *)malloc(h->entry_count * sizeof(ImageLoadedFile));
+
+    bool ok = true;
+    for (uint64_t d = 0; d < h->dir_count && ok; d++)
+    {
+        ok = dirs[d] != NULL && image_load_dir(&sections, h, d, dirs, items, &links);
+    }
+    // Os totais saem dos filhos: do último diretório (os mais fundos) para a raiz
+    for (uint64_t d = h->dir_count; d-- > 0 && ok;)
+        directory_recount(dirs[d]);
+    if (!ok)
+    {
+        printf("load: imagem corrompida\n");
+        fs_destroy(fs);
+        fs = NULL;
+    }
+
+    free(links.files);
+    free(items);
+    free(dirs);
+    image_sections_close(&sections);
+    munmap(base, file_size);
+    return fs;
+}
@@ -0,0 +1,95 @@
+#ifndef FS_IMAGE_H
+#define FS_IMAGE_H
+
+#include "filesystem.h"
+
+// Imagem binária do sistema de arquivos (versões 1 a 4)
+//
+// Layout (inteiros na ordem de bytes da máquina, conferida por 'byte_order'):
+//
+//   ImageHeader                 cabeçalho fixo com os offsets das seções
+//   ImageDir[dir_count]         um registro por diretório; o 0 é a raiz
+//   ImageEntry[entry_count]     entradas; as de um mesmo diretório ficam
+//                               juntas e em ordem crescente de nome
+//   nomes                       nomes terminados em '\0'
+//   dados                       conteúdos dos arquivos terminados em '\0'
+//
+// Como as entradas de cada diretório já estão ordenadas, a carga monta a
+// Árvore B de cada diretório direto dos itens (btree_bulk_load), sem inserir
+// um por um.
+//
+// Os nomes de um arquivo com mais de um (ln) apontam para o mesmo conteúdo,
+// gravado uma vez: na carga, uma entrada cujo offset de dados volta para um
+// conteúdo já carregado é mais um nome daquele arquivo.
+//
+// Cada entrada guarda o número do inode (o id, num diretório), e o cabeçalho o
+// próximo número a dar: a carga devolve a cada item o número que ele tinha.
+// Uma entrada dividida entre um diretório e uma cópia dele (snapshot, cp -r)
+// vai inteira nos dois, com o mesmo número, e volta a ser uma só na carga
+// (directory_reshare_file). As versões 1 e 2, anteriores aos números, ainda
+// são carregadas (com números novos): o cabeçalho vai só até 'data_size' e as
+// entradas não têm 'ino'.
+//
+// A versão 4 (save -z; a 2, antes dos números) tem o mesmo cabeçalho da 3 (da
+// 1), mas cada seção é gravada comprimida (fs_lz.h), em quadros de até
+// FS_IMAGE_FRAME_SIZE bytes da seção:
+//
+//   uint32_t raw_size           bytes do quadro descomprimido
+//   uint32_t stored_size        bytes gravados em seguida (com o bit
+//                               FS_IMAGE_FRAME_RAW: sem compressão)
+//
+// Os offsets do cabeçalho apontam para as seções comprimidas, que vão até o
+// offset da seguinte (a de dados, até o fim do arquivo); os tamanhos continuam
+// sendo os das seções descomprimidas. A carga descomprime cada seção num
+// buffer antes de montar a árvore.
+
+#define FS_IMAGE_MAGIC "BTFSIMG"
+#define FS_IMAGE_VERSION 3
+#define FS_IMAGE_VERSION_LZ 4
+#define FS_IMAGE_VERSION_NO_INO 1    // antes dos números de inode
+#define FS_IMAGE_VERSION_NO_INO_LZ 2
+#define FS_IMAGE_BYTE_ORDER 0x01020304u
+
+#define FS_IMAGE_FRAME_SIZE (64 * 1024)
+#define FS_IMAGE_FRAME_RAW 0x80000000u
+
+typedef struct ImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t dir_count;
+    uint64_t entry_count;
+    uint64_t dirs_offset;
+    uint64_t entries_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t next_ino;    // a partir da versão 3
+} ImageHeader;
+
+typedef struct ImageDir {
+    uint64_t first_entry; // índice da primeira entrada do diretório
+    uint64_t entry_count; // quantas entradas ele tem
+} ImageDir;
+
+typedef struct ImageEntry {
+    uint64_t name_offset; // na seção de nomes
+    uint64_t data_offset; // arquivo: conteúdo na seção de dados; diretório: índice do ImageDir
+    uint64_t data_size;   // arquivo: tamanho do conteúdo (sem o '\0')
+    int64_t creation_time;
+    int64_t modification_time;
+    int64_t last_access_time;
+    uint64_t ino;         // número do inode (arquivo) ou id (diretório); a partir da versão 3
+    uint32_t name_len;
+    uint32_t type;        // NodeType
+} ImageEntry;
+
+// Salva a árvore a partir de 'root' na imagem, com as seções comprimidas se
+// 'compress' (versão 4). Devolve 0 ou -1 em caso de erro.
+int fs_image_save(Directory* root, const char* filename, bool compress);
+
+// Carrega uma imagem num sistema de arquivos novo. Devolve NULL em caso de erro.
+FileSystem* fs_image_load(const char* filename);
+
+#endif // FS_IMAGE_H
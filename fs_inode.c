@@ -0,0 +1,186 @@
+#include "fs_inode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SHARD_MIN_CAPACITY 64
+
+// Os números saem em sequência: a multiplicação os espalha pela tabela. A
+// parte sai dos bits altos e a posição inicial, dos baixos.
+static uint64_t inode_hash(uint64_t ino)
+{
+    return ino * 0x9E3779B97F4A7C15ULL;
+}
+
+static FsInodeShard *shard_of(FsInodeTable *table, uint64_t hash)
+{
+    return &table->shards[hash >> 60 & (FS_INODE_SHARDS - 1)];
+}
+
+static void shard_lock(FsInodeTable *table, FsInodeShard *shard)
+{
+    if (table->concurrent)
+        pthread_mutex_lock(&shard->lock);
+}
+
+static void shard_unlock(FsInodeTable *table, FsInodeShard *shard)
+{
+    if (table->concurrent)
+        pthread_mutex_unlock(&shard->lock);
+}
+
+// Posição de 'ino' na parte, ou a posição livre onde ele entraria
+static size_t shard_find(const FsInodeShard *shard, uint64_t ino, uint64_t hash)
+{
+    size_t mask = shard->capacity - 1;
+    size_t i = hash & mask;
+    while (shard->table[i].ino && shard->table[i].ino != ino)
+        i = (i + 1) & mask;
+    return i;
+}
+
+// Dobra a tabela quando passa da metade
+static void shard_grow(FsInodeShard *shard)
+{
+    FsInodeEntry *old = shard->table;
+    size_t old_capacity = shard->capacity;
+    shard->capacity = old_capacity ? old_capacity * 2 : SHARD_MIN_CAPACITY;
+    shard->table = (FsInodeEntry *)calloc(shard->capacity, sizeof(FsInodeEntry));
+    if (!shard->table)
+    {
+        perror("Erro ao reservar memória");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_capacity; i++)
+        if (old[i].ino)
+            shard->table[shard_find(shard, old[i].ino, inode_hash(old[i].ino))] = old[i];
+    free(old);
+}
+
+void fs_inode_init(FsInodeTable *table)
+{
+    memset(table, 0, sizeof(*table));
+    for (int i = 0; i < FS_INODE_SHARDS; i++)
+        pthread_mutex_init(&table->shards[i].lock, NULL);
+}
+
+// Liga as travas das partes. Precisa ser chamada antes de as outras threads
+// começarem a usar a tabela.
+void fs_inode_set_concurrent(FsInodeTable *table)
+{
+    table->concurrent = true;
+}
+
+void fs_inode_destroy(FsInodeTable *table)
+{
+    for (int i = 0; i < FS_INODE_SHARDS; i++)
+    {
+        free(table->shards[i].table);
+        pthread_mutex_destroy(&table->shards[i].lock);
+    }
+    memset(table, 0, sizeof(*table));
+}
+
+void fs_inode_put(FsInodeTable *table, uint64_t ino, struct TreeNode *node, uint64_t parent)
+{
+    uint64_t hash = inode_hash(ino);
+    FsInodeShard *shard = shard_of(table, hash);
+    shard_lock(table, shard);
+    if ((shard->count + 1) * 2 > shard->capacity)
+        shard_grow(shard);
+    size_t i = shard_find(shard, ino, hash);
+    if (!shard->table[i].ino)
+    {
+        shard->table[i].ino = ino;
+        shard->count++;
+    }
+    shard->table[i].node = node;
+    shard->table[i].parent = parent;
+    shard_unlock(table, shard);
+}
+
+// As entradas seguintes do mesmo grupo voltam uma posição quando podem, para
+// que nenhuma busca pare antes da hora (como em fs_content.c). Com 'node', só
+// tira a entrada que ainda aponta para ele.
+static void inode_remove(FsInodeTable *table, uint64_t ino, const struct TreeNode *node)
+{
+    uint64_t hash = inode_hash(ino);
+    FsInodeShard *shard = shard_of(table, hash);
+    shard_lock(table, shard);
+    size_t hole = shard->capacity ? shard_find(shard, ino, hash) : 0;
+    if (shard->capacity == 0 || !shard->table[hole].ino || (node && shard->table[hole].node != node))
+    {
+        shard_unlock(table, shard);
+        return;
+    }
+    size_t mask = shard->capacity - 1;
+    size_t i = hole;
+    for (;;)
+    {
+        i = (i + 1) & mask;
+        if (!shard->table[i].ino)
+            break;
+        size_t home = inode_hash(shard->table[i].ino) & mask;
+        bool between = (hole <= i) ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!between)
+        {
+            shard->table[hole] = shard->table[i];
+            hole = i;
+        }
+    }
+    shard->table[hole].ino = 0;
+    shard->table[hole].node = NULL;
+    shard->table[hole].parent = 0;
+    shard->count--;
+    shard_unlock(table, shard);
+}
+
+void fs_inode_remove(FsInodeTable *table, uint64_t ino)
+{
+    inode_remove(table, ino, NULL);
+}
+
+void fs_inode_remove_node(FsInodeTable *table, uint64_t ino, const struct TreeNode *node)
+{
+    inode_remove(table, ino, node);
+}
+
+bool fs_inode_visit(FsInodeTable *table, uint64_t ino, FsInodeVisitor visit, void *ctx)
+{
+    if (ino == 0)
+        return false;
+    uint64_t hash = inode_hash(ino);
+    FsInodeShard *shard = shard_of(table, hash);
+    shard_lock(table, shard);
+    FsInodeEntry *entry = shard->capacity ? &shard->table[shard_find(shard, ino, hash)] : NULL;
+    struct TreeNode *node = entry ? entry->node : NULL;
+    if (node)
+        visit(node, entry->parent, ctx);
+    shard_unlock(table, shard);
+    return node != NULL;
+}
+
+struct TreeNode *fs_inode_get(FsInodeTable *table, uint64_t ino)
+{
+    if (ino == 0)
+        return NULL;
+    uint64_t hash = inode_hash(ino);
+    FsInodeShard *shard = shard_of(table, hash);
+    if (shard->capacity == 0)
+        return NULL;
+    return shard->table[shard_find(shard, ino, hash)].node;
+}
+
+void fs_inode_stats(FsInodeTable *table, size_t *count, size_t *capacity)
+{
+    *count = 0;
+    *capacity = 0;
+    for (int i = 0; i < FS_INODE_SHARDS; i++)
+    {
+        FsInodeShard *shard = &table->shards[i];
+        shard_lock(table, shard);
+        *count += shard->count;
+        *capacity += shard->capacity;
+        shard_unlock(table, shard);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef FS_INODE_H
+#define FS_INODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Tabela global de inodes: número do inode -> TreeNode
+//
+// Todo arquivo e todo diretório tem um número de inode, único no sistema de
+// arquivos e nunca reaproveitado (o dos diretórios é o próprio id). A tabela
+// acha o item pelo número sem descer em Árvore B nenhuma ('stat -i'). Um
+// arquivo com vários nomes (ln) tem uma entrada só, que aponta para um dos
+// nomes. A raiz não tem TreeNode e não entra na tabela: show_inode_metadata
+// trata o número dela (FS_ROOT_DIR_ID) à parte.
+//
+// Como a do armazenamento por conteúdo (fs_content.h), a tabela é dividida em
+// partes com travas próprias, de endereçamento aberto com sondagem linear, e
+// cada parte dobra quando passa da metade: a busca continua O(1) com dezenas
+// de milhões de entradas. Um item sai da tabela quando é liberado, e não
+// quando é removido do diretório (no modo servidor e no rm -r, um pouco
+// depois): por isso quem lê o item achado o faz com a trava da parte
+// (fs_inode_visit). Um arquivo não sabe em que diretório está, então a
+// entrada guarda o número dele: com ele, o 'stat -i' deixa de fora os
+// arquivos de uma subárvore que o rm -r já tirou da árvore.
+
+#define FS_INODE_SHARDS 16
+
+struct TreeNode;
+
+typedef struct FsInodeEntry {
+    uint64_t ino;           // 0: posição livre
+    struct TreeNode* node;
+    uint64_t parent;        // número do diretório em que 'node' foi posto
+} FsInodeEntry;
+
+typedef struct FsInodeShard {
+    FsInodeEntry* table;
+    size_t capacity; // potência de 2
+    size_t count;
+    pthread_mutex_t lock;
+} __attribute__((aligned(64))) FsInodeShard;
+
+typedef struct FsInodeTable {
+    FsInodeShard shards[FS_INODE_SHARDS];
+    bool concurrent; // travas das partes ligadas
+} FsInodeTable;
+
+typedef void (*FsInodeVisitor)(struct TreeNode* node, uint64_t parent, void* ctx);
+
+void fs_inode_init(FsInodeTable* table);
+void fs_inode_destroy(FsInodeTable* table);
+void fs_inode_set_concurrent(FsInodeTable* table);
+
+// Põe 'ino' -> 'node' (que está no diretório 'parent') na tabela, ou troca o
+// item de um número que já está nela
+void fs_inode_put(FsInodeTable* table, uint64_t ino, struct TreeNode* node, uint64_t parent);
+void fs_inode_remove(FsInodeTable* table, uint64_t ino);
+// Tira 'ino' só se ele ainda aponta para 'node'
+void fs_inode_remove_node(FsInodeTable* table, uint64_t ino, const struct TreeNode* node);
+
+// Chama visit(item, diretório, ctx) com a trava da parte, se o número estiver
+// na tabela
+bool fs_inode_visit(FsInodeTable* table, uint64_t ino, FsInodeVisitor visit, void* ctx);
+
+// O item do número, sem trava: só para quem sabe que ele não vai ser liberado
+// no meio (carga de imagem, recuperação do journal, comandos exclusivos)
+struct TreeNode* fs_inode_get(FsInodeTable* table, uint64_t ino);
+
+// Entradas e posições reservadas, somadas em todas as partes (ver 'stats')
+void fs_inode_stats(FsInodeTable* table, size_t* count, size_t* capacity);
+
+#endif // FS_INODE_H
@@ -0,0 +1,1122 @@
+#include "fs_journal.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ============================================================================= */
+/* --- CODIFICAÇÃO --- */
+/* ============================================================================= */
+
+static void jbuf_append(JournalBuffer *buf, const void *src, size_t len)
+{
+    if (buf->size + len > buf->capacity)
+    {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        while (capacity < buf->size + len)
+            capacity *= 2;
+        buf->data = (char *)realloc(buf->data, capacity);
+        buf->capacity = capacity;
+    }
+    if (src)
+        memcpy(buf->data + buf->size, src, len);
+    buf->size += len;
+}
+
+static void jbuf_put_u32(JournalBuffer *buf, uint32_t v)
+{
+    jbuf_append(buf, &v, sizeof(v));
+}
+
+static void jbuf_put_u64(JournalBuffer *buf, uint64_t v)
+{
+    jbuf_append(buf, &v, sizeof(v));
+}
+
+static void jbuf_put_str(JournalBuffer *buf, const char *s, size_t len)
+{
+    jbuf_put_u64(buf, len);
+    jbuf_append(buf, s, len);
+    jbuf_append(buf, "", 1);
+}
+
+// O conteúdo de um arquivo, no formato de 'str', lido direto dos blocos
+static void jbuf_put_file(JournalBuffer *buf, const File *file)
+{
+    size_t len = file_size(file);
+    jbuf_put_u64(buf, len);
+    jbuf_append(buf, NULL, len + 1);
+    char *dst = buf->data + buf->size - len - 1;
+    file_read(file, 0, len, dst);
+    dst[len] = '\0';
+}
+
+// Leitura sequencial com verificação de limites: qualquer leitura fora do
+// buffer desliga 'ok' e as seguintes devolvem zero
+typedef struct JournalCursor {
+    const char *p;
+    const char *end;
+    bool ok;
+} JournalCursor;
+
+static uint32_t cur_get_u32(JournalCursor *c)
+{
+    uint32_t v = 0;
+    if (!c->ok || (size_t)(c->end - c->p) < sizeof(v))
+    {
+        c->ok = false;
+        return 0;
+    }
+    memcpy(&v, c->p, sizeof(v));
+    c->p += sizeof(v);
+    return v;
+}
+
+static uint64_t cur_get_u64(JournalCursor *c)
+{
+    uint64_t v = 0;
+    if (!c->ok || (size_t)(c->end - c->p) < sizeof(v))
+    {
+        c->ok = false;
+        return 0;
+    }
+    memcpy(&v, c->p, sizeof(v));
+    c->p += sizeof(v);
+    return v;
+}
+
+// Devolve a string (terminada em '\0' dentro do próprio buffer) e o tamanho
+static const char *cur_get_str(JournalCursor *c, uint64_t *len)
+{
+    uint64_t n = cur_get_u64(c);
+    if (!c->ok || n >= (uint64_t)(c->end - c->p) || c->p[n] != '\0')
+    {
+        c->ok = false;
+        return NULL;
+    }
+    const char *s = c->p;
+    c->p += n + 1;
+    if (len)
+        *len = n;
+    return s;
+}
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32(const void *data, size_t len)
+{
+    if (crc_table[1] == 0)
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    }
+    const unsigned char *p = (const unsigned char *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++)
+        crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static bool write_all_fd(int fd, const void *src, size_t len)
+{
+    const char *p = (const char *)src;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Caminho de um arquivo dentro do diretório do journal (alocado com malloc)
+static char *journal_file(const char *dir, const char *name)
+{
+    size_t len = strlen(dir) + strlen(name) + 2;
+    char *path = (char *)malloc(len);
+    snprintf(path, len, "%s/%s", dir, name);
+    return path;
+}
+
+static char *journal_segment_file(const char *dir, uint64_t seq)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "ckpt-%08llu.seg", (unsigned long long)seq);
+    return journal_file(dir, name);
+}
+
+// Garante que a criação/renomeação de arquivos no diretório chegou ao disco
+static void sync_dir(const char *dir)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/* ============================================================================= */
+/* --- REGISTRO DAS OPERAÇÕES --- */
+/* ============================================================================= */
+
+// Abre um registro no grupo pendente; o cabeçalho é completado em record_end
+static size_t record_begin(FsJournal *j, JournalRecordType type)
+{
+    JournalBuffer *buf = &j->group;
+    size_t start = buf->size;
+    jbuf_put_u32(buf, 0); // tamanho, preenchido em record_end
+    jbuf_put_u32(buf, 0); // crc, idem
+    jbuf_put_u64(buf, j->next_lsn++);
+    jbuf_put_u32(buf, (uint32_t)type);
+    return start;
+}
+
+static void record_end(FsJournal *j, size_t start)
+{
+    JournalBuffer *buf = &j->group;
+    char *rec = buf->data + start;
+    uint32_t size = (uint32_t)(buf->size - start - JOURNAL_RECORD_HEADER);
+    uint32_t crc = crc32(rec + 8, buf->size - start - 8);
+    memcpy(rec, &size, sizeof(size));
+    memcpy(rec + 4, &crc, sizeof(crc));
+    j->records++;
+    if (buf->size >= JOURNAL_GROUP_BYTES)
+        fs_journal_commit(j);
+}
+
+// Outro nome do arquivo de 'node' (ln): o registro aponta para ele em vez de
+// repetir o conteúdo
+static void journal_log_link(FsJournal *j, Directory *dir, TreeNode *node)
+{
+    const FileLinks *links = node->data.file->links;
+    const FileLink *other = &links->items[0];
+    if (other->node == node)
+        other = &links->items[1];
+    size_t start = record_begin(j, JR_LINK);
+    jbuf_put_u64(&j->group, dir->id);
+    jbuf_put_str(&j->group, tree_node_name(node), strlen(tree_node_name(node)));
+    jbuf_put_u64(&j->group, other->dir->id);
+    jbuf_put_str(&j->group, tree_node_name(other->node), strlen(tree_node_name(other->node)));
+    jbuf_put_u64(&j->group, tree_node_ino(node));
+    record_end(j, start);
+}
+
+void fs_journal_log_add(Directory *dir, TreeNode *node)
+{
+    FsJournal *j = dir->fs->journal;
+    if (!j || j->replaying)
+        return;
+    if (node->type == FILE_TYPE && node->data.file->links)
+    {
+        journal_log_link(j, dir, node);
+        return;
+    }
+    size_t start = record_begin(j, node->type == FILE_TYPE ? JR_ADD_FILE : JR_ADD_DIR);
+    jbuf_put_u64(&j->group, dir->id);
+    jbuf_put_u64(&j->group, (uint64_t)(int64_t)node->creation_time);
+    jbuf_put_str(&j->group, tree_node_name(node), strlen(tree_node_name(node)));
+    if (node->type == FILE_TYPE)
+    {
+        jbuf_put_file(&j->group, node->data.file);
+        jbuf_put_u64(&j->group, tree_node_ino(node));
+    }
+    else
+        jbuf_put_u64(&j->group, node->data.directory->id);
+    record_end(j, start);
+}
+
+void fs_journal_log_remove(Directory *dir, const char *name)
+{
+    FsJournal *j = dir->fs->journal;
+    if (!j || j->replaying)
+        return;
+    size_t start = record_begin(j, JR_REMOVE);
+    jbuf_put_u64(&j->group, dir->id);
+    jbuf_put_str(&j->group, name, strlen(name));
+    record_end(j, start);
+}
+
+void fs_journal_log_mtime(Directory *dir, time_t mtime)
+{
+    FsJournal *j = dir->fs->journal;
+    if (!j || j->replaying)
+        return;
+    size_t start = record_begin(j, JR_MTIME);
+    jbuf_put_u64(&j->group, dir->id);
+    jbuf_put_u64(&j->group, (uint64_t)(int64_t)mtime);
+    record_end(j, start);
+}
+
+void fs_journal_log_write(Directory *dir, TreeNode *node, size_t offset, const char *data, size_t len)
+{
+    FsJournal *j = dir->fs->journal;
+    if (!j || j->replaying)
+        return;
+    size_t start = record_begin(j, JR_WRITE);
+    jbuf_put_u64(&j->group, dir->id);
+    jbuf_put_u64(&j->group, (uint64_t)(int64_t)node->modification_time);
+    jbuf_put_str(&j->group, tree_node_name(node), strlen(tree_node_name(node)));
+    jbuf_put_u64(&j->group, offset);
+    jbuf_put_str(&j->group, data, len);
+    jbuf_put_u64(&j->group, tree_node_ino(node));
+    record_end(j, start);
+}
+
+void fs_journal_log_unshare(Directory *dir, TreeNode *own, TreeNode *shared)
+{
+    FsJournal *j = dir->fs->journal;
+    if (!j || j->replaying)
+        return;
+    size_t start = record_begin(j, JR_UNSHARE);
+    jbuf_put_u64(&j->group, dir->id);
+    jbuf_put_str(&j->group, tree_node_name(own), strlen(tree_node_name(own)));
+    jbuf_put_u64(&j->group, tree_node_ino(own));
+    jbuf_put_u64(&j->group, tree_node_ino(shared));
+    record_end(j, start);
+}
+
+void fs_journal_log_clone(Directory *dir, TreeNode *node, Directory *src)
+{
+    FsJournal *j = dir->fs->journal;
+    if (!j || j->replaying)
+        return;
+    size_t start = record_begin(j, JR_CLONE);
+    jbuf_put_u64(&j->group, dir->id);
+    jbuf_put_str(&j->group, tree_node_name(node), strlen(tree_node_name(node)));
+    jbuf_put_u64(&j->group, src->id);
+    jbuf_put_u64(&j->group, node->data.directory->id);
+    record_end(j, start);
+}
+
+void fs_journal_commit(FsJournal *j)
+{
+    if (!j || j->group.size == 0)
+        return;
+    // Sem o log gravado não há como garantir nada do que vem depois
+    if (!write_all_fd(j->log_fd, j->group.data, j->group.size) || fdatasync(j->log_fd) != 0)
+    {
+        perror("Erro ao gravar o journal");
+        exit(EXIT_FAILURE);
+    }
+    j->log_size += j->group.size;
+    j->group.size = 0;
+    j->commits++;
+
+    // No modo concorrente o checkpoint precisa da árvore parada: fica para
+    // quem chamou (ver fs_journal_checkpoint_due)
+    if (!j->fs->concurrent && fs_journal_checkpoint_due(j))
+        fs_journal_checkpoint(j, false);
+}
+
+bool fs_journal_checkpoint_due(const FsJournal *j)
+{
+    return j && j->log_size >= JOURNAL_CHECKPOINT_BYTES;
+}
+
+void fs_journal_lock(FileSystem *fs)
+{
+    if (fs->concurrent && fs->journal)
+        pthread_mutex_lock(&fs->journal_lock);
+}
+
+void fs_journal_unlock(FileSystem *fs)
+{
+    if (fs->concurrent && fs->journal)
+        pthread_mutex_unlock(&fs->journal_lock);
+}
+
+/* ============================================================================= */
+/* --- CHECKPOINTS --- */
+/* ============================================================================= */
+
+static void mark_all_dirty(BTreeNode *node)
+{
+    for (int i = 0; i < node->num_keys; i++)
+    {
+        if (!node->leaf)
+            mark_all_dirty(node->children[i]);
+        if (node->keys[i]->type == DIRECTORY_TYPE)
+        {
+            directory_mark_dirty(node->keys[i]->data.directory);
+            mark_all_dirty(node->keys[i]->data.directory->tree->root);
+        }
+    }
+    if (!node->leaf)
+        mark_all_dirty(node->children[node->num_keys]);
+}
+
+static void segment_add_entries(JournalBuffer *buf, BTreeNode *node)
+{
+    for (int i = 0; i < node->num_keys; i++)
+    {
+        if (!node->leaf)
+            segment_add_entries(buf, node->children[i]);
+
+        TreeNode *item = node->keys[i];
+        jbuf_put_u32(buf, (uint32_t)item->type);
+        jbuf_put_u64(buf, (uint64_t)(int64_t)item->creation_time);
+        jbuf_put_u64(buf, (uint64_t)(int64_t)item->modification_time);
+        jbuf_put_u64(buf, (uint64_t)(int64_t)item->last_access_time);
+        jbuf_put_str(buf, tree_node_name(item), strlen(tree_node_name(item)));
+        if (item->type == FILE_TYPE)
+        {
+            jbuf_put_file(buf, item->data.file);
+            jbuf_put_u64(buf, tree_node_ino(item));
+            jbuf_put_u32(buf, __atomic_load_n(&item->data.file->nlink, __ATOMIC_RELAXED));
+        }
+        else
+            jbuf_put_u64(buf, item->data.directory->id);
+    }
+    if (!node->leaf)
+        segment_add_entries(buf, node->children[node->num_keys]);
+}
+
+static bool segment_write(const char *dir, uint64_t seq, const JournalBuffer *buf)
+{
+    char *name = journal_segment_file(dir, seq);
+    size_t tmp_len = strlen(name) + 5;
+    char *tmp_name = (char *)malloc(tmp_len);
+    snprintf(tmp_name, tmp_len, "%s.tmp", name);
+
+    bool ok = false;
+    int fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0)
+    {
+        ok = write_all_fd(fd, buf->data, buf->size) && fsync(fd) == 0;
+        if (close(fd) != 0)
+            ok = false;
+        ok = ok && rename(tmp_name, name) == 0;
+        if (!ok)
+            remove(tmp_name);
+    }
+    if (ok)
+        sync_dir(dir);
+    else
+        perror("Erro ao gravar checkpoint");
+
+    free(tmp_name);
+    free(name);
+    return ok;
+}
+
+int fs_journal_checkpoint(FsJournal *j, bool full)
+{
+    fs_journal_commit(j);
+    FileSystem *fs = j->fs;
+
+    // Muitos segmentos deixam a recuperação lenta: consolida num completo
+    if (j->last_segment - j->first_segment + 1 >= JOURNAL_MAX_SEGMENTS)
+        full = true;
+    if (full)
+    {
+        directory_mark_dirty(fs->root);
+        mark_all_dirty(fs->root->tree->root);
+    }
+    if (!fs->dirty_head)
+        return 0;
+
+    SegmentHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, JOURNAL_SEGMENT_MAGIC, sizeof(JOURNAL_SEGMENT_MAGIC));
+    h.version = JOURNAL_SEGMENT_VERSION;
+    h.full = full ? 1 : 0;
+    h.seq = j->last_segment + 1;
+    h.lsn = j->next_lsn - 1;
+    h.next_ino = fs->next_ino;
+
+    JournalBuffer buf = {NULL, 0, 0};
+    jbuf_append(&buf, &h, sizeof(h));
+    for (Directory *dir = fs->dirty_head; dir; dir = dir->dirty_next)
+    {
+        jbuf_put_u64(&buf, dir->id);
+        jbuf_put_u64(&buf, btree_count(dir->tree));
+        segment_add_entries(&buf, dir->tree->root);
+        h.dir_count++;
+    }
+    memcpy(buf.data, &h, sizeof(h));
+
+    bool ok = segment_write(j->path, h.seq, &buf);
+    free(buf.data);
+    if (!ok)
+        return -1; // a lista de sujos e o log continuam valendo
+
+    while (fs->dirty_head)
+        directory_clear_dirty(fs->dirty_head);
+
+    // Tudo o que está no log agora está no segmento
+    if (ftruncate(j->log_fd, 0) != 0 || fsync(j->log_fd) != 0)
+        perror("Erro ao truncar o journal");
+    j->log_size = 0;
+    j->checkpoint_lsn = h.lsn;
+    j->last_segment = h.seq;
+
+    if (full)
+    {
+        for (uint64_t seq = j->first_segment; seq < h.seq; seq++)
+        {
+            char *name = journal_segment_file(j->path, seq);
+            unlink(name);
+            free(name);
+        }
+        j->first_segment = h.seq;
+    }
+    return (int)h.dir_count;
+}
+
+void fs_journal_move(FileSystem *from, FileSystem *to)
+{
+    FsJournal *j = from->journal;
+    if (!j)
+        return;
+    while (from->dirty_head)
+        directory_clear_dirty(from->dirty_head);
+    from->journal = NULL;
+    j->fs = to;
+    to->journal = j;
+    fs_journal_checkpoint(j, true);
+}
+
+/* ============================================================================= */
+/* --- RECUPERAÇÃO --- */
+/* ============================================================================= */
+
+// Tabela id -> ponteiro (endereçamento aberto; o id 0 marca posição vazia)
+typedef struct IdMap {
+    uint64_t *keys;
+    void **values;
+    size_t capacity;
+    size_t count;
+} IdMap;
+
+static void idmap_put(IdMap *map, uint64_t id, void *value);
+
+static void idmap_grow(IdMap *map)
+{
+    IdMap bigger = {NULL, NULL, map->capacity ? map->capacity * 2 : 256, 0};
+    bigger.keys = (uint64_t *)calloc(bigger.capacity, sizeof(uint64_t));
+    bigger.values = (void **)calloc(bigger.capacity, sizeof(void *));
+    for (size_t i = 0; i < map->capacity; i++)
+        if (map->keys[i])
+            idmap_put(&bigger, map->keys[i], map->values[i]);
+    free(map->keys);
+    free(map->values);
+    *map = bigger;
+}
+
+static void idmap_put(IdMap *map, uint64_t id, void *value)
+{
+    if ((map->count + 1) * 10 > map->capacity * 7)
+        idmap_grow(map);
+    size_t mask = map->capacity - 1;
+    size_t i = (size_t)(id * 0x9E3779B97F4A7C15ULL) & mask;
+    while (map->keys[i] && map->keys[i] != id)
+        i = (i + 1) & mask;
+    if (!map->keys[i])
+    {
+        map->keys[i] = id;
+        map->count++;
+    }
+    map->values[i] = value;
+}
+
+static void *idmap_get(const IdMap *map, uint64_t id)
+{
+    if (map->capacity == 0)
+        return NULL;
+    size_t mask = map->capacity - 1;
+    size_t i = (size_t)(id * 0x9E3779B97F4A7C15ULL) & mask;
+    while (map->keys[i])
+    {
+        if (map->keys[i] == id)
+            return map->values[i];
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+// Registro de um diretório dentro de um segmento mapeado
+typedef struct SegmentRecord {
+    const char *start; // logo depois do id
+    const char *end;   // fim do segmento
+    uint32_t version;  // do segmento
+} SegmentRecord;
+
+typedef struct SegmentFile {
+    uint64_t seq;
+    char *base;
+    size_t size;
+    SegmentRecord *records;
+} SegmentFile;
+
+typedef struct JournalRecovery {
+    IdMap records;      // id -> SegmentRecord mais novo
+    IdMap dirs;         // id -> Directory já montado
+    IdMap links;        // inode -> Directory do primeiro nome de um arquivo com vários
+    SegmentFile *segments;
+    size_t segment_count;
+    uint64_t checkpoint_lsn;
+    uint64_t next_ino;
+    uint64_t replayed;  // registros do log reaplicados
+    uint64_t skipped;   // registros que não batiam com a árvore
+} JournalRecovery;
+
+static int compare_seq(const void *a, const void *b)
+{
+    uint64_t x = ((const SegmentFile *)a)->seq, y = ((const SegmentFile *)b)->seq;
+    return (x > y) - (x < y);
+}
+
+// Lista os segmentos do diretório em ordem crescente
+static void recovery_list_segments(JournalRecovery *r, const char *path)
+{
+    DIR *d = opendir(path);
+    if (!d)
+        return;
+    size_t capacity = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        unsigned long long seq;
+        char tail[8];
+        if (sscanf(ent->d_name, "ckpt-%llu%7s", &seq, tail) != 2 || strcmp(tail, ".seg") != 0)
+            continue;
+        if (r->segment_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            r->segments = (SegmentFile *)realloc(r->segments, capacity * sizeof(SegmentFile));
+        }
+        SegmentFile *seg = &r->segments[r->segment_count++];
+        memset(seg, 0, sizeof(*seg));
+        seg->seq = seq;
+    }
+    closedir(d);
+    if (r->segment_count > 1)
+        qsort(r->segments, r->segment_count, sizeof(SegmentFile), compare_seq);
+}
+
+static bool segment_map(const char *path, SegmentFile *seg)
+{
+    char *name = journal_segment_file(path, seg->seq);
+    int fd = open(name, O_RDONLY);
+    free(name);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SegmentHeader);
+    if (ok)
+    {
+        seg->size = (size_t)st.st_size;
+        seg->base = (char *)mmap(NULL, seg->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (seg->base == MAP_FAILED)
+        {
+            seg->base = NULL;
+            ok = false;
+        }
+    }
+    close(fd);
+    if (!ok)
+        return false;
+
+    const SegmentHeader *h = (const SegmentHeader *)seg->base;
+    return memcmp(h->magic, JOURNAL_SEGMENT_MAGIC, sizeof(JOURNAL_SEGMENT_MAGIC)) == 0 &&
+           h->version >= 1 && h->version <= JOURNAL_SEGMENT_VERSION && h->seq == seg->seq;
+}
+
+// Pula uma entrada do segmento, só conferindo os limites
+static bool segment_skip_entry(JournalCursor *c, uint32_t version)
+{
+    uint32_t type = cur_get_u32(c);
+    cur_get_u64(c);
+    cur_get_u64(c);
+    cur_get_u64(c);
+    cur_get_str(c, NULL);
+    if (type == FILE_TYPE)
+    {
+        cur_get_str(c, NULL);
+        if (version >= 2)
+        {
+            cur_get_u64(c);
+            cur_get_u32(c);
+        }
+    }
+    else
+        cur_get_u64(c);
+    return c->ok;
+}
+
+// Indexa os registros de diretório do segmento; os mais novos substituem os antigos
+static bool segment_index(JournalRecovery *r, SegmentFile *seg)
+{
+    const SegmentHeader *h = (const SegmentHeader *)seg->base;
+    if (h->dir_count > seg->size / 16)
+        return false;
+    seg->records = (SegmentRecord *)malloc((h->dir_count ? h->dir_count : 1) * sizeof(SegmentRecord));
+
+    JournalCursor c = {seg->base + sizeof(SegmentHeader), seg->base + seg->size, true};
+    for (uint64_t d = 0; d < h->dir_count; d++)
+    {
+        uint64_t id = cur_get_u64(&c);
+        seg->records[d].start = c.p;
+        seg->records[d].end = c.end;
+        seg->records[d].version = h->version;
+        uint64_t count = cur_get_u64(&c);
+        for (uint64_t i = 0; i < count && c.ok; i++)
+            segment_skip_entry(&c, h->version);
+        if (!c.ok || id == 0)
+            return false;
+        idmap_put(&r->records, id, &seg->records[d]);
+    }
+
+    if (h->lsn > r->checkpoint_lsn)
+        r->checkpoint_lsn = h->lsn;
+    if (h->next_ino > r->next_ino)
+        r->next_ino = h->next_ino;
+    return true;
+}
+
+// Um arquivo do segmento com o inode 'ino'. O segundo nome (em diante) de um
+// arquivo com vários volta a ser uma ligação para o primeiro. Um número
+// repetido com um nome só é uma entrada compartilhada entre um diretório e a
+// cópia dele (snapshot, cp -r): volta a ser o mesmo item nos dois
+// (directory_reshare_file). Fora isso, um número que já é de outro item fica
+// com o número novo que o arquivo recebeu.
+static TreeNode *recovery_file(JournalRecovery *r, Directory *dir, const char *name, const char *content,
+                               uint64_t len, uint64_t ino, uint32_t nlink)
+{
+    FileSystem *fs = dir->fs;
+    TreeNode *first = fs_inode_get(&fs->alloc.inodes, ino);
+    Directory *first_dir = (nlink > 1) ? (Directory *)idmap_get(&r->links, ino) : NULL;
+    if (first && first->type == FILE_TYPE && first_dir)
+        return link_txt_file(first, first_dir, name, dir);
+    TreeNode *shared = (nlink == 1) ? directory_reshare_file(dir, name, ino, len) : NULL;
+    if (shared)
+        return shared;
+
+    TreeNode *node = create_txt_file(name, content, dir);
+    tree_node_set_ino(fs, node, ino);
+    if (nlink > 1 && node->data.file->ino == ino)
+        idmap_put(&r->links, ino, dir);
+    return node;
+}
+
+// Monta o conteúdo de 'dir' a partir do registro mais novo do seu id
+static bool recovery_build_dir(JournalRecovery *r, Directory *dir, uint64_t id)
+{
+    idmap_put(&r->dirs, id, dir);
+    const SegmentRecord *rec = (const SegmentRecord *)idmap_get(&r->records, id);
+    if (!rec)
+        return id == FS_ROOT_DIR_ID; // sem nenhum segmento, a raiz começa vazia
+
+    JournalCursor c = {rec->start, rec->end, true};
+    uint64_t count = cur_get_u64(&c);
+    TreeNode **items = (TreeNode **)malloc((count ? count : 1) * sizeof(TreeNode *));
+    size_t n = 0;
+    bool ok = c.ok;
+    for (uint64_t i = 0; i < count && ok; i++)
+    {
+        uint32_t type = cur_get_u32(&c);
+        time_t created = (time_t)(int64_t)cur_get_u64(&c);
+        time_t modified = (time_t)(int64_t)cur_get_u64(&c);
+        time_t accessed = (time_t)(int64_t)cur_get_u64(&c);
+        const char *name = cur_get_str(&c, NULL);
+        if (!c.ok || name[0] == '\0' || (n > 0 && strcmp(tree_node_name(items[n - 1]), name) >= 0))
+        {
+            ok = false;
+            break;
+        }
+
+        TreeNode *node;
+        if (type == FILE_TYPE)
+        {
+            uint64_t len = 0;
+            const char *content = cur_get_str(&c, &len);
+            uint64_t ino = (rec->version >= 2) ? cur_get_u64(&c) : 0;
+            uint32_t nlink = (rec->version >= 2) ? cur_get_u32(&c) : 1;
+            if (!c.ok)
+            {
+                ok = false;
+                break;
+            }
+            node = recovery_file(r, dir, name, content, len, ino, nlink);
+        }
+        else if (type == DIRECTORY_TYPE)
+        {
+            uint64_t child_id = cur_get_u64(&c);
+            // Um id já montado indicaria um ciclo
+            if (!c.ok || child_id == 0 || idmap_get(&r->dirs, child_id))
+            {
+                ok = false;
+                break;
+            }
+            node = create_directory(name, dir);
+            tree_node_set_ino(dir->fs, node, child_id);
+            if (node->data.directory->id != child_id || !recovery_build_dir(r, node->data.directory, child_id))
+            {
+                free_tree_node(&dir->fs->alloc, node);
+                ok = false;
+                break;
+            }
+        }
+        else
+        {
+            ok = false;
+            break;
+        }
+        node->creation_time = created;
+        node->modification_time = modified;
+        node->last_access_time = accessed;
+        items[n++] = node;
+    }
+
+    if (ok)
+    {
+        btree_bulk_load(dir->tree, items, n);
+        directory_recount(dir);
+    }
+    else
+    {
+        for (size_t i = 0; i < n; i++)
+            free_tree_node(&dir->fs->alloc, items[i]);
+    }
+    free(items);
+    return ok;
+}
+
+// Tira do mapa os diretórios de uma subárvore que vai ser removida
+static void recovery_forget_dirs(JournalRecovery *r, BTreeNode *node)
+{
+    for (int i = 0; i < node->num_keys; i++)
+    {
+        if (!node->leaf)
+            recovery_forget_dirs(r, node->children[i]);
+        if (node->keys[i]->type == DIRECTORY_TYPE)
+        {
+            Directory *dir = node->keys[i]->data.directory;
+            idmap_put(&r->dirs, dir->id, NULL);
+            recovery_forget_dirs(r, dir->tree->root);
+        }
+    }
+    if (!node->leaf)
+        recovery_forget_dirs(r, node->children[node->num_keys]);
+}
+
+// Registra os diretórios de uma cópia reaplicada
+static void recovery_learn_dirs(JournalRecovery *r, Directory *dir)
+{
+    idmap_put(&r->dirs, dir->id, dir);
+    for (Directory *sub = dir->subdirs; sub; sub = sub->sibling_next)
+        recovery_learn_dirs(r, sub);
+}
+
+// Aplica um registro do log. Registros que não batem com a árvore (pai
+// inexistente, nome repetido) são contados e ignorados.
+static bool recovery_apply(JournalRecovery *r, uint32_t type, JournalCursor *c)
+{
+    Directory *dir = (Directory *)idmap_get(&r->dirs, cur_get_u64(c));
+    if (type == JR_ADD_FILE || type == JR_ADD_DIR)
+    {
+        time_t now = (time_t)(int64_t)cur_get_u64(c);
+        const char *name = cur_get_str(c, NULL);
+        const char *content = (type == JR_ADD_FILE) ? cur_get_str(c, NULL) : NULL;
+        uint64_t ino = (type == JR_ADD_DIR || c->p < c->end) ? cur_get_u64(c) : 0;
+        if (!c->ok || !dir || name[0] == '\0' || btree_search(dir->tree, name))
+            return false;
+        if (type == JR_ADD_DIR && (ino == 0 || idmap_get(&r->dirs, ino)))
+            return false;
+
+        TreeNode *node = (type == JR_ADD_FILE) ? create_txt_file(name, content, dir)
+                                               : create_directory(name, dir);
+        node->creation_time = now;
+        node->modification_time = now;
+        node->last_access_time = now;
+        tree_node_set_ino(dir->fs, node, ino);
+        if (type == JR_ADD_DIR)
+            idmap_put(&r->dirs, ino, node->data.directory);
+        directory_add_entry(dir, node);
+        return true;
+    }
+    if (type == JR_REMOVE)
+    {
+        const char *name = cur_get_str(c, NULL);
+        TreeNode *node = (c->ok && dir) ? btree_search(dir->tree, name) : NULL;
+        if (!node)
+            return false;
+        if (node->type == DIRECTORY_TYPE)
+        {
+            idmap_put(&r->dirs, node->data.directory->id, NULL);
+            recovery_forget_dirs(r, node->data.directory->tree->root);
+        }
+        directory_remove_entry(dir, name);
+        return true;
+    }
+    if (type == JR_MTIME)
+    {
+        time_t mtime = (time_t)(int64_t)cur_get_u64(c);
+        if (!c->ok || !dir)
+            return false;
+        directory_set_mtime(dir, mtime);
+        return true;
+    }
+    if (type == JR_WRITE)
+    {
+        time_t mtime = (time_t)(int64_t)cur_get_u64(c);
+        const char *name = cur_get_str(c, NULL);
+        uint64_t offset = cur_get_u64(c);
+        uint64_t len = 0;
+        const char *data = cur_get_str(c, &len);
+        uint64_t ino = (c->p < c->end) ? cur_get_u64(c) : 0;
+        TreeNode *node = (c->ok && dir) ? btree_search(dir->tree, name) : NULL;
+        if (!node || !directory_file_write(dir, node, offset, data, len))
+            return false;
+        // A escrita pode ter trocado a entrada (cópia compartilhada)
+        node = btree_search(dir->tree, name);
+        file_set_mtime(dir->fs, node, mtime);
+        tree_node_set_ino(dir->fs, node, ino);
+        return true;
+    }
+    if (type == JR_LINK)
+    {
+        const char *name = cur_get_str(c, NULL);
+        Directory *src_dir = (Directory *)idmap_get(&r->dirs, cur_get_u64(c));
+        const char *src_name = cur_get_str(c, NULL);
+        uint64_t ino = cur_get_u64(c);
+        if (!c->ok || !dir || !src_dir || name[0] == '\0' || btree_search(dir->tree, name))
+            return false;
+        TreeNode *src = btree_search(src_dir->tree, src_name);
+        if (!src || src->type != FILE_TYPE)
+            return false;
+        TreeNode *node = directory_add_link(dir, name, src_dir, src);
+        tree_node_set_ino(dir->fs, node, ino);
+        return true;
+    }
+    if (type == JR_UNSHARE)
+    {
+        const char *name = cur_get_str(c, NULL);
+        uint64_t ino = cur_get_u64(c);
+        uint64_t shared_ino = cur_get_u64(c);
+        TreeNode *node = (c->ok && dir) ? btree_search(dir->tree, name) : NULL;
+        if (!node || node->type != FILE_TYPE || node->data.file->links)
+            return false;
+        TreeNode *own = directory_unshare_file(dir, node);
+        if (own == node)
+            return false;
+        // Quem ficou com o número pode ter sido outro (duas cópias soltando a
+        // mesma entrada ao mesmo tempo): os números são os do registro
+        if (tree_node_ino(own) == shared_ino)
+            tree_node_set_ino(dir->fs, own, dir->fs->next_ino);
+        tree_node_set_ino(dir->fs, node, shared_ino);
+        tree_node_set_ino(dir->fs, own, ino);
+        return true;
+    }
+    if (type == JR_CLONE)
+    {
+        const char *name = cur_get_str(c, NULL);
+        Directory *src = (Directory *)idmap_get(&r->dirs, cur_get_u64(c));
+        uint64_t copy_id = cur_get_u64(c);
+        if (!c->ok || !dir || !src || name[0] == '\0' || btree_search(dir->tree, name) ||
+            copy_id == 0 || idmap_get(&r->dirs, copy_id))
+            return false;
+
+        // A cópia é refeita a partir do estado atual da origem, que é o do
+        // momento do registro; os ids saem de novo em sequência a partir do gravado
+        FileSystem *fs = dir->fs;
+        uint64_t next = fs->next_ino;
+        fs->next_ino = copy_id;
+        TreeNode *node = directory_add_clone(dir, name, src);
+        if (next > fs->next_ino)
+            fs->next_ino = next;
+        recovery_learn_dirs(r, node->data.directory);
+        return true;
+    }
+    return false;
+}
+
+// Reaplica o log e devolve até onde ele é válido (o resto é descartado)
+static size_t recovery_replay_log(JournalRecovery *r, FsJournal *j, const char *data, size_t size)
+{
+    size_t off = 0;
+    uint64_t last_lsn = r->checkpoint_lsn;
+    while (size - off >= JOURNAL_RECORD_HEADER)
+    {
+        uint32_t len, crc, type;
+        uint64_t lsn;
+        memcpy(&len, data + off, sizeof(len));
+        memcpy(&crc, data + off + 4, sizeof(crc));
+        memcpy(&lsn, data + off + 8, sizeof(lsn));
+        memcpy(&type, data + off + 16, sizeof(type));
+        if (len > size - off - JOURNAL_RECORD_HEADER ||
+            crc32(data + off + 8, JOURNAL_RECORD_HEADER - 8 + len) != crc)
+            break;
+
+        if (lsn > r->checkpoint_lsn)
+        {
+            JournalCursor c = {data + off + JOURNAL_RECORD_HEADER, data + off + JOURNAL_RECORD_HEADER + len, true};
+            if (recovery_apply(r, type, &c))
+                r->replayed++;
+            else
+                r->skipped++;
+        }
+        if (lsn > last_lsn)
+            last_lsn = lsn;
+        off += JOURNAL_RECORD_HEADER + len;
+    }
+    j->next_lsn = last_lsn + 1;
+    return off;
+}
+
+static void recovery_free(JournalRecovery *r)
+{
+    for (size_t i = 0; i < r->segment_count; i++)
+    {
+        if (r->segments[i].base)
+            munmap(r->segments[i].base, r->segments[i].size);
+        free(r->segments[i].records);
+    }
+    free(r->segments);
+    free(r->records.keys);
+    free(r->records.values);
+    free(r->dirs.keys);
+    free(r->dirs.values);
+    free(r->links.keys);
+    free(r->links.values);
+}
+
+// Lê o log inteiro para a memória (NULL e *size = 0 se estiver vazio)
+static char *read_log(int fd, size_t *size)
+{
+    struct stat st;
+    *size = 0;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+        return NULL;
+    char *data = (char *)malloc((size_t)st.st_size);
+    size_t got = 0;
+    while (got < (size_t)st.st_size)
+    {
+        ssize_t n = pread(fd, data + got, (size_t)st.st_size - got, (off_t)got);
+        if (n <= 0)
+            break;
+        got += (size_t)n;
+    }
+    *size = got;
+    return data;
+}
+
+FileSystem *fs_journal_open(const char *path)
+{
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+    {
+        perror("Erro ao criar o diretório do journal");
+        return NULL;
+    }
+    char *log_name = journal_file(path, JOURNAL_LOG_NAME);
+    int log_fd = open(log_name, O_RDWR | O_CREAT | O_APPEND, 0644);
+    free(log_name);
+    if (log_fd < 0)
+    {
+        perror("Erro ao abrir o journal");
+        return NULL;
+    }
+
+    JournalRecovery r;
+    memset(&r, 0, sizeof(r));
+    recovery_list_segments(&r, path);
+
+    // Só interessam os segmentos a partir do último completo
+    size_t first = 0;
+    bool ok = true;
+    for (size_t i = 0; i < r.segment_count && ok; i++)
+        ok = segment_map(path, &r.segments[i]);
+    for (size_t i = 0; i < r.segment_count && ok; i++)
+        if (((const SegmentHeader *)r.segments[i].base)->full)
+            first = i;
+    for (size_t i = first; i < r.segment_count && ok; i++)
+        ok = segment_index(&r, &r.segments[i]);
+    if (ok && r.segment_count > 0 && !((const SegmentHeader *)r.segments[first].base)->full)
+        ok = false; // faltou o segmento completo de base
+
+    // Os números novos dados na montagem (itens sem número gravado, números
+    // repetidos) ficam acima de todos os gravados
+    FileSystem *fs = fs_create();
+    if (r.next_ino > fs->next_ino)
+        fs->next_ino = r.next_ino;
+    if (ok)
+        ok = recovery_build_dir(&r, fs->root, FS_ROOT_DIR_ID);
+    if (!ok)
+    {
+        printf("journal: checkpoint corrompido em %s\n", path);
+        fs_destroy(fs);
+        recovery_free(&r);
+        close(log_fd);
+        return NULL;
+    }
+    bool first_open = (r.segment_count == 0);
+
+    FsJournal *j = (FsJournal *)calloc(1, sizeof(FsJournal));
+    j->fs = fs;
+    j->path = strdup(path);
+    j->log_fd = log_fd;
+    j->checkpoint_lsn = r.checkpoint_lsn;
+    j->next_lsn = r.checkpoint_lsn + 1;
+    if (r.segment_count > 0)
+    {
+        j->first_segment = r.segments[first].seq;
+        j->last_segment = r.segments[r.segment_count - 1].seq;
+    }
+    fs->journal = j;
+
+    // Reaplica o log com o journal já ligado, para que os diretórios tocados
+    // fiquem marcados para o próximo checkpoint, mas sem gerar registros novos
+    size_t log_size;
+    char *log_data = read_log(log_fd, &log_size);
+    j->replaying = true;
+    size_t valid = recovery_replay_log(&r, j, log_data, log_size);
+    j->replaying = false;
+    free(log_data);
+    if (valid < log_size && ftruncate(log_fd, (off_t)valid) != 0)
+        perror("Erro ao truncar o journal");
+    j->log_size = valid;
+
+    // Segmentos antigos que sobraram de um checkpoint interrompido
+    for (size_t i = 0; i < first; i++)
+    {
+        char *name = journal_segment_file(path, r.segments[i].seq);
+        unlink(name);
+        free(name);
+    }
+    if (r.replayed > 0 || r.skipped > 0 || valid < log_size)
+        printf("journal: %llu operações reaplicadas, %llu ignoradas, %zu bytes descartados\n",
+               (unsigned long long)r.replayed, (unsigned long long)r.skipped, log_size - valid);
+    recovery_free(&r);
+
+    // Primeira abertura: grava o segmento completo que serve de base
+    if (first_open)
+        fs_journal_checkpoint(j, true);
+    return fs;
+}
+
+void fs_journal_close(FsJournal *j)
+{
+    if (!j)
+        return;
+    fs_journal_commit(j);
+    close(j->log_fd);
+    if (j->fs)
+        j->fs->journal = NULL;
+    free(j->group.data);
+    free(j->path);
+    free(j);
+}
@@ -0,0 +1,144 @@
+#ifndef FS_JOURNAL_H
+#define FS_JOURNAL_H
+
+#include "filesystem.h"
+
+// Persistência incremental do sistema de arquivos num diretório do host
+//
+//   journal.log           log de operações, só cresce no fim. Cada mudança
+//                         (mkdir, touch, rm, rmdir, write, cp, ln, data de
+//                         modificação) vira um registro; os registros de um
+//                         mesmo comando são gravados juntos, com um único
+//                         fdatasync.
+//   ckpt-NNNNNNNN.seg     checkpoints. Um segmento guarda só os diretórios
+//                         alterados desde o checkpoint anterior; um segmento
+//                         completo guarda todos e torna os anteriores inúteis.
+//
+// Na abertura, os segmentos a partir do último completo são lidos (vale o
+// registro mais novo de cada diretório), a árvore é montada com
+// btree_bulk_load e o log é reaplicado por cima. Registros do log já cobertos
+// pelo checkpoint (LSN menor ou igual) são ignorados, e um registro final
+// incompleto ou com CRC errado (queda no meio da escrita) é descartado.
+//
+// Registro do log (inteiros na ordem de bytes da máquina):
+//   u32 tamanho do conteúdo | u32 crc32 (do lsn em diante) | u64 lsn | u32 tipo | conteúdo
+//
+//   JR_ADD_FILE   u64 id do pai, i64 data, str nome, str conteúdo, u64 inode
+//   JR_ADD_DIR    u64 id do pai, i64 data, str nome, u64 id do novo diretório
+//   JR_REMOVE     u64 id do pai, str nome
+//   JR_MTIME      u64 id do diretório, i64 data de modificação
+//   JR_WRITE      u64 id do pai, i64 data, str nome, u64 deslocamento, str dados,
+//                 u64 inode
+//   JR_CLONE      u64 id do pai, str nome, u64 id da origem, u64 id da cópia
+//                 (os subdiretórios da cópia recebem os ids seguintes, em
+//                 pré-ordem, e a origem é a do momento do registro)
+//   JR_LINK       u64 id do pai, str nome, u64 id do diretório de outro nome
+//                 do arquivo, str esse nome, u64 inode
+//   JR_UNSHARE    u64 id do diretório, str nome, u64 inode da entrada que fica
+//                 só do diretório, u64 inode da que as cópias continuam
+//                 dividindo (ver directory_unshare_file); vem antes do
+//                 JR_WRITE ou JR_LINK que soltou a entrada
+//
+// O inode no fim de JR_ADD_FILE e JR_WRITE falta nos logs anteriores a ele
+// (o arquivo fica com o número que receber na reaplicação).
+//
+// Segmento: SegmentHeader e, para cada diretório, u64 id, u64 quantidade de
+// entradas e as entradas em ordem de nome:
+//   u32 tipo, i64 criação, i64 modificação, i64 acesso, str nome, e depois
+//   str conteúdo, u64 inode e u32 número de nomes (arquivo) ou u64 id
+//   (diretório). Na versão 1, o arquivo tem só o conteúdo.
+//
+// Os nomes de um arquivo com mais de um (ln) são gravados cada um com o
+// conteúdo, e voltam a ser um arquivo só na recuperação: o segundo nome com o
+// mesmo inode vira uma ligação para o primeiro.
+//
+// 'str' é um u64 com o tamanho seguido dos bytes e de um '\0'.
+
+#define JOURNAL_LOG_NAME "journal.log"
+#define JOURNAL_SEGMENT_MAGIC "BTFSSEG"
+#define JOURNAL_SEGMENT_VERSION 2
+#define JOURNAL_RECORD_HEADER 20
+
+// O grupo pendente é gravado antes do fim do comando se passar deste tamanho
+#define JOURNAL_GROUP_BYTES (64 * 1024)
+// Log maior que isto dispara um checkpoint
+#define JOURNAL_CHECKPOINT_BYTES (4 * 1024 * 1024)
+// Depois de tantos segmentos incrementais, o próximo checkpoint é completo
+#define JOURNAL_MAX_SEGMENTS 16
+
+typedef enum {
+    JR_ADD_FILE = 1,
+    JR_ADD_DIR = 2,
+    JR_REMOVE = 3,
+    JR_MTIME = 4,
+    JR_WRITE = 5,
+    JR_CLONE = 6,
+    JR_LINK = 7,
+    JR_UNSHARE = 8
+} JournalRecordType;
+
+typedef struct SegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t full;        // 1 se o segmento tem todos os diretórios
+    uint64_t seq;         // número do segmento (o mesmo do nome do arquivo)
+    uint64_t lsn;         // último registro do log coberto por este segmento
+    uint64_t next_ino;    // próximo número de inode livre
+    uint64_t dir_count;
+} SegmentHeader;
+
+// Buffer em memória que cresce conforme os registros são montados
+typedef struct JournalBuffer {
+    char* data;
+    size_t size;
+    size_t capacity;
+} JournalBuffer;
+
+typedef struct FsJournal {
+    FileSystem* fs;
+    char* path;               // diretório onde ficam o log e os segmentos
+    int log_fd;
+    uint64_t log_size;        // bytes já gravados no log
+    uint64_t next_lsn;
+    uint64_t checkpoint_lsn;  // último LSN coberto pelos segmentos
+    uint64_t first_segment;   // segmento completo mais recente
+    uint64_t last_segment;    // último segmento gravado
+    JournalBuffer group;      // registros ainda não gravados (group commit)
+    bool replaying;           // reaplicando o log: não gera registros novos
+    uint64_t records;         // registros gerados nesta execução
+    uint64_t commits;         // gravações do log (fdatasync) nesta execução
+} FsJournal;
+
+// Abre (ou cria) a persistência em 'path' e recupera o sistema de arquivos.
+// Devolve NULL em caso de erro.
+FileSystem* fs_journal_open(const char* path);
+// Fecha os arquivos e libera o journal (não faz checkpoint)
+void fs_journal_close(FsJournal* j);
+
+// Grava os registros pendentes no log, com um único fdatasync. Fora do modo
+// concorrente, também faz o checkpoint quando o log passa do limite.
+void fs_journal_commit(FsJournal* j);
+// O log passou do limite e precisa de um checkpoint (no modo concorrente, quem
+// chama faz o checkpoint com a trava global exclusiva)
+bool fs_journal_checkpoint_due(const FsJournal* j);
+// Grava os diretórios sujos (ou todos, se 'full') num segmento novo e zera o
+// log. Devolve quantos diretórios foram gravados, ou -1 em caso de erro.
+int fs_journal_checkpoint(FsJournal* j, bool full);
+// Passa o journal de 'from' para 'to' (usado pelo 'load') e grava um
+// checkpoint completo do novo sistema de arquivos
+void fs_journal_move(FileSystem* from, FileSystem* to);
+
+// Trava do journal e da lista de diretórios sujos no modo concorrente (sem
+// efeito fora dele ou sem persistência)
+void fs_journal_lock(FileSystem* fs);
+void fs_journal_unlock(FileSystem* fs);
+
+// --- Registro das operações (chamados por filesystem.c) ---
+void fs_journal_log_add(Directory* dir, TreeNode* node);
+void fs_journal_log_remove(Directory* dir, const char* name);
+void fs_journal_log_mtime(Directory* dir, time_t mtime);
+void fs_journal_log_write(Directory* dir, TreeNode* node, size_t offset, const char* data, size_t len);
+void fs_journal_log_clone(Directory* dir, TreeNode* node, Directory* src);
+void fs_journal_log_unshare(Directory* dir, TreeNode* own, TreeNode* shared);
+
+#endif // FS_JOURNAL_H
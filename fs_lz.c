@@ -0,0 +1,219 @@
+#include "fs_lz.h"
+#include <string.h>
+
+// A tabela guarda a posição + 1 (0: vazia) da última ocorrência de cada hash
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+
+// Sem cópia encontrada, o passo cresce a cada 64 bytes de literais seguidos:
+// trechos que não comprimem passam mais rápido
+#define LZ_SKIP_SHIFT 6
+
+static inline uint32_t lz_read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Até onde vão iguais os bytes a partir de 'a' e 'b' (b < a), sem passar de 'len'
+static size_t lz_match_end(const unsigned char *in, size_t a, size_t b, size_t len)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (a + 8 <= len)
+    {
+        uint64_t x, y;
+        memcpy(&x, in + a, sizeof(x));
+        memcpy(&y, in + b, sizeof(y));
+        if (x != y)
+            return a + (__builtin_ctzll(x ^ y) >> 3);
+        a += 8;
+        b += 8;
+    }
+#endif
+    while (a < len && in[a] == in[b])
+    {
+        a++;
+        b++;
+    }
+    return a;
+}
+
+/* ============================================================================= */
+/* --- COMPRESSÃO --- */
+/* ============================================================================= */
+
+// Escreve o que passou de 15 num tamanho, em bytes de até 255
+static bool lz_put_length(unsigned char **op, const unsigned char *oend, size_t n)
+{
+    unsigned char *p = *op;
+    while (n >= 255)
+    {
+        if (p >= oend)
+            return false;
+        *p++ = 255;
+        n -= 255;
+    }
+    if (p >= oend)
+        return false;
+    *p++ = (unsigned char)n;
+    *op = p;
+    return true;
+}
+
+// Escreve um trecho: literais e, se match_len > 0, a cópia
+static bool lz_put_sequence(unsigned char **op, const unsigned char *oend, const unsigned char *literals,
+                            size_t literal_len, size_t offset, size_t match_len)
+{
+    unsigned char *p = *op;
+    if (p >= oend)
+        return false;
+    size_t ml = match_len ? match_len - FS_LZ_MIN_MATCH : 0;
+    unsigned char *token = p++;
+    *token = (unsigned char)(((literal_len >= 15 ? 15 : literal_len) << 4) | (ml >= 15 ? 15 : ml));
+    if (literal_len >= 15 && !lz_put_length(&p, oend, literal_len - 15))
+        return false;
+    if ((size_t)(oend - p) < literal_len)
+        return false;
+    memcpy(p, literals, literal_len);
+    p += literal_len;
+    if (match_len)
+    {
+        if (oend - p < 2)
+            return false;
+        p[0] = (unsigned char)(offset & 0xFF);
+        p[1] = (unsigned char)(offset >> 8);
+        p += 2;
+        if (ml >= 15 && !lz_put_length(&p, oend, ml - 15))
+            return false;
+    }
+    *op = p;
+    return true;
+}
+
+size_t fs_lz_compress(const char *src, size_t len, char *dst, size_t capacity)
+{
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char *op = (unsigned char *)dst;
+    const unsigned char *oend = op + capacity;
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    size_t anchor = 0;
+    size_t ip = 0;
+    if (len > FS_LZ_MIN_MATCH)
+    {
+        // Última posição de onde ainda dá para ler 4 bytes
+        size_t limit = len - FS_LZ_MIN_MATCH;
+        while (ip <= limit)
+        {
+            uint32_t seq = lz_read32(in + ip);
+            uint32_t h = lz_hash(seq);
+            size_t ref = table[h];
+            table[h] = (uint32_t)(ip + 1);
+            if (ref == 0 || ip - (ref - 1) > LZ_MAX_OFFSET || lz_read32(in + ref - 1) != seq)
+            {
+                ip += 1 + ((ip - anchor) >> LZ_SKIP_SHIFT);
+                continue;
+            }
+
+            ref--;
+            size_t end = lz_match_end(in, ip + FS_LZ_MIN_MATCH, ref + FS_LZ_MIN_MATCH, len);
+            // A cópia também pode começar antes, dentro dos literais pendentes
+            while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1])
+            {
+                ip--;
+                ref--;
+            }
+            if (!lz_put_sequence(&op, oend, in + anchor, ip - anchor, ip - ref, end - ip))
+                return 0;
+            ip = end;
+            anchor = ip;
+            // Registra uma posição de dentro da cópia, para achar repetições seguidas
+            if (ip >= 2 && ip - 2 <= limit)
+                table[lz_hash(lz_read32(in + ip - 2))] = (uint32_t)(ip - 1);
+        }
+    }
+    if (!lz_put_sequence(&op, oend, in + anchor, len - anchor, 0, 0))
+        return 0;
+    return (size_t)(op - (unsigned char *)dst);
+}
+
+/* ============================================================================= */
+/* --- DESCOMPRESSÃO --- */
+/* ============================================================================= */
+
+// Soma os bytes extras de um tamanho que chegou a 15
+static bool lz_get_length(const unsigned char **ip, const unsigned char *iend, size_t *n)
+{
+    const unsigned char *p = *ip;
+    unsigned char b;
+    do
+    {
+        if (p >= iend || *n > SIZE_MAX / 2)
+            return false;
+        b = *p++;
+        *n += b;
+    } while (b == 255);
+    *ip = p;
+    return true;
+}
+
+size_t fs_lz_decompress(const char *src, size_t src_len, char *dst, size_t len)
+{
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *iend = ip + src_len;
+    unsigned char *out = (unsigned char *)dst;
+    unsigned char *op = out;
+    unsigned char *oend = out + len;
+
+    while (ip < iend && op < oend)
+    {
+        unsigned token = *ip++;
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !lz_get_length(&ip, iend, &literal_len))
+            break;
+        if ((size_t)(iend - ip) < literal_len)
+            break;
+        size_t n = literal_len;
+        if (n > (size_t)(oend - op))
+            n = (size_t)(oend - op);
+        memcpy(op, ip, n);
+        op += n;
+        ip += literal_len;
+        // Fim do bloco (o último trecho não tem cópia) ou do destino
+        if (ip >= iend || op >= oend || iend - ip < 2)
+            break;
+
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out))
+            break;
+        size_t match_len = token & 15;
+        if (match_len == 15 && !lz_get_length(&ip, iend, &match_len))
+            break;
+        match_len += FS_LZ_MIN_MATCH;
+        if (match_len > (size_t)(oend - op))
+            match_len = (size_t)(oend - op);
+
+        const unsigned char *ref = op - offset;
+        if (offset >= match_len)
+        {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        }
+        else
+        {
+            // Cópia que se sobrepõe ao que está sendo escrito (repetição curta)
+            for (size_t i = 0; i < match_len; i++)
+                op[i] = ref[i];
+            op += match_len;
+        }
+    }
+    return (size_t)(op - out);
+}
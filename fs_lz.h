@@ -0,0 +1,36 @@
+#ifndef FS_LZ_H
+#define FS_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Compressão de blocos da família LZ77 (formato no estilo do LZ4), sem
+// dependências
+//
+// Um bloco comprimido é uma sequência de trechos. Cada trecho começa com um
+// byte: os 4 bits altos são quantos literais vêm em seguida e os 4 baixos, o
+// tamanho da cópia menos FS_LZ_MIN_MATCH. O valor 15 em qualquer das metades
+// continua em bytes extras (255 = soma e continua). Depois dos literais vem a
+// distância da cópia (2 bytes, little-endian, de 1 a 65535) e os bytes extras
+// do tamanho dela. O último trecho só tem literais.
+//
+// O compressor procura cópias com uma tabela de hash de 4 bytes (a posição mais
+// recente de cada hash) e é guloso. A descompressão confere todos os limites:
+// um bloco corrompido nunca escreve fora do destino nem lê fora da origem.
+
+#define FS_LZ_MIN_MATCH 4
+
+// Maior tamanho comprimido possível para 'len' bytes
+#define FS_LZ_BOUND(len) ((len) + (len) / 255 + 16)
+
+// Comprime 'len' bytes de 'src' em 'dst' (com 'capacity' bytes). Devolve o
+// tamanho comprimido, ou 0 se não coube.
+size_t fs_lz_compress(const char* src, size_t len, char* dst, size_t capacity);
+
+// Descomprime até 'len' bytes do bloco 'src' (de 'src_len' bytes) em 'dst' e
+// para ali, mesmo que o bloco tenha mais. Devolve quantos bytes escreveu:
+// menos que 'len' se o bloco acabou antes ou está corrompido.
+size_t fs_lz_decompress(const char* src, size_t src_len, char* dst, size_t len);
+
+#endif // FS_LZ_H
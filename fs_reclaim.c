@@ -0,0 +1,120 @@
+#include "fs_reclaim.h"
+
+struct FsReclaimer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    TreeNode **queue; // fila circular
+    size_t capacity;  // potência de 2
+    size_t head;
+    size_t count;
+    bool busy;   // uma subárvore sendo liberada (já fora da fila)
+    size_t done;
+    bool stop;
+};
+
+static void *reclaim_thread(void *arg)
+{
+    FileSystem *fs = (FileSystem *)arg;
+    FsReclaimer *r = fs->reclaimer;
+    pthread_mutex_lock(&r->lock);
+    for (;;)
+    {
+        while (r->count == 0 && !r->stop)
+            pthread_cond_wait(&r->wake, &r->lock);
+        if (r->count == 0)
+            break;
+        TreeNode *node = r->queue[r->head];
+        r->head = (r->head + 1) & (r->capacity - 1);
+        r->count--;
+        r->busy = true;
+        pthread_mutex_unlock(&r->lock);
+
+        free_tree_node(&fs->alloc, node);
+
+        pthread_mutex_lock(&r->lock);
+        r->busy = false;
+        r->done++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static FsReclaimer *reclaim_start(FileSystem *fs)
+{
+    FsReclaimer *r = (FsReclaimer *)calloc(1, sizeof(FsReclaimer));
+    if (!r)
+    {
+        perror("Erro ao reservar memória");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+    // A partir daqui o alocador é usado por duas threads
+    fs_alloc_set_locked(&fs->alloc);
+    fs->reclaimer = r;
+    if (pthread_create(&r->thread, NULL, reclaim_thread, fs) != 0)
+    {
+        perror("Erro ao criar a thread de liberação");
+        exit(EXIT_FAILURE);
+    }
+    return r;
+}
+
+void fs_reclaim_push(FileSystem *fs, TreeNode *node)
+{
+    FsReclaimer *r = fs->reclaimer ? fs->reclaimer : reclaim_start(fs);
+    pthread_mutex_lock(&r->lock);
+    if (r->count == r->capacity)
+    {
+        // Dobra a fila, desenrolando-a a partir de 'head'
+        size_t capacity = r->capacity ? r->capacity * 2 : 16;
+        TreeNode **queue = (TreeNode **)malloc(capacity * sizeof(TreeNode *));
+        if (!queue)
+        {
+            perror("Erro ao reservar memória");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < r->count; i++)
+            queue[i] = r->queue[(r->head + i) & (r->capacity - 1)];
+        free(r->queue);
+        r->queue = queue;
+        r->capacity = capacity;
+        r->head = 0;
+    }
+    r->queue[(r->head + r->count) & (r->capacity - 1)] = node;
+    r->count++;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+}
+
+void fs_reclaim_stop(FileSystem *fs)
+{
+    FsReclaimer *r = fs->reclaimer;
+    if (!r)
+        return;
+    pthread_mutex_lock(&r->lock);
+    r->stop = true;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    pthread_join(r->thread, NULL);
+    pthread_cond_destroy(&r->wake);
+    pthread_mutex_destroy(&r->lock);
+    free(r->queue);
+    free(r);
+    fs->reclaimer = NULL;
+}
+
+void fs_reclaim_stats(FileSystem *fs, size_t *pending, size_t *done)
+{
+    FsReclaimer *r = fs->reclaimer;
+    *pending = 0;
+    *done = 0;
+    if (!r)
+        return;
+    pthread_mutex_lock(&r->lock);
+    // A que está sendo liberada ainda ocupa memória
+    *pending = r->count + (r->busy ? 1 : 0);
+    *done = r->done;
+    pthread_mutex_unlock(&r->lock);
+}
@@ -0,0 +1,31 @@
+#ifndef FS_RECLAIM_H
+#define FS_RECLAIM_H
+
+#include "filesystem.h"
+
+// Liberação em segundo plano das subárvores removidas com 'rm -r'
+//
+// Tirar um diretório do pai é uma remoção só na Árvore B dele; liberar o que
+// estava dentro custa o tamanho da subárvore. Essa parte vai para uma thread
+// própria, criada no primeiro 'rm -r', que libera as subárvores na ordem em que
+// chegam. O comando termina em tempo que não depende do tamanho da subárvore.
+//
+// Quem entrega uma subárvore garante que ninguém mais a alcança: ela já saiu do
+// pai, do cache de entradas e da lista de diretórios sujos, e no modo servidor
+// o 'rm -r' roda com a trava global exclusiva, sem leitores no meio. A thread
+// só solta referências (os nós e blocos divididos com snapshots continuam com
+// o outro lado) e devolve memória ao alocador, cujas travas são ligadas antes
+// de ela começar.
+
+typedef struct FsReclaimer FsReclaimer;
+
+// Entrega 'node' (um diretório fora da árvore) para ser liberado
+void fs_reclaim_push(FileSystem* fs, TreeNode* node);
+
+// Espera a fila esvaziar e termina a thread (fs_destroy)
+void fs_reclaim_stop(FileSystem* fs);
+
+// Subárvores ainda na fila e já liberadas (ver 'stats')
+void fs_reclaim_stats(FileSystem* fs, size_t* pending, size_t* done);
+
+#endif // FS_RECLAIM_H
@@ -0,0 +1,283 @@
+#include "fs_walk.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+/* ============================================================================= */
+/* --- TAREFAS E SAÍDA --- */
+/* ============================================================================= */
+
+struct WalkTask;
+
+// Ponto da saída de um diretório onde entra a saída de um subdiretório
+typedef struct WalkSplice {
+    size_t offset;
+    struct WalkTask *child;
+} WalkSplice;
+
+typedef struct WalkTask {
+    Directory *dir;
+    char *path;
+    FsWalkOutput out;
+    WalkSplice *splices;
+    size_t splice_count;
+    size_t splice_capacity;
+} WalkTask;
+
+static void output_reserve(FsWalkOutput *out, size_t extra)
+{
+    if (out->size + extra <= out->capacity)
+        return;
+    size_t capacity = out->capacity ? out->capacity : 256;
+    while (capacity < out->size + extra)
+        capacity *= 2;
+    out->data = (char *)realloc(out->data, capacity);
+    out->capacity = capacity;
+}
+
+void fs_walk_printf(FsWalkOutput *out, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (len <= 0)
+        return;
+
+    output_reserve(out, (size_t)len + 1);
+    va_start(args, fmt);
+    vsnprintf(out->data + out->size, (size_t)len + 1, fmt, args);
+    va_end(args);
+    out->size += (size_t)len;
+}
+
+static WalkTask *task_create(Directory *dir, char *path)
+{
+    WalkTask *task = (WalkTask *)calloc(1, sizeof(WalkTask));
+    task->dir = dir;
+    task->path = path;
+    return task;
+}
+
+// Caminho de uma entrada: o do diretório, '/' e o nome
+static char *join_path(const char *path, const char *name)
+{
+    size_t path_len = strcmp(path, "/") == 0 ? 0 : strlen(path);
+    size_t name_len = strlen(name);
+    char *joined = (char *)malloc(path_len + name_len + 2);
+    memcpy(joined, path, path_len);
+    joined[path_len] = '/';
+    memcpy(joined + path_len + 1, name, name_len + 1);
+    return joined;
+}
+
+static void write_range(const FsWalkOutput *out, size_t from, size_t to, FILE *fp)
+{
+    if (to > from)
+        fwrite(out->data + from, 1, to - from, fp);
+}
+
+// Escreve a saída da tarefa com as dos subdiretórios no lugar marcado, e libera
+static void task_flush(WalkTask *task, FILE *fp)
+{
+    size_t pos = 0;
+    for (size_t i = 0; i < task->splice_count; i++)
+    {
+        write_range(&task->out, pos, task->splices[i].offset, fp);
+        pos = task->splices[i].offset;
+        task_flush(task->splices[i].child, fp);
+    }
+    write_range(&task->out, pos, task->out.size, fp);
+
+    free(task->out.data);
+    free(task->splices);
+    free(task->path);
+    free(task);
+}
+
+/* ============================================================================= */
+/* --- FILAS COM ROUBO DE TRABALHO --- */
+/* ============================================================================= */
+
+// Fila de uma thread: a dona empilha e desempilha no fim ('tail'); as outras
+// roubam do começo ('head'), onde estão as tarefas mais antigas (em geral os
+// diretórios mais altos, com mais trabalho abaixo).
+typedef struct WalkQueue {
+    pthread_mutex_t lock;
+    WalkTask **items;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} WalkQueue;
+
+typedef struct Walk {
+    const FsWalkOps *ops;
+    void *ctx;
+    int threads;
+    WalkQueue queues[FS_WALK_MAX_THREADS];
+    size_t pending; // tarefas criadas e ainda não terminadas (atômico)
+    size_t visited; // diretórios visitados (atômico)
+} Walk;
+
+typedef struct WalkWorker {
+    Walk *walk;
+    int id;
+} WalkWorker;
+
+static void queue_push(WalkQueue *q, WalkTask *task)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->capacity)
+    {
+        // Aproveita o espaço já liberado no começo antes de crescer
+        if (q->head > 0)
+        {
+            memmove(q->items, q->items + q->head, (q->tail - q->head) * sizeof(WalkTask *));
+            q->tail -= q->head;
+            q->head = 0;
+        }
+        if (q->tail == q->capacity)
+        {
+            q->capacity = q->capacity ? q->capacity * 2 : 64;
+            q->items = (WalkTask **)realloc(q->items, q->capacity * sizeof(WalkTask *));
+        }
+    }
+    q->items[q->tail++] = task;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static WalkTask *queue_pop(WalkQueue *q, bool steal)
+{
+    WalkTask *task = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail)
+        task = steal ? q->items[q->head++] : q->items[--q->tail];
+    if (q->head == q->tail)
+        q->head = q->tail = 0;
+    pthread_mutex_unlock(&q->lock);
+    return task;
+}
+
+// Visita o diretório e cria uma tarefa para cada subdiretório
+static void walk_run(Walk *w, int self, WalkTask *task)
+{
+    const FsWalkOps *ops = w->ops;
+    if (ops->visit_dir)
+        ops->visit_dir(task->dir, task->path, &task->out, w->ctx);
+
+    BTreeCursor cursor;
+    btree_cursor_open(&cursor, task->dir->tree);
+    TreeNode *item;
+    while ((item = btree_cursor_next(&cursor)) != NULL)
+    {
+        if (ops->visit_entry)
+            ops->visit_entry(task->dir, task->path, item, &task->out, w->ctx);
+        if (item->type != DIRECTORY_TYPE)
+            continue;
+
+        WalkTask *child = task_create(item->data.directory, join_path(task->path, tree_node_name(item)));
+        if (task->splice_count == task->splice_capacity)
+        {
+            task->splice_capacity = task->splice_capacity ? task->splice_capacity * 2 : 8;
+            task->splices = (WalkSplice *)realloc(task->splices, task->splice_capacity * sizeof(WalkSplice));
+        }
+        task->splices[task->splice_count].offset = task->out.size;
+        task->splices[task->splice_count].child = child;
+        task->splice_count++;
+
+        __atomic_fetch_add(&w->pending, 1, __ATOMIC_RELAXED);
+        queue_push(&w->queues[self], child);
+    }
+    __atomic_fetch_add(&w->visited, 1, __ATOMIC_RELAXED);
+}
+
+static void *walk_worker(void *arg)
+{
+    WalkWorker *worker = (WalkWorker *)arg;
+    Walk *w = worker->walk;
+    int self = worker->id;
+
+    for (;;)
+    {
+        WalkTask *task = queue_pop(&w->queues[self], false);
+        for (int i = 1; !task && i < w->threads; i++)
+            task = queue_pop(&w->queues[(self + i) % w->threads], true);
+
+        if (task)
+        {
+            walk_run(w, self, task);
+            __atomic_fetch_sub(&w->pending, 1, __ATOMIC_ACQ_REL);
+        }
+        else if (__atomic_load_n(&w->pending, __ATOMIC_ACQUIRE) == 0)
+        {
+            break;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* ============================================================================= */
+/* --- TRAVESSIA --- */
+/* ============================================================================= */
+
+int fs_walk_default_threads(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        return 1;
+    return cpus > FS_WALK_MAX_THREADS ? FS_WALK_MAX_THREADS : (int)cpus;
+}
+
+size_t fs_walk(Directory *root, const char *path, const FsWalkOps *ops, void *ctx, int threads, FILE *fp)
+{
+    if (threads < 1)
+        threads = 1;
+    if (threads > FS_WALK_MAX_THREADS)
+        threads = FS_WALK_MAX_THREADS;
+
+    Walk *w = (Walk *)calloc(1, sizeof(Walk));
+    w->ops = ops;
+    w->ctx = ctx;
+    w->threads = threads;
+    for (int i = 0; i < threads; i++)
+        pthread_mutex_init(&w->queues[i].lock, NULL);
+
+    WalkTask *top = task_create(root, strdup(path));
+    w->pending = 1;
+    queue_push(&w->queues[0], top);
+
+    // A thread que chamou é a trabalhadora 0
+    pthread_t tids[FS_WALK_MAX_THREADS];
+    WalkWorker workers[FS_WALK_MAX_THREADS];
+    int started = 1;
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i].walk = w;
+        workers[i].id = i;
+    }
+    for (int i = 1; i < threads; i++)
+    {
+        if (pthread_create(&tids[i], NULL, walk_worker, &workers[i]) != 0)
+            break;
+        started++;
+    }
+    walk_worker(&workers[0]);
+    for (int i = 1; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    task_flush(top, fp);
+
+    size_t visited = w->visited;
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_mutex_destroy(&w->queues[i].lock);
+        free(w->queues[i].items);
+    }
+    free(w);
+    return visited;
+}
@@ -0,0 +1,49 @@
+#ifndef FS_WALK_H
+#define FS_WALK_H
+
+#include "filesystem.h"
+
+// Travessia paralela de subárvores de diretórios
+//
+// Cada diretório é uma tarefa. Um conjunto de threads com uma fila por thread
+// executa as tarefas: a thread empilha os subdiretórios que encontra na
+// própria fila e as que ficam sem trabalho roubam do outro lado da fila das
+// demais (work stealing), o que espalha árvores largas por todos os núcleos.
+//
+// A saída de cada diretório vai para um buffer próprio, com marcas de onde
+// entra a saída de cada subdiretório; no fim, os buffers são escritos em
+// pré-ordem (a entrada de um diretório e logo depois o que está dentro dele,
+// com as entradas em ordem de nome). Assim a saída é a mesma com qualquer
+// número de threads.
+//
+// Os visitantes rodam em paralelo: só podem ler a árvore, e o que acumularem
+// em 'ctx' precisa ser atômico. A travessia não trava os diretórios; no modo
+// servidor, quem chama segura a trava global exclusiva.
+
+#define FS_WALK_MAX_THREADS 64
+
+// Saída de um diretório (ver fs_walk_printf)
+typedef struct FsWalkOutput {
+    char *data;
+    size_t size;
+    size_t capacity;
+} FsWalkOutput;
+
+typedef struct FsWalkOps {
+    // Chamado uma vez por diretório, antes das entradas dele (opcional)
+    void (*visit_dir)(Directory *dir, const char *path, FsWalkOutput *out, void *ctx);
+    // Chamado para cada entrada do diretório, em ordem de nome (opcional)
+    void (*visit_entry)(Directory *dir, const char *path, TreeNode *entry, FsWalkOutput *out, void *ctx);
+} FsWalkOps;
+
+// Acrescenta texto formatado à saída do diretório
+void fs_walk_printf(FsWalkOutput *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Número de threads padrão: os núcleos disponíveis (até FS_WALK_MAX_THREADS)
+int fs_walk_default_threads(void);
+
+// Percorre a subárvore de 'root' ('path' é o caminho dele) com 'threads'
+// threads e escreve as saídas em 'fp'. Devolve quantos diretórios visitou.
+size_t fs_walk(Directory *root, const char *path, const FsWalkOps *ops, void *ctx, int threads, FILE *fp);
+
+#endif // FS_WALK_H
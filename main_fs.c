@@ -1,259 +1,1543 @@
+#define _GNU_SOURCE // ppoll
 #include "filesystem.h"
+#include "fs_image.h"
+#include "fs_journal.h"
+#include "fs_reclaim.h"
+#include "fs_walk.h"
+#include <fnmatch.h>
 #include <stdio.h>
-#include <string.h> 
-#include <stdbool.h> 
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
-#define MAX_CMD_LEN 100
-#define MAX_ARGS 3
+// Histograma de latência de cada comando: o balde i conta as execuções que
+// levaram de 2^(i-1) a 2^i - 1 ns (o balde 0 conta as de 0 ns)
+#define LATENCY_BUCKETS 40
+
+typedef struct CommandStats {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t buckets[LATENCY_BUCKETS];
+} CommandStats;
+
+// Buffers de entrada e saída do modo em lote (scripts e pipes)
+#define BATCH_INPUT_BUFFER (1 << 20)
+#define BATCH_OUTPUT_BUFFER (1 << 16)
+
+// Estado do interpretador de comandos
+typedef struct Shell {
+    FileSystem *fs;
+    Directory *current_dir;
+    bool interactive; // terminal: mostra o prompt e grava o journal a cada comando
+    bool running;
+    CommandStats *command_stats; // um por entrada da tabela de comandos
+    FILE *out; // saída dos comandos: stdout ou o socket da sessão
+    char **args; // argumentos da linha atual (ver tokenize)
+    int args_capacity;
+} Shell;
+
+typedef void (*CommandHandler)(Shell *shell, int argc, char **argv);
+
+typedef struct Command {
+    const char *name;
+    CommandHandler handler;
+    const char *usage;
+    const char *help;
+    bool exclusive; // no modo servidor, roda sozinho (percorre ou grava a árvore inteira)
+} Command;
 
 void print_prompt(Directory *current_dir)
 {
-    char *path = get_current_path(current_dir);
-    printf("fs:%s$ ", path);
-    free(path);
+    printf("fs:%s$ ", get_current_path(current_dir));
 }
 
-void save_fs_image(Directory *root, const char *filename);
-void save_node_to_image_recursive(FILE *fp, BTreeNode *node, int level);
+/* ============================================================================= */
+/* --- LEITURA DOS COMANDOS --- */
+/* ============================================================================= */
 
-int main()
+// Quebra a linha em argumentos, no próprio buffer. Espaços separam argumentos,
+// exceto entre aspas ("..." ou '...'); dentro de aspas duplas, \" e \\ viram
+// " e \. Uma linha que começa com '#' é comentário. Devolve a quantidade de
+// argumentos ou -1 se faltar fechar aspas.
+static int tokenize(char *line, char ***args, int *capacity)
 {
-    // A inicialização do diretório raiz pode ser simplificada
-    Directory *root = get_root_directory();
-    Directory *current_dir = root;
-
-    char cmd_line[MAX_CMD_LEN];
-    char *args[MAX_ARGS];
-    char *token;
+    int argc = 0;
+    char *src = line;
+    char *dst = line;
 
-    printf("Sistema de Arquivos Simples com Árvore B. Digite 'help' para ajuda.\n");
+    while (*src == ' ' || *src == '\t')
+        src++;
+    if (*src == '#')
+        return 0;
 
-    while (1)
+    while (*src)
     {
-        print_prompt(current_dir);
-        fgets(cmd_line, MAX_CMD_LEN, stdin);
-        cmd_line[strcspn(cmd_line, "\n")] = 0;
+        while (*src == ' ' || *src == '\t')
+            src++;
+        if (*src == '\0')
+            break;
 
-        int i = 0;
-        token = strtok(cmd_line, " ");
-        while (token != NULL && i < MAX_ARGS)
+        if (argc == *capacity)
         {
-            args[i++] = token;
-            token = strtok(NULL, " ");
+            *capacity = *capacity ? *capacity * 2 : 8;
+            *args = (char **)realloc(*args, *capacity * sizeof(char *));
         }
+        (*args)[argc++] = dst;
 
-        if (i == 0)
-            continue;
-
-        if (strcmp(args[0], "exit") == 0)
-        {
-            break;
-        }
-        else if (strcmp(args[0], "ls") == 0)
+        while (*src && *src != ' ' && *src != '\t')
         {
-            bool long_format = (i > 1 && strcmp(args[1], "-l") == 0);
-            list_directory_contents(current_dir, long_format);
-        }
-        else if (strcmp(args[0], "mkdir") == 0)
-        {
-            if (i < 2)
-            {
-                printf("mkdir: faltando operando\n");
-            }
-            else
+            if (*src == '"' || *src == '\'')
             {
-                if (btree_search(current_dir->tree, args[1]))
-                {
-                    printf("mkdir: não é possível criar o diretório '%s': Arquivo ou diretório já existe\n", args[1]);
-                }
-                else
+                char quote = *src++;
+                while (*src && *src != quote)
                 {
-                    TreeNode *new_dir_node = create_directory(args[1], current_dir);
-                    btree_insert(current_dir->tree, new_dir_node);
-                    update_parent_modification_time(current_dir);
+                    if (quote == '"' && *src == '\\' && (src[1] == '"' || src[1] == '\\'))
+                        src++;
+                    *dst++ = *src++;
                 }
-            }
-        }
-        else if (strcmp(args[0], "cd") == 0)
-        {
-            if (i < 2)
-            {
-                printf("cd: faltando operando\n");
+                if (*src != quote)
+                    return -1;
+                src++;
             }
             else
             {
-                change_directory(&current_dir, args[1]);
+                *dst++ = *src++;
             }
         }
-        else if (strcmp(args[0], "touch") == 0)
+        if (*src)
+            src++;
+        *dst++ = '\0';
+    }
+    return argc;
+}
+
+/* ============================================================================= */
+/* --- COMANDOS --- */
+/* ============================================================================= */
+
+// Argumentos comuns do ls e do count: filtros e diretório (ou diretório/glob).
+// A busca do diretório fica aberta (seção de leitura) até o path_lookup_free.
+typedef struct ListArgs {
+    ListFilter filter;
+    bool filtered;
+    bool long_format;
+    Directory *dir;
+    PathLookup lookup;
+} ListArgs;
+
+static bool parse_size(const char *text, size_t *value)
+{
+    char *end = NULL;
+    long long n = text ? strtoll(text, &end, 10) : -1;
+    if (!end || end == text || *end != '\0' || n < 0)
+        return false;
+    *value = (size_t)n;
+    return true;
+}
+
+// Lê as opções de filtro e resolve o diretório. 'paging' habilita as opções
+// só do ls (-l, --after, --limit e --offset). Mostra o erro e devolve false se
+// algo estiver errado. Chame path_lookup_free(&args->lookup) depois, nos dois
+// casos.
+static bool parse_list_args(Shell *shell, const char *cmd, int argc, char **argv, bool paging, ListArgs *args)
+{
+    memset(args, 0, sizeof(*args));
+    const char *path = NULL;
+    for (int a = 1; a < argc; a++)
+    {
+        const char **option = NULL;
+        size_t *number = NULL;
+        if (paging && strcmp(argv[a], "-l") == 0)
+            args->long_format = true;
+        else if (strcmp(argv[a], "--from") == 0)
+            option = &args->filter.from;
+        else if (strcmp(argv[a], "--to") == 0)
+            option = &args->filter.to;
+        else if (strcmp(argv[a], "--prefix") == 0)
+            option = &args->filter.prefix;
+        else if (paging && strcmp(argv[a], "--after") == 0)
+            option = &args->filter.after;
+        else if (paging && strcmp(argv[a], "--limit") == 0)
+            number = &args->filter.limit;
+        else if (paging && strcmp(argv[a], "--offset") == 0)
+            number = &args->filter.offset;
+        else
+            path = argv[a];
+
+        if (option || number)
         {
-            if (i < 2)
-            {
-                printf("touch: faltando operando. Uso: touch <arquivo.txt> [\"conteudo\"]\n");
-            }
-            else
+            if (++a == argc)
             {
-                if (strstr(args[1], ".txt") == NULL)
-                {
-                    printf("touch: O nome do arquivo deve terminar com .txt\n");
-                }
-                else if (btree_search(current_dir->tree, args[1]))
-                {
-                    printf("touch: não é possível criar o arquivo '%s': Arquivo ou diretório já existe\n", args[1]);
-                }
-                else
-                {
-                    char *content = (i > 2) ? args[2] : "";
-                    TreeNode *new_file_node = create_file(args[1], content);
-                    btree_insert(current_dir->tree, new_file_node);
-                    update_parent_modification_time(current_dir);
-                }
+                fprintf(shell->out, "%s: a opção '%s' precisa de um argumento\n", cmd, argv[a - 1]);
+                return false;
             }
-        }
-        else if (strcmp(args[0], "rm") == 0)
-        {
-            if (i < 2)
+            if (option)
             {
-                printf("rm: faltando operando. Uso: rm <arquivo.txt>\n");
+                *option = argv[a];
             }
-            else
+            else if (!parse_size(argv[a], number) || (number == &args->filter.limit && *number == 0))
             {
-                 if (strstr(args[1], ".txt") == NULL) {
-                    printf("rm: O alvo da remoção deve ser um arquivo .txt\n");
-                } else {
-                    TreeNode *node_to_delete = btree_search(current_dir->tree, args[1]);
-                    if (!node_to_delete)
-                    {
-                        printf("rm: não foi possível remover '%s': Arquivo não encontrado\n", args[1]);
-                    }
-                    else if (node_to_delete->type == DIRECTORY_TYPE)
-                    {
-                        printf("rm: não é possível remover '%s': É um diretório\n", args[1]);
-                    }
-                    else
-                    {
-                        btree_delete(current_dir->tree, args[1]);
-                        update_parent_modification_time(current_dir);
-                        printf("Arquivo '%s' removido.\n", args[1]);
-                    }
-                }
+                fprintf(shell->out, "%s: valor inválido para '%s': %s\n", cmd, argv[a - 1], argv[a]);
+                return false;
             }
+            args->filtered = true;
         }
-        else if (strcmp(args[0], "rmdir") == 0)
+    }
+
+    // Um glob no último componente filtra o diretório que o contém
+    char *dir_path = NULL;
+    const char *base = path ? strrchr(path, '/') : NULL;
+    base = base ? base + 1 : path;
+    if (base && strpbrk(base, "*?[") != NULL)
+    {
+        args->filter.pattern = base;
+        args->filtered = true;
+        if (base != path)
+            dir_path = strndup(path, base - path > 1 ? (size_t)(base - path - 1) : 1);
+    }
+    else
+    {
+        dir_path = path ? strdup(path) : NULL;
+    }
+
+    // Sem caminho, "." é o diretório atual
+    args->dir = path_lookup(shell->current_dir, dir_path ? dir_path : ".", &args->lookup, LOOKUP_READ) ? args->lookup.dir : NULL;
+    free(dir_path);
+    if (!args->dir)
+    {
+        fprintf(shell->out, "%s: não foi possível acessar '%s': Diretório não encontrado\n", cmd, path);
+        return false;
+    }
+    return true;
+}
+
+static void cmd_ls(Shell *shell, int argc, char **argv)
+{
+    ListArgs args;
+    if (parse_list_args(shell, "ls", argc, argv, true, &args) &&
+        list_directory_contents(shell->out, args.dir, args.long_format, args.filtered ? &args.filter : NULL) == 0 &&
+        args.filtered)
+        fprintf(shell->out, "ls: nenhuma entrada corresponde ao filtro\n");
+    path_lookup_free(&args.lookup);
+}
+
+static void cmd_count(Shell *shell, int argc, char **argv)
+{
+    ListArgs args;
+    if (parse_list_args(shell, "count", argc, argv, false, &args))
+        fprintf(shell->out, "%zu\n", directory_count(args.dir, args.filtered ? &args.filter : NULL));
+    path_lookup_free(&args.lookup);
+}
+
+// Diretório apontado por 'path' (o atual se for NULL); mostra o erro se não
+// houver. A busca fica em 'lookup' (chame path_lookup_free depois).
+static Directory *resolve_dir(Shell *shell, const char *cmd, const char *path, PathLookup *lookup)
+{
+    Directory *dir = path_lookup(shell->current_dir, path ? path : ".", lookup, LOOKUP_READ) ? lookup->dir : NULL;
+    if (!dir)
+        fprintf(shell->out, "%s: não foi possível acessar '%s': Diretório não encontrado\n", cmd, path);
+    return dir;
+}
+
+// Lê o argumento de -j (número de threads da travessia)
+static bool parse_threads(Shell *shell, const char *cmd, const char *text, int *threads)
+{
+    size_t n;
+    if (!parse_size(text, &n) || n == 0 || n > FS_WALK_MAX_THREADS)
+    {
+        fprintf(shell->out, "%s: -j precisa de um número entre 1 e %d\n", cmd, FS_WALK_MAX_THREADS);
+        return false;
+    }
+    *threads = (int)n;
+    return true;
+}
+
+// Contadores da verificação, somados pelas threads da travessia
+typedef struct VerifyStats {
+    uint64_t entries;
+    uint64_t problems;
+} VerifyStats;
+
+static void verify_visit_dir(Directory *dir, const char *path, FsWalkOutput *out, void *ctx)
+{
+    VerifyStats *stats = (VerifyStats *)ctx;
+    char msg[256];
+    if (!directory_check(dir, msg, sizeof(msg)))
+    {
+        fs_walk_printf(out, "du: %s: %s\n", path, msg);
+        __atomic_fetch_add(&stats->problems, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&stats->entries, btree_count(dir->tree), __ATOMIC_RELAXED);
+}
+
+static void cmd_du(Shell *shell, int argc, char **argv)
+{
+    bool all = false;
+    bool verify = false;
+    int threads = fs_walk_default_threads();
+    const char *path = NULL;
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-a") == 0)
+            all = true;
+        else if (strcmp(argv[a], "--verify") == 0)
+            verify = true;
+        else if (strcmp(argv[a], "-j") == 0)
         {
-            if (i < 2)
-            {
-                printf("rmdir: faltando operando\n");
-            }
-            else
-            {
-                TreeNode *node_to_delete = btree_search(current_dir->tree, args[1]);
-                if (!node_to_delete)
-                {
-                    printf("rmdir: não foi possível remover '%s': Arquivo ou diretório não encontrado\n", args[1]);
-                }
-                else if (node_to_delete->type == FILE_TYPE)
-                {
-                    printf("rmdir: não foi possível remover '%s': Não é um diretório\n", args[1]);
-                }
-                else if (node_to_delete->data.directory->tree->root->num_keys > 0)
-                {
-                    printf("rmdir: não foi possível remover '%s': Diretório não está vazio\n", args[1]);
-                }
-                else
-                {
-                    // A função btree_delete cuida de liberar o TreeNode.
-                    // A delete_directory_recursive libera a estrutura Directory.
-                    delete_directory_recursive(node_to_delete->data.directory);
-                    btree_delete(current_dir->tree, args[1]);
-                    update_parent_modification_time(current_dir);
-                }
-            }
+            if (!parse_threads(shell, "du", ++a < argc ? argv[a] : NULL, &threads))
+                return;
         }
-        else if (strcmp(args[0], "stat") == 0)
+        else
+            path = argv[a];
+    }
+
+    PathLookup lookup;
+    Directory *dir = resolve_dir(shell, "du", path, &lookup);
+    if (dir && verify)
+    {
+        // Confere cada diretório da subárvore em paralelo
+        FsWalkOps ops = {verify_visit_dir, NULL};
+        VerifyStats stats = {0, 0};
+        size_t dirs = fs_walk(dir, get_current_path(dir), &ops, &stats, threads, shell->out);
+        fprintf(shell->out, "du: %zu diretório(s) e %llu entrada(s) verificados com %d thread(s): %llu problema(s)\n",
+               dirs, (unsigned long long)stats.entries, threads, (unsigned long long)stats.problems);
+    }
+    if (dir)
+        show_disk_usage(shell->out, dir, all);
+    path_lookup_free(&lookup);
+}
+
+// Critérios do find
+typedef struct FindArgs {
+    const char *pattern; // -name (glob no nome)
+    int type;            // -type: FILE_TYPE, DIRECTORY_TYPE ou -1 para ambos
+} FindArgs;
+
+static void find_visit_entry(Directory *dir, const char *path, TreeNode *entry, FsWalkOutput *out, void *ctx)
+{
+    (void)dir;
+    const FindArgs *args = (const FindArgs *)ctx;
+    if (args->type >= 0 && (int)entry->type != args->type)
+        return;
+    if (args->pattern && fnmatch(args->pattern, tree_node_name(entry), 0) != 0)
+        return;
+    fs_walk_printf(out, "%s%s%s%s\n", path, strcmp(path, "/") == 0 ? "" : "/", tree_node_name(entry),
+                   entry->type == DIRECTORY_TYPE ? "/" : "");
+}
+
+static void cmd_find(Shell *shell, int argc, char **argv)
+{
+    FindArgs args = {NULL, -1};
+    int threads = fs_walk_default_threads();
+    const char *path = NULL;
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-name") == 0 || strcmp(argv[a], "-type") == 0 || strcmp(argv[a], "-j") == 0)
         {
-            if (i < 2)
+            const char *option = argv[a];
+            if (++a == argc)
             {
-                printf("stat: faltando operando\n");
+                fprintf(shell->out, "find: a opção '%s' precisa de um argumento\n", option);
+                return;
             }
-            else
+            if (option[1] == 'n')
             {
-                show_metadata(current_dir, args[1]);
+                args.pattern = argv[a];
             }
-        }
-        else if (strcmp(args[0], "save") == 0)
-        {
-            if (i < 2)
+            else if (option[1] == 't')
             {
-                printf("save: especifique o nome do arquivo (ex: save fs.img)\n");
+                if (strcmp(argv[a], "f") != 0 && strcmp(argv[a], "d") != 0)
+                {
+                    fprintf(shell->out, "find: -type aceita 'f' ou 'd'\n");
+                    return;
+                }
+                args.type = (argv[a][0] == 'f') ? FILE_TYPE : DIRECTORY_TYPE;
             }
-            else
+            else if (!parse_threads(shell, "find", argv[a], &threads))
             {
-                save_fs_image(current_dir, args[1]);
-                printf("Sistema de arquivos salvo em %s\n", args[1]);
+                return;
             }
         }
-        else if (strcmp(args[0], "help") == 0)
+        else
         {
-            printf("Comandos disponíveis:\n");
-            printf("  ls              - Lista o conteúdo do diretório atual\n");
-            printf("  ls -l           - Lista com detalhes (metadados de tempo)\n");
-            printf("  cd <dir>        - Muda para o diretório <dir>\n");
-            printf("  mkdir <dir>     - Cria um novo diretório chamado <dir>\n");
-            printf("  rmdir <dir>     - Remove o diretório vazio <dir>\n");
-            printf("  touch <arq.txt> - Cria um arquivo de texto vazio\n");
-            printf("  touch <arq.txt> \"conteudo\" - Cria um arquivo de texto com conteúdo\n");
-            printf("  rm <arq.txt>      - Remove o arquivo de texto\n");
-            printf("  stat <item>     - Exibe todos os metadados de um arquivo ou diretório\n");
-            printf("  save <img_file> - Salva uma imagem do FS no arquivo\n");
-            printf("  exit            - Sai do programa\n");
+            path = argv[a];
         }
+    }
+
+    PathLookup lookup;
+    Directory *dir = resolve_dir(shell, "find", path, &lookup);
+    if (dir)
+    {
+        FsWalkOps ops = {NULL, find_visit_entry};
+        fs_walk(dir, get_current_path(dir), &ops, &args, threads, shell->out);
+    }
+    path_lookup_free(&lookup);
+}
+
+static void cmd_cd(Shell *shell, int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(shell->out, "cd: faltando operando\n");
+        return;
+    }
+    change_directory(shell->out, &shell->current_dir, argv[1]);
+}
+
+static void cmd_mkdir(Shell *shell, int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(shell->out, "mkdir: faltando operando\n");
+        return;
+    }
+
+    PathLookup lookup;
+    if (!path_lookup(shell->current_dir, argv[1], &lookup, LOOKUP_WRITE))
+    {
+        fprintf(shell->out, "mkdir: não é possível criar o diretório '%s': Arquivo ou diretório não encontrado\n", argv[1]);
+    }
+    else if (!lookup.name || lookup.node)
+    {
+        fprintf(shell->out, "mkdir: não é possível criar o diretório '%s': Arquivo ou diretório já existe\n", argv[1]);
+    }
+    else
+    {
+        TreeNode *new_dir_node = create_directory(lookup.name, lookup.parent);
+        directory_add_entry(lookup.parent, new_dir_node);
+        update_parent_modification_time(lookup.parent);
+    }
+    path_lookup_free(&lookup);
+}
+
+static void cmd_rmdir(Shell *shell, int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(shell->out, "rmdir: faltando operando\n");
+        return;
+    }
+
+    PathLookup lookup;
+    bool found = path_lookup(shell->current_dir, argv[1], &lookup, LOOKUP_WRITE);
+    // Com o pai travado para escrita, trava também o diretório a remover, para
+    // que nada seja criado nele entre a verificação e a remoção
+    Directory *target = (found && lookup.name) ? lookup.dir : NULL;
+    if (target)
+        directory_lock(target);
+    if (!found || !lookup.node)
+    {
+        fprintf(shell->out, "rmdir: não foi possível remover '%s': Arquivo ou diretório não encontrado\n", argv[1]);
+    }
+    else if (lookup.node->type == FILE_TYPE)
+    {
+        fprintf(shell->out, "rmdir: não foi possível remover '%s': Não é um diretório\n", argv[1]);
+    }
+    else if (lookup.dir->tree->root->num_keys > 0)
+    {
+        fprintf(shell->out, "rmdir: não foi possível remover '%s': Diretório não está vazio\n", argv[1]);
+    }
+    else if (!lookup.name || lookup.dir == shell->current_dir)
+    {
+        fprintf(shell->out, "rmdir: não foi possível remover '%s': É o diretório atual\n", argv[1]);
+    }
+    else if (!directory_mark_removed(lookup.dir))
+    {
+        fprintf(shell->out, "rmdir: não foi possível remover '%s': Dispositivo ou recurso ocupado\n", argv[1]);
+    }
+    else
+    {
+        // A remoção libera o TreeNode e a estrutura Directory (e a trava dele);
+        // no modo concorrente, só depois que os leitores que a viram saírem
+        directory_unlock(target);
+        target = NULL;
+        directory_remove_entry(lookup.parent, lookup.name);
+        update_parent_modification_time(lookup.parent);
+    }
+    if (target)
+        directory_unlock(target);
+    path_lookup_free(&lookup);
+}
+
+static void cmd_touch(Shell *shell, int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(shell->out, "touch: faltando operando. Uso: touch <arquivo.txt> [\"conteudo\"]\n");
+        return;
+    }
+
+    PathLookup lookup;
+    bool found = path_lookup(shell->current_dir, argv[1], &lookup, LOOKUP_WRITE);
+    if (!lookup.name || strstr(lookup.name, ".txt") == NULL)
+    {
+        fprintf(shell->out, "touch: O nome do arquivo deve terminar com .txt\n");
+    }
+    else if (!found)
+    {
+        fprintf(shell->out, "touch: não é possível criar o arquivo '%s': Arquivo ou diretório não encontrado\n", argv[1]);
+    }
+    else if (lookup.node)
+    {
+        fprintf(shell->out, "touch: não é possível criar o arquivo '%s': Arquivo ou diretório já existe\n", argv[1]);
+    }
+    else
+    {
+        const char *content = (argc > 2) ? argv[2] : "";
+        TreeNode *new_file_node = create_txt_file(lookup.name, content, lookup.parent);
+        directory_add_entry(lookup.parent, new_file_node);
+        update_parent_modification_time(lookup.parent);
+    }
+    path_lookup_free(&lookup);
+}
+
+// rm -r de um diretório: com o pai travado, trava o alvo para marcá-lo como
+// removido (o que falha se alguma sessão estiver dentro dele) e o tira do pai
+// de uma vez; o conteúdo é liberado em segundo plano
+static void remove_tree(Shell *shell, PathLookup *lookup, const char *path)
+{
+    Directory *target = lookup->dir;
+    if (!lookup->name)
+    {
+        fprintf(shell->out, "rm: não é possível remover '%s': '.' e '..' não podem ser removidos\n", path);
+        return;
+    }
+    if (directory_contains(target, shell->current_dir))
+    {
+        fprintf(shell->out, "rm: não é possível remover '%s': Contém o diretório atual\n", path);
+        return;
+    }
+    directory_lock(target);
+    bool removed = directory_mark_removed(target);
+    directory_unlock(target);
+    if (!removed)
+    {
+        fprintf(shell->out, "rm: não é possível remover '%s': Dispositivo ou recurso ocupado\n", path);
+        return;
+    }
+    unsigned long long files = __atomic_load_n(&target->totals.files, __ATOMIC_RELAXED);
+    unsigned long long dirs = __atomic_load_n(&target->totals.dirs, __ATOMIC_RELAXED);
+    directory_remove_tree(lookup->parent, lookup->name);
+    update_parent_modification_time(lookup->parent);
+    fprintf(shell->out, "Diretório '%s' removido (%llu arquivo(s), %llu subdiretório(s)).\n", path, files, dirs);
+}
+
+static void cmd_rm(Shell *shell, int argc, char **argv)
+{
+    bool recursive = argc > 1 && strcmp(argv[1], "-r") == 0;
+    if (recursive)
+    {
+        argc--;
+        argv++;
+    }
+    if (argc < 2)
+    {
+        fprintf(shell->out, "rm: faltando operando. Uso: rm [-r] <arquivo.txt | dir>\n");
+        return;
+    }
+
+    PathLookup lookup;
+    bool found = path_lookup(shell->current_dir, argv[1], &lookup, LOOKUP_WRITE);
+    if (found && !lookup.node && lookup.dir == shell->fs->root)
+    {
+        fprintf(shell->out, "rm: não é possível remover '%s': É o diretório raiz\n", argv[1]);
+    }
+    else if (lookup.node && lookup.node->type == DIRECTORY_TYPE && recursive)
+    {
+        remove_tree(shell, &lookup, argv[1]);
+    }
+    else if (lookup.node && lookup.node->type == DIRECTORY_TYPE)
+    {
+        fprintf(shell->out, "rm: não é possível remover '%s': É um diretório\n", argv[1]);
+    }
+    else if (recursive && !lookup.node)
+    {
+        fprintf(shell->out, "rm: não foi possível remover '%s': Arquivo ou diretório não encontrado\n", argv[1]);
+    }
+    else if (!lookup.name || strstr(lookup.name, ".txt") == NULL)
+    {
+        fprintf(shell->out, "rm: O alvo da remoção deve ser um arquivo .txt\n");
+    }
+    else if (!found || !lookup.node)
+    {
+        fprintf(shell->out, "rm: não foi possível remover '%s': Arquivo não encontrado\n", argv[1]);
+    }
+    else
+    {
+        directory_remove_entry(lookup.parent, lookup.name);
+        update_parent_modification_time(lookup.parent);
+        fprintf(shell->out, "Arquivo '%s' removido.\n", argv[1]);
+    }
+    path_lookup_free(&lookup);
+}
+
+static void cmd_cat(Shell *shell, int argc, char **argv)
+{
+    size_t offset = 0, len = SIZE_MAX;
+    if (argc < 2)
+    {
+        fprintf(shell->out, "cat: faltando operando. Uso: cat <arquivo.txt> [deslocamento [tamanho]]\n");
+        return;
+    }
+    if ((argc > 2 && !parse_size(argv[2], &offset)) || (argc > 3 && !parse_size(argv[3], &len)))
+    {
+        fprintf(shell->out, "cat: deslocamento e tamanho devem ser números não negativos\n");
+        return;
+    }
+
+    // No modo concorrente, a leitura não trava nada: quem escreve não mexe nos
+    // blocos que ela pode estar vendo
+    PathLookup lookup;
+    TreeNode *node = path_lookup(shell->current_dir, argv[1], &lookup, LOOKUP_READ) ? lookup.node : NULL;
+    if (!node)
+    {
+        fprintf(shell->out, "cat: '%s': Arquivo não encontrado\n", argv[1]);
+    }
+    else if (node->type == DIRECTORY_TYPE)
+    {
+        fprintf(shell->out, "cat: '%s': É um diretório\n", argv[1]);
+    }
+    else
+    {
+        size_t n = file_print(shell->out, node->data.file, offset, len);
+        char last = '\n';
+        if (n > 0)
+            file_read(node->data.file, offset + n - 1, 1, &last);
+        if (last != '\n')
+            fputc('\n', shell->out);
+        node_touch_atime(shell->fs, node);
+    }
+    path_lookup_free(&lookup);
+}
+
+static void cmd_write(Shell *shell, int argc, char **argv)
+{
+    size_t offset = 0;
+    if (argc < 4)
+    {
+        fprintf(shell->out, "write: faltando operando. Uso: write <arquivo.txt> <deslocamento> <dados>\n");
+        return;
+    }
+    if (!parse_size(argv[2], &offset))
+    {
+        fprintf(shell->out, "write: deslocamento inválido: %s\n", argv[2]);
+        return;
+    }
+
+    PathLookup lookup;
+    TreeNode *node = path_lookup(shell->current_dir, argv[1], &lookup, LOOKUP_WRITE) ? lookup.node : NULL;
+    if (!node)
+    {
+        fprintf(shell->out, "write: '%s': Arquivo não encontrado\n", argv[1]);
+    }
+    else if (node->type == DIRECTORY_TYPE)
+    {
+        fprintf(shell->out, "write: '%s': É um diretório\n", argv[1]);
+    }
+    else if (!directory_file_write(lookup.parent, node, offset, argv[3], strlen(argv[3])))
+    {
+        fprintf(shell->out, "write: deslocamento %zu além do fim de '%s' (%zu bytes)\n", offset, argv[1],
+                file_size(node->data.file));
+    }
+    path_lookup_free(&lookup);
+}
+
+// echo <dados ...> [>> arquivo.txt]: mostra os dados ou os acrescenta (com
+// uma quebra de linha) no fim do arquivo, que é criado se não existir
+static void cmd_echo(Shell *shell, int argc, char **argv)
+{
+    int words = argc;
+    const char *path = NULL;
+    if (argc >= 3 && strcmp(argv[argc - 2], ">>") == 0)
+    {
+        words = argc - 2;
+        path = argv[argc - 1];
+    }
+
+    size_t len = 0;
+    for (int a = 1; a < words; a++)
+        len += strlen(argv[a]) + 1;
+    // sem palavras, ainda vai a quebra de linha e o '\0' (2 bytes)
+    char *data = (char *)malloc(len + 2);
+    char *p = data;
+    for (int a = 1; a < words; a++)
+        p += sprintf(p, a + 1 < words ? "%s " : "%s\n", argv[a]);
+    if (words == 1)
+        p += sprintf(p, "\n");
+    len = (size_t)(p - data);
+
+    if (!path)
+    {
+        fwrite(data, 1, len, shell->out);
+        free(data);
+        return;
+    }
+
+    PathLookup lookup;
+    bool found = path_lookup(shell->current_dir, path, &lookup, LOOKUP_WRITE);
+    if (lookup.node && lookup.node->type == DIRECTORY_TYPE)
+    {
+        fprintf(shell->out, "echo: '%s': É um diretório\n", path);
+    }
+    else if (lookup.node)
+    {
+        directory_file_write(lookup.parent, lookup.node, file_size(lookup.node->data.file), data, len);
+    }
+    else if (!lookup.name || strstr(lookup.name, ".txt") == NULL)
+    {
+        fprintf(shell->out, "echo: O nome do arquivo deve terminar com .txt\n");
+    }
+    else if (!found)
+    {
+        fprintf(shell->out, "echo: não é possível criar o arquivo '%s': Arquivo ou diretório não encontrado\n", path);
+    }
+    else
+    {
+        directory_add_entry(lookup.parent, create_txt_file(lookup.name, data, lookup.parent));
+        update_parent_modification_time(lookup.parent);
+    }
+    path_lookup_free(&lookup);
+    free(data);
+}
+
+// Copia 'src' (já resolvido) para o caminho 'dest' a partir de 'from', que não
+// pode existir. A cópia divide com a origem os nós das Árvores B e os blocos
+// dos arquivos.
+static void copy_entry(Shell *shell, const char *cmd, TreeNode *src, Directory *src_dir, Directory *from,
+                       const char *dest)
+{
+    PathLookup lookup;
+    bool found = path_lookup(from, dest, &lookup, LOOKUP_WRITE);
+    if (!found)
+    {
+        fprintf(shell->out, "%s: não é possível criar '%s': Arquivo ou diretório não encontrado\n", cmd, dest);
+    }
+    else if (!lookup.name || lookup.node)
+    {
+        fprintf(shell->out, "%s: não é possível criar '%s': Arquivo ou diretório já existe\n", cmd, dest);
+    }
+    else if (!src_dir && strstr(lookup.name, ".txt") == NULL)
+    {
+        fprintf(shell->out, "%s: O nome do arquivo deve terminar com .txt\n", cmd);
+    }
+    else
+    {
+        if (src_dir)
+            directory_add_clone(lookup.parent, lookup.name, src_dir);
         else
+            directory_add_entry(lookup.parent, copy_txt_file(src, lookup.name, lookup.parent));
+        update_parent_modification_time(lookup.parent);
+    }
+    path_lookup_free(&lookup);
+}
+
+// snapshot <dir> <nome>: cópia do diretório no estado atual, ao lado dele (no
+// mesmo pai), em tempo proporcional aos subdiretórios (não às entradas)
+static void cmd_snapshot(Shell *shell, int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(shell->out, "snapshot: faltando operando. Uso: snapshot <dir> <nome>\n");
+        return;
+    }
+    PathLookup lookup;
+    Directory *src = path_lookup(shell->current_dir, argv[1], &lookup, LOOKUP_READ) ? lookup.dir : NULL;
+    if (!src)
+        fprintf(shell->out, "snapshot: '%s': Diretório não encontrado\n", argv[1]);
+    else if (!src->parent)
+        fprintf(shell->out, "snapshot: '%s': A raiz não tem um diretório pai para a cópia\n", argv[1]);
+    else if (strchr(argv[2], '/'))
+        fprintf(shell->out, "snapshot: '%s': O nome da cópia não pode conter '/'\n", argv[2]);
+    else
+        copy_entry(shell, "snapshot", NULL, src, src->parent, argv[2]);
+    path_lookup_free(&lookup);
+}
+
+// Se 'dest' é um diretório, o caminho de 'base' dentro dele (alocado com
+// malloc); senão NULL
+static char *path_inside_dir(Shell *shell, const char *dest, const char *base)
+{
+    char *inside = NULL;
+    PathLookup target;
+    if (path_lookup(shell->current_dir, dest, &target, LOOKUP_READ) && target.dir && base)
+    {
+        size_t len = strlen(dest) + strlen(base) + 2;
+        inside = (char *)malloc(len);
+        snprintf(inside, len, "%s%s%s", dest, dest[strlen(dest) - 1] == '/' ? "" : "/", base);
+    }
+    path_lookup_free(&target);
+    return inside;
+}
+
+// cp [-r] <origem> <destino>: se o destino é um diretório, a cópia entra nele
+// com o nome da origem
+static void cmd_cp(Shell *shell, int argc, char **argv)
+{
+    bool recursive = false;
+    const char *paths[2] = {NULL, NULL};
+    int count = 0;
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-r") == 0 || strcmp(argv[a], "-R") == 0)
+            recursive = true;
+        else if (count < 2)
+            paths[count++] = argv[a];
+    }
+    if (count < 2)
+    {
+        fprintf(shell->out, "cp: faltando operando. Uso: cp [-r] <origem> <destino>\n");
+        return;
+    }
+
+    PathLookup lookup;
+    TreeNode *src = NULL;
+    Directory *src_dir = NULL;
+    if (path_lookup(shell->current_dir, paths[0], &lookup, LOOKUP_READ))
+    {
+        src = lookup.node;
+        src_dir = lookup.dir;
+    }
+    if (!src && !src_dir)
+    {
+        fprintf(shell->out, "cp: '%s': Arquivo ou diretório não encontrado\n", paths[0]);
+    }
+    else if (src_dir && !recursive)
+    {
+        fprintf(shell->out, "cp: -r não especificado; omitindo o diretório '%s'\n", paths[0]);
+    }
+    else
+    {
+        // Destino que já é um diretório: a cópia vai para dentro dele
+        const char *base = src ? tree_node_name(src) : src_dir->node ? tree_node_name(src_dir->node) : NULL;
+        char *inside = path_inside_dir(shell, paths[1], base);
+        copy_entry(shell, "cp", src_dir ? NULL : src, src_dir, shell->current_dir, inside ? inside : paths[1]);
+        free(inside);
+    }
+    path_lookup_free(&lookup);
+}
+
+// ln <arq.txt> <destino>: mais um nome para o mesmo arquivo (mesmo inode e
+// mesmo conteúdo; uma escrita por um nome aparece pelos outros). Se o destino
+// é um diretório, o nome novo entra nele com o nome da origem.
+static void cmd_ln(Shell *shell, int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(shell->out, "ln: faltando operando. Uso: ln <arq.txt> <destino>\n");
+        return;
+    }
+    PathLookup lookup;
+    TreeNode *src = path_lookup(shell->current_dir, argv[1], &lookup, LOOKUP_READ) ? lookup.node : NULL;
+    if (!src && !lookup.dir)
+    {
+        fprintf(shell->out, "ln: '%s': Arquivo ou diretório não encontrado\n", argv[1]);
+        path_lookup_free(&lookup);
+        return;
+    }
+    if (!src || src->type != FILE_TYPE)
+    {
+        fprintf(shell->out, "ln: '%s': ligações para diretórios não são permitidas\n", argv[1]);
+        path_lookup_free(&lookup);
+        return;
+    }
+
+    char *inside = path_inside_dir(shell, argv[2], tree_node_name(src));
+    const char *dest = inside ? inside : argv[2];
+    PathLookup target;
+    bool found = path_lookup(shell->current_dir, dest, &target, LOOKUP_WRITE);
+    if (!found)
+        fprintf(shell->out, "ln: não é possível criar '%s': Arquivo ou diretório não encontrado\n", dest);
+    else if (!target.name || target.node)
+        fprintf(shell->out, "ln: não é possível criar '%s': Arquivo ou diretório já existe\n", dest);
+    else if (strstr(target.name, ".txt") == NULL)
+        fprintf(shell->out, "ln: O nome do arquivo deve terminar com .txt\n");
+    else
+    {
+        directory_add_link(target.parent, target.name, lookup.parent, src);
+        update_parent_modification_time(target.parent);
+    }
+    path_lookup_free(&target);
+    free(inside);
+    path_lookup_free(&lookup);
+}
+
+// stat <item> | stat -i <inode>
+static void cmd_stat(Shell *shell, int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "-i") == 0)
+    {
+        char *end = NULL;
+        unsigned long long ino = (argc >= 3) ? strtoull(argv[2], &end, 10) : 0;
+        if (argc < 3 || *end != '\0' || end == argv[2])
+            fprintf(shell->out, "stat: -i precisa de um número de inode\n");
+        else if (!show_inode_metadata(shell->out, shell->fs, ino))
+            fprintf(shell->out, "stat: inode %llu não encontrado\n", ino);
+        return;
+    }
+    if (argc < 2)
+    {
+        fprintf(shell->out, "stat: faltando operando\n");
+        return;
+    }
+    show_metadata(shell->out, shell->current_dir, argv[1]);
+}
+
+static void cmd_save(Shell *shell, int argc, char **argv)
+{
+    bool compress = argc > 1 && strcmp(argv[1], "-z") == 0;
+    const char *filename = argc > (compress ? 2 : 1) ? argv[compress ? 2 : 1] : NULL;
+    if (!filename)
+    {
+        fprintf(shell->out, "save: especifique o nome do arquivo (ex: save fs.img)\n");
+        return;
+    }
+    if (fs_image_save(shell->fs->root, filename, compress) == 0)
+        fprintf(shell->out, "Sistema de arquivos salvo em %s%s\n", filename, compress ? " (comprimido)" : "");
+}
+
+static void cmd_load(Shell *shell, int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(shell->out, "load: especifique o nome do arquivo (ex: load fs.img)\n");
+        return;
+    }
+    // As outras sessões estão usando diretórios do sistema de arquivos atual
+    if (shell->fs->concurrent)
+    {
+        fprintf(shell->out, "load: não disponível no modo servidor\n");
+        return;
+    }
+    FileSystem *loaded = fs_image_load(argv[1]);
+    if (loaded)
+    {
+        fs_journal_move(shell->fs, loaded);
+        loaded->atime_policy = shell->fs->atime_policy;
+        fs_destroy(shell->fs);
+        shell->fs = loaded;
+        shell->current_dir = loaded->root;
+        fprintf(shell->out, "Sistema de arquivos carregado de %s\n", argv[1]);
+    }
+}
+
+static void cmd_dcache(Shell *shell, int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    // As outras sessões continuam contando enquanto isso (ver dcache_count)
+    DentryCache *cache = &shell->fs->dcache;
+    uint64_t hits = __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+    uint64_t misses = __atomic_load_n(&cache->misses, __ATOMIC_RELAXED);
+    uint64_t invalidations = __atomic_load_n(&cache->invalidations, __ATOMIC_RELAXED);
+    uint64_t lookups = hits + misses;
+    fprintf(shell->out, "Cache de entradas: %llu buscas, %llu acertos (%.1f%%), %llu faltas, %llu invalidações\n",
+           (unsigned long long)lookups, (unsigned long long)hits, lookups ? 100.0 * hits / lookups : 0.0,
+           (unsigned long long)misses, (unsigned long long)invalidations);
+}
+
+static void cmd_atime(Shell *shell, int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        AtimePolicy policy;
+        if (!fs_parse_atime_policy(argv[1], &policy))
         {
-            printf("Comando não encontrado: %s\n", args[0]);
+            fprintf(shell->out, "atime: política desconhecida: %s (use strict, relatime ou noatime)\n", argv[1]);
+            return;
         }
+        __atomic_store_n(&shell->fs->atime_policy, policy, __ATOMIC_RELAXED);
     }
+    fprintf(shell->out, "Data de acesso: %s\n", fs_atime_policy_name(__atomic_load_n(&shell->fs->atime_policy, __ATOMIC_RELAXED)));
+}
 
-    // A limpeza da memória é feita aqui, depois que o loop termina.
-    delete_directory_recursive(root);
-    printf("Saindo...\n");
+static void cmd_checkpoint(Shell *shell, int argc, char **argv)
+{
+    if (!shell->fs->journal)
+    {
+        fprintf(shell->out, "checkpoint: persistência desligada (inicie com -d <diretório>)\n");
+        return;
+    }
+    int dirs = fs_journal_checkpoint(shell->fs->journal, argc > 1 && strcmp(argv[1], "--full") == 0);
+    if (dirs >= 0)
+        fprintf(shell->out, "Checkpoint gravado: %d diretório(s)\n", dirs);
+}
 
-    return 0;
+static void cmd_exit(Shell *shell, int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    shell->running = false;
+}
+
+static void cmd_help(Shell *shell, int argc, char **argv);
+static void cmd_stats(Shell *shell, int argc, char **argv);
+
+// Tabela de comandos, na ordem em que aparecem no 'help'. Os marcados como
+// exclusivos percorrem ou gravam a árvore inteira sem as travas de cada
+// diretório: no modo servidor, rodam com a trava global exclusiva.
+static const Command commands[] = {
+    {"ls", cmd_ls, "ls [-l] [--prefix p] [--from a] [--to b] [--after n] [--offset k] [--limit k] [dir | dir/glob]", "Lista o conteúdo do diretório atual (ou de <dir>); -l mostra as datas. Filtra por prefixo, intervalo [a, b) ou glob (*, ?, [...]); --limit, --after e --offset paginam", false},
+    {"count", cmd_count, "count [--prefix p] [--from a] [--to b] [dir | dir/glob]", "Conta as entradas do diretório (com os mesmos filtros do ls) sem listá-las", false},
+    {"cd", cmd_cd, "cd <dir>", "Muda para o diretório <dir>", false},
+    {"mkdir", cmd_mkdir, "mkdir <dir>", "Cria um novo diretório chamado <dir>", false},
+    {"rmdir", cmd_rmdir, "rmdir <dir>", "Remove o diretório vazio <dir>", false},
+    {"touch", cmd_touch, "touch <arq.txt> [\"conteudo\"]", "Cria um arquivo de texto, vazio ou com conteúdo", false},
+    {"rm", cmd_rm, "rm [-r] <arq.txt | dir>", "Remove o arquivo de texto; com -r, também o diretório com tudo o que está dentro (liberado em segundo plano)", false},
+    {"cat", cmd_cat, "cat <arq.txt> [desloc [tam]]", "Mostra o conteúdo do arquivo (ou só 'tam' bytes a partir de 'desloc')", false},
+    {"write", cmd_write, "write <arq.txt> <desloc> <dados>", "Escreve os dados no arquivo a partir de 'desloc' (no máximo o tamanho: aí acrescenta no fim)", false},
+    {"echo", cmd_echo, "echo <dados> [>> arq.txt]", "Mostra os dados ou os acrescenta numa linha nova no fim do arquivo (criado se não existir)", false},
+    {"cp", cmd_cp, "cp [-r] <origem> <destino>", "Copia o arquivo (ou, com -r, o diretório); a cópia divide o conteúdo com a origem até um dos lados mudar", true},
+    {"snapshot", cmd_snapshot, "snapshot <dir> <nome>", "Cria <nome>, ao lado de <dir>, com o conteúdo atual dele, sem copiar as entradas", true},
+    {"ln", cmd_ln, "ln <arq.txt> <destino>", "Cria mais um nome (ligação) para o arquivo: mesmo inode e mesmo conteúdo", true},
+    {"stat", cmd_stat, "stat <item> | stat -i <inode>", "Exibe todos os metadados de um arquivo ou diretório (com -i, achado pelo número do inode)", false},
+    {"save", cmd_save, "save [-z] <img_file>", "Salva uma imagem binária do FS (nomes, conteúdos e datas); -z comprime as seções", true},
+    {"load", cmd_load, "load <img_file>", "Carrega uma imagem salva com 'save', substituindo o FS atual", true},
+    {"dcache", cmd_dcache, "dcache", "Mostra os acertos do cache de entradas", false},
+    {"du", cmd_du, "du [-a] [--verify [-j n]] [dir]", "Total de bytes, arquivos e subdiretórios abaixo do diretório; -a mostra também o de cada entrada; --verify confere a subárvore em paralelo", false},
+    {"find", cmd_find, "find [dir] [-name padrão] [-type f|d] [-j n]", "Procura entradas na subárvore, em paralelo; a saída sai sempre na mesma ordem", true},
+    {"stats", cmd_stats, "stats [-r] [dir]", "Forma das Árvores B do diretório (-r: da subárvore) e latência dos comandos", true},
+    {"atime", cmd_atime, "atime [strict|relatime|noatime]", "Mostra ou troca quando ls, cd, stat e cat atualizam a data de acesso", false},
+    {"checkpoint", cmd_checkpoint, "checkpoint [--full]", "Grava os diretórios alterados e zera o journal (com -d)", true},
+    {"help", cmd_help, "help", "Mostra esta ajuda", false},
+    {"exit", cmd_exit, "exit", "Sai do programa (no modo servidor, encerra a sessão)", false},
+};
+
+#define COMMAND_COUNT (sizeof(commands) / sizeof(commands[0]))
+
+static void cmd_help(Shell *shell, int argc, char **argv)
+{
+    (void)shell;
+    (void)argc;
+    (void)argv;
+    fprintf(shell->out, "Comandos disponíveis:\n");
+    for (size_t c = 0; c < COMMAND_COUNT; c++)
+        fprintf(shell->out, "  %-28s - %s\n", commands[c].usage, commands[c].help);
+    fprintf(shell->out, "Os comandos aceitam caminhos absolutos ou relativos (ex: cd /a/b, stat ../x/y.txt)\n");
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
 
-void save_node_to_image_recursive(FILE *fp, BTreeNode *node, int level)
+static void record_latency(CommandStats *stats, uint64_t ns)
 {
-    if (node)
+    int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if (bucket >= LATENCY_BUCKETS)
+        bucket = LATENCY_BUCKETS - 1;
+    stats->buckets[bucket]++;
+    stats->count++;
+    stats->total_ns += ns;
+}
+
+static void format_ns(double ns, char *buf, size_t size)
+{
+    if (ns < 1e3)
+        snprintf(buf, size, "%.0fns", ns);
+    else if (ns < 1e6)
+        snprintf(buf, size, "%.1fµs", ns / 1e3);
+    else if (ns < 1e9)
+        snprintf(buf, size, "%.1fms", ns / 1e6);
+    else
+        snprintf(buf, size, "%.1fs", ns / 1e9);
+}
+
+static void cmd_stats(Shell *shell, int argc, char **argv)
+{
+    bool recursive = false;
+    const char *path = NULL;
+    for (int a = 1; a < argc; a++)
     {
-        for (int i = 0; i < node->num_keys; ++i)
-        {
-            for (int j = 0; j < level; ++j)
-                fprintf(fp, "  "); 
+        if (strcmp(argv[a], "-r") == 0)
+            recursive = true;
+        else
+            path = argv[a];
+    }
 
-            fprintf(fp, "|-- %s%s\n", node->keys[i]->name, node->keys[i]->type == DIRECTORY_TYPE ? "/" : "");
+    PathLookup lookup;
+    Directory *dir = path_lookup(shell->current_dir, path ? path : ".", &lookup, LOOKUP_READ) ? lookup.dir : NULL;
+    if (!dir)
+    {
+        fprintf(shell->out, "stats: diretório não encontrado: %s\n", path);
+        path_lookup_free(&lookup);
+        return;
+    }
 
-            if (node->keys[i]->type == DIRECTORY_TYPE)
-            {
-                if (node->keys[i]->data.directory->tree) {
-                    save_node_to_image_recursive(fp, node->keys[i]->data.directory->tree->root, level + 1);
-                }
-            }
+    DirectoryStats stats;
+    directory_stats(dir, recursive, &stats);
+    size_t capacity = stats.tree.nodes * BTREE_MAX_KEYS;
+    fprintf(shell->out, "Árvores B de %s (%zu diretório(s), ordem %d):\n", get_current_path(dir), stats.directories, BTREE_ORDER);
+    fprintf(shell->out, "  altura: %d  nós: %zu (%zu folhas)  chaves: %zu  ocupação: %.1f%%\n",
+           stats.tree.height, stats.tree.nodes, stats.tree.leaves, stats.tree.keys,
+           capacity ? 100.0 * stats.tree.keys / capacity : 0.0);
+    fprintf(shell->out, "  splits: %llu  merges: %llu  empréstimos: %llu\n",
+           (unsigned long long)stats.tree.splits, (unsigned long long)stats.tree.merges,
+           (unsigned long long)stats.tree.borrows);
+
+    // Bytes lógicos: soma dos tamanhos dos arquivos; físicos: blocos reservados
+    FsContentStats content;
+    fs_content_stats(&dir->fs->alloc.content, &content);
+    fprintf(shell->out, "Conteúdo dos arquivos: %llu bytes lógicos, %zu bytes físicos em %zu bloco(s) (%zu comprimido(s))\n",
+           (unsigned long long)__atomic_load_n(&dir->fs->root->totals.bytes, __ATOMIC_RELAXED),
+           content.chunk_bytes, content.chunks, content.packed);
+    fprintf(shell->out, "  armazenamento por conteúdo: %zu bloco(s) (%zu bytes), %llu bloco(s) reaproveitado(s)\n",
+           content.stored, content.stored_bytes, (unsigned long long)content.hits);
+    size_t reclaim_pending, reclaim_done;
+    fs_reclaim_stats(dir->fs, &reclaim_pending, &reclaim_done);
+    fprintf(shell->out, "Subárvores do rm -r: %zu liberada(s), %zu na fila\n", reclaim_done, reclaim_pending);
+    // 'stats' roda com a trava global exclusiva: a lista de nomes está parada
+    size_t inodes, inode_slots, linked = 0;
+    fs_inode_stats(&dir->fs->alloc.inodes, &inodes, &inode_slots);
+    for (const FileLinks *links = dir->fs->links; links; links = links->next)
+        linked++;
+    fprintf(shell->out, "Tabela de inodes: %zu inode(s) em %zu posição(ões), %zu arquivo(s) com mais de um nome\n",
+           inodes, inode_slots, linked);
+
+    fprintf(shell->out, "Latência dos comandos:\n");
+    for (size_t c = 0; c < COMMAND_COUNT; c++)
+    {
+        const CommandStats *cs = &shell->command_stats[c];
+        if (cs->count == 0)
+            continue;
+        char mean[16];
+        format_ns((double)cs->total_ns / cs->count, mean, sizeof(mean));
+        fprintf(shell->out, "  %-10s %llu execução(ões), média %s\n", commands[c].name, (unsigned long long)cs->count, mean);
+
+        uint64_t max = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+            if (cs->buckets[b] > max)
+                max = cs->buckets[b];
+        for (int b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            if (cs->buckets[b] == 0)
+                continue;
+            char lo[16], hi[16];
+            format_ns(b ? (double)(1ULL << (b - 1)) : 0.0, lo, sizeof(lo));
+            format_ns((double)(1ULL << b), hi, sizeof(hi));
+            int bar = (int)((cs->buckets[b] * 30 + max - 1) / max);
+            fprintf(shell->out, "    [%7s, %7s) %8llu  %.*s\n", lo, hi, (unsigned long long)cs->buckets[b],
+                   bar, "##############################");
         }
     }
+    path_lookup_free(&lookup);
+}
+
+static const Command *find_command(const char *name)
+{
+    for (size_t c = 0; c < COMMAND_COUNT; c++)
+        if (strcmp(commands[c].name, name) == 0)
+            return &commands[c];
+    return NULL;
+}
+
+/* ============================================================================= */
+/* --- EXECUÇÃO DOS COMANDOS --- */
+/* ============================================================================= */
+
+static void shell_init(Shell *shell, FileSystem *fs, FILE *out)
+{
+    shell->fs = fs;
+    shell->current_dir = fs->root;
+    shell->interactive = false;
+    shell->running = true;
+    shell->command_stats = (CommandStats *)calloc(COMMAND_COUNT, sizeof(CommandStats));
+    shell->out = out;
+    shell->args = NULL;
+    shell->args_capacity = 0;
+}
+
+static void shell_free(Shell *shell)
+{
+    free(shell->command_stats);
+    free(shell->args);
 }
 
+// O rm -r também roda sozinho: a subárvore sai do pai sem que nenhuma outra
+// sessão esteja lendo ou escrevendo nela. O du só lê os totais guardados,
+// menos com -a e --verify, que percorrem o diretório ou a subárvore.
+static bool command_exclusive(const Command *command, int argc, char **argv)
+{
+    if (command->exclusive)
+        return true;
+    if (command->handler == cmd_rm)
+        return argc > 1 && strcmp(argv[1], "-r") == 0;
+    if (command->handler == cmd_du)
+        for (int a = 1; a < argc; a++)
+            if (strcmp(argv[a], "-a") == 0 || strcmp(argv[a], "--verify") == 0)
+                return true;
+    return false;
+}
 
-void save_fs_image(Directory *root, const char *filename)
+// Executa uma linha lida da entrada. No modo servidor, o comando roda com a
+// trava global (exclusiva para os marcados na tabela) e os registros que ele
+// gerou vão para o log antes de ela ser solta; se o log passar do limite, o
+// checkpoint é feito em seguida, com a trava exclusiva.
+static void run_line(Shell *shell, char *line, size_t line_number)
 {
-    FILE *fp = fopen(filename, "w");
-    if (!fp)
+    line[strcspn(line, "\r\n")] = 0;
+    int n = tokenize(line, &shell->args, &shell->args_capacity);
+    if (n < 0)
+    {
+        fprintf(shell->out, "Linha %zu: aspas sem fechar\n", line_number);
+        return;
+    }
+    if (n == 0)
+        return;
+
+    const Command *command = find_command(shell->args[0]);
+    if (!command)
     {
-        perror("Erro ao abrir imagem para escrita");
+        fprintf(shell->out, "Comando não encontrado: %s\n", shell->args[0]);
+        return;
+    }
+
+    // O 'load' troca shell->fs, mas não roda no modo servidor
+    FileSystem *fs = shell->fs->concurrent ? shell->fs : NULL;
+    if (fs)
+        fs_lock(fs, command_exclusive(command, n, shell->args));
+    uint64_t start = now_ns();
+    fs_clock_begin();
+    command->handler(shell, n, shell->args);
+    fs_clock_end();
+    record_latency(&shell->command_stats[command - commands], now_ns() - start);
+    if (!fs)
         return;
+
+    fs_journal_lock(fs);
+    fs_journal_commit(fs->journal);
+    bool checkpoint_due = fs_journal_checkpoint_due(fs->journal);
+    fs_journal_unlock(fs);
+    fs_unlock(fs);
+    if (checkpoint_due)
+    {
+        fs_lock(fs, true);
+        if (fs_journal_checkpoint_due(fs->journal))
+            fs_journal_checkpoint(fs->journal, false);
+        fs_unlock(fs);
+    }
+}
+
+/* ============================================================================= */
+/* --- MODO SERVIDOR --- */
+/* ============================================================================= */
+
+// Cada conexão no socket é uma sessão, numa thread própria e com o próprio
+// Shell (diretório atual e latências). O protocolo é o do modo em lote: o
+// cliente manda linhas de comando e, depois da saída de cada linha, o servidor
+// manda um byte '\0'.
+
+struct Server;
+
+typedef struct Session {
+    struct Server *server;
+    int fd;
+    struct Session *next;
+} Session;
+
+typedef struct Server {
+    FileSystem *fs;
+    pthread_mutex_t lock;
+    pthread_cond_t idle; // sinalizado quando uma sessão termina
+    Session *sessions;   // sessões abertas
+} Server;
+
+static volatile sig_atomic_t server_stop = 0;
+
+static void server_signal(int sig)
+{
+    (void)sig;
+    server_stop = 1;
+}
+
+static void *session_main(void *arg)
+{
+    Session *session = (Session *)arg;
+    Server *server = session->server;
+    int out_fd = dup(session->fd);
+    FILE *in = fdopen(session->fd, "r");
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+
+    if (in && out)
+    {
+        Shell shell;
+        shell_init(&shell, server->fs, out);
+        directory_pin(shell.current_dir);
+
+        char *line = NULL;
+        size_t line_capacity = 0;
+        size_t line_number = 0;
+        while (shell.running && getline(&line, &line_capacity, in) >= 0)
+        {
+            run_line(&shell, line, ++line_number);
+            fputc('\0', out);
+            if (fflush(out) != 0)
+                break;
+        }
+
+        directory_unpin(shell.current_dir);
+        free(line);
+        shell_free(&shell);
+    }
+
+    // O descritor só é fechado fora da lista, para que o desligamento do
+    // servidor não chame shutdown num descritor já reaproveitado
+    pthread_mutex_lock(&server->lock);
+    for (Session **p = &server->sessions; *p; p = &(*p)->next)
+    {
+        if (*p == session)
+        {
+            *p = session->next;
+            break;
+        }
+    }
+    if (out)
+        fclose(out);
+    else if (out_fd >= 0)
+        close(out_fd);
+    if (in)
+        fclose(in);
+    else
+        close(session->fd);
+    pthread_cond_signal(&server->idle);
+    pthread_mutex_unlock(&server->lock);
+    free(session);
+    return NULL;
+}
+
+// Escuta em 'socket_path' até receber SIGINT ou SIGTERM. Depois espera as
+// sessões abertas terminarem o comando atual e devolve o código de saída.
+static int server_run(FileSystem *fs, const char *socket_path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Caminho do socket muito longo: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // Um socket que sobrou de uma execução anterior é removido; outro arquivo não
+    struct stat st;
+    if (lstat(socket_path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            fprintf(stderr, "%s já existe e não é um socket\n", socket_path);
+            return 1;
+        }
+        unlink(socket_path);
     }
-    fprintf(fp, "%s\n", root->name);
-    if(root->tree) {
-        save_node_to_image_recursive(fp, root->tree->root, 0);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0)
+    {
+        perror("Erro ao abrir o socket");
+        if (listen_fd >= 0)
+            close(listen_fd);
+        return 1;
+    }
+
+    Server server;
+    server.fs = fs;
+    server.sessions = NULL;
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.idle, NULL);
+    fs_set_concurrent(fs);
+
+    // Os sinais ficam bloqueados (e as sessões herdam isso); só o ppoll da
+    // thread principal os recebe, sem a corrida entre testar server_stop e
+    // esperar uma conexão
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // cliente que fechou a conexão: a escrita só falha
+    sigset_t signals, wait_mask;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &wait_mask);
+
+    printf("Servidor escutando em %s\n", socket_path);
+    fflush(stdout);
+
+    int status = 0;
+    while (!server_stop)
+    {
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        if (ppoll(&pfd, 1, NULL, &wait_mask) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Erro ao esperar conexões");
+            status = 1;
+            break;
+        }
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        Session *session = (Session *)malloc(sizeof(Session));
+        session->server = &server;
+        session->fd = fd;
+        pthread_mutex_lock(&server.lock);
+        session->next = server.sessions;
+        server.sessions = session;
+        pthread_mutex_unlock(&server.lock);
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, session_main, session) != 0)
+        {
+            pthread_mutex_lock(&server.lock);
+            server.sessions = session->next;
+            pthread_mutex_unlock(&server.lock);
+            close(fd);
+            free(session);
+            continue;
+        }
+        pthread_detach(thread);
     }
-    fclose(fp);
-}
\ No newline at end of file
+
+    close(listen_fd);
+    unlink(socket_path);
+
+    // Fecha a leitura de cada sessão: elas terminam depois do comando atual
+    pthread_mutex_lock(&server.lock);
+    for (Session *s = server.sessions; s; s = s->next)
+        shutdown(s->fd, SHUT_RDWR);
+    while (server.sessions)
+        pthread_cond_wait(&server.idle, &server.lock);
+    pthread_mutex_unlock(&server.lock);
+
+    pthread_cond_destroy(&server.idle);
+    pthread_mutex_destroy(&server.lock);
+    printf("Servidor encerrado\n");
+    return status;
+}
+
+/* ============================================================================= */
+/* --- PROGRAMA PRINCIPAL --- */
+/* ============================================================================= */
+
+int main(int argc, char *argv[])
+{
+    // -d <diretório>: grava as alterações num journal nesse diretório e
+    //                 recupera o estado salvo lá ao iniciar
+    // -a <política>:   quando atualizar a data de acesso (strict, relatime ou
+    //                 noatime; ver o comando 'atime')
+    // -f <script>:    executa os comandos do arquivo, sem prompt
+    // -s <socket>:    modo servidor: atende várias sessões ao mesmo tempo
+    //                 num socket Unix
+    const char *journal_dir = NULL;
+    const char *script = NULL;
+    const char *socket_path = NULL;
+    AtimePolicy atime_policy = ATIME_RELATIME;
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-a") == 0 && a + 1 < argc && fs_parse_atime_policy(argv[a + 1], &atime_policy))
+        {
+            a++;
+        }
+        else if (strcmp(argv[a], "-d") == 0 && a + 1 < argc)
+        {
+            journal_dir = argv[++a];
+        }
+        else if (strcmp(argv[a], "-f") == 0 && a + 1 < argc && !socket_path)
+        {
+            script = argv[++a];
+        }
+        else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc && !script)
+        {
+            socket_path = argv[++a];
+        }
+        else
+        {
+            fprintf(stderr, "Uso: %s [-a strict|relatime|noatime] [-d <diretório de persistência>] [-f <script> | -s <socket>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *input = stdin;
+    if (script)
+    {
+        input = fopen(script, "r");
+        if (!input)
+        {
+            perror("Erro ao abrir o script");
+            return 1;
+        }
+    }
+
+    FileSystem *fs = journal_dir ? fs_journal_open(journal_dir) : fs_create();
+    if (!fs)
+        return 1;
+    fs->atime_policy = atime_policy;
+
+    if (socket_path)
+    {
+        int status = server_run(fs, socket_path);
+        if (fs->journal)
+            fs_journal_checkpoint(fs->journal, false);
+        fs_destroy(fs);
+        return status;
+    }
+
+    Shell shell;
+    shell_init(&shell, fs, stdout);
+
+    // Sem terminal (script ou pipe): sem prompt, com leitura e escrita em
+    // blocos grandes. O journal é gravado quando o grupo enche e no final,
+    // em vez de a cada comando.
+    shell.interactive = !script && isatty(STDIN_FILENO);
+    if (!shell.interactive)
+    {
+        setvbuf(input, NULL, _IOFBF, BATCH_INPUT_BUFFER);
+        setvbuf(stdout, NULL, _IOFBF, BATCH_OUTPUT_BUFFER);
+    }
+
+    if (shell.interactive)
+        printf("Sistema de Arquivos Simples com Árvore B. Digite 'help' para ajuda.\n");
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    size_t line_number = 0;
+
+    while (shell.running)
+    {
+        if (shell.interactive)
+            print_prompt(shell.current_dir);
+        if (getline(&line, &line_capacity, input) < 0)
+            break;
+        run_line(&shell, line, ++line_number);
+
+        // Group commit: os registros gerados pelo comando vão juntos para o log
+        if (shell.interactive)
+            fs_journal_commit(shell.fs->journal);
+    }
+
+    free(line);
+    shell_free(&shell);
+    if (script)
+        fclose(input);
+
+    // A limpeza da memória é feita aqui, depois que o loop termina.
+    if (shell.fs->journal)
+        fs_journal_checkpoint(shell.fs->journal, false);
+    fs_destroy(shell.fs);
+    if (shell.interactive)
+        printf("Saindo...\n");
+
+    return 0;
+}
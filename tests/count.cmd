@@ -0,0 +1,23 @@
+mkdir d
+count d
+touch d/a.txt
+touch d/ab.txt
+touch d/b.txt
+mkdir d/ab
+mkdir d/ab/x
+count d
+count --prefix ab d
+count --prefix z d
+count --from ab.txt d
+count --from ab.txt --to b.txt d
+count --from b.txt --to ab.txt d
+count --from zzz d
+count d/a*
+count d/*.md
+cd d
+count
+count ab
+rm b.txt
+count
+count /
+count nada
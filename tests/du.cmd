@@ -0,0 +1,30 @@
+du
+mkdir d
+du d
+touch d/a.txt "12345"
+touch d/vazio.txt
+mkdir d/s
+touch d/s/b.txt "abc"
+mkdir d/s/t
+du d
+du -a d
+du -a d/s
+du d/s/t
+du /
+write d/a.txt 5 678
+du d
+ln d/a.txt d/s/l.txt
+du -a d
+cp -r d/s d/s2
+snapshot d/s s3
+du -a d
+write d/s3/b.txt 0 XYZW
+du d
+rm -r d/s
+du -a d
+rm d/a.txt
+du -a d
+du nada
+du d/s2/b.txt
+cd d
+du -a
@@ -0,0 +1,6 @@
+echo
+echo >> vazio.txt
+echo >> vazio.txt
+echo ola mundo >> vazio.txt
+cat vazio.txt
+echo a b c
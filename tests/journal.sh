@@ -0,0 +1,100 @@
+#!/bin/sh
+# Recuperação do journal (-d): as operações abaixo rodam uma vez só em memória,
+# como referência, e outra com -d, que é morta (kill -9) sem o checkpoint da
+# saída. Depois, duas execuções com -d no mesmo diretório precisam mostrar a
+# mesma árvore que a referência, com os mesmos números de inode: a primeira
+# reaplica o log por cima do checkpoint do meio; a segunda lê só os
+# checkpoints (o da saída da primeira inclusive).
+#
+# Uso: sh tests/journal.sh ./fs
+
+FS=${1:-./fs}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# Depois do checkpoint, o log fica com JR_ADD_FILE, JR_CLONE (snapshot e
+# cp -r, com subdiretórios e com arquivos criados antes, o que faz a
+# reaplicação voltar o próximo número de inode), JR_UNSHARE e JR_WRITE dos dois
+# lados de uma cópia, JR_LINK e JR_REMOVE. O último arquivo passa do tamanho
+# de um grupo e faz o log ser gravado antes do fim.
+cat > "$DIR/ops.cmd" <<'EOF'
+mkdir a
+mkdir a/b
+touch a/x.txt "um"
+touch a/b/y.txt "dois"
+ln a/x.txt a/b/l.txt
+checkpoint
+touch a/z.txt "tres"
+touch a/b/w.txt "quatro"
+snapshot a s
+write a/x.txt 0 U
+write a/b/y.txt 4 s
+write s/z.txt 0 T
+ln s/b/w.txt l2.txt
+mkdir c
+cp -r a/b c/b2
+write c/b2/y.txt 0 D
+rm a/z.txt
+EOF
+{
+    printf 'touch grande.txt "'
+    head -c 70000 /dev/zero | tr '\0' g
+    printf '"\n'
+} >> "$DIR/ops.cmd"
+
+# A conferência mostra a árvore, os metadados de cada item pelo caminho e os
+# inodes 2 a 20 (o do arquivo grande fica de fora). No 'stat -i' de um arquivo
+# com vários nomes, o nome mostrado pode ser qualquer um deles: a linha do nome
+# não é comparada.
+{
+    echo "echo ==conferencia=="
+    echo "find /"
+    echo "du -a /a"
+    for f in a a/b a/x.txt a/b/y.txt a/b/l.txt a/b/w.txt s s/b s/x.txt s/z.txt s/b/y.txt s/b/w.txt s/b/l.txt l2.txt \
+             c c/b2 c/b2/y.txt c/b2/w.txt c/b2/l.txt; do
+        echo "stat $f"
+    done
+    echo "echo ==inodes=="
+    i=2
+    while [ $i -le 20 ]; do
+        echo "stat -i $i"
+        i=$((i + 1))
+    done
+} > "$DIR/check.cmd"
+
+conferencia() {
+    sed -E 's/[0-9]{2}-[0-9]{2}-[0-9]{4} [0-9:]{5,8}/<data>/g' | sed -n '/^==conferencia==$/,$p' |
+        sed '/^==inodes==$/,$ { /^  Arquivo: /d; }'
+}
+
+cat "$DIR/ops.cmd" "$DIR/check.cmd" > "$DIR/ref.cmd"
+"$FS" -f "$DIR/ref.cmd" 2>&1 | conferencia > "$DIR/esperado"
+
+# Com a entrada num fifo que continua aberto, o programa fica esperando o
+# próximo comando depois do último, com o log já gravado
+mkfifo "$DIR/entrada"
+"$FS" -d "$DIR/j" < "$DIR/entrada" > /dev/null 2>&1 &
+PID=$!
+exec 3> "$DIR/entrada"
+cat "$DIR/ops.cmd" >&3
+n=0
+while [ "$(wc -c < "$DIR/j/journal.log" 2>/dev/null || echo 0)" -lt 70000 ]; do
+    n=$((n + 1))
+    if [ $n -gt 100 ]; then
+        echo "journal.sh: o log não foi gravado"
+        kill -9 $PID
+        exit 1
+    fi
+    sleep 0.1
+done
+kill -9 $PID
+wait $PID 2> /dev/null
+exec 3>&-
+
+for rodada in log checkpoint; do
+    "$FS" -d "$DIR/j" -f "$DIR/check.cmd" 2>&1 | conferencia > "$DIR/obtido"
+    if ! diff -u "$DIR/esperado" "$DIR/obtido"; then
+        echo "FALHOU: tests/journal.sh (recuperação pelo $rodada)"
+        exit 1
+    fi
+done
@@ -0,0 +1,32 @@
+mkdir d
+touch d/a.txt
+touch d/ab.txt
+touch d/abc.txt
+touch d/b.txt
+touch d/b1.txt
+touch d/c.txt
+mkdir d/ab
+ls d
+ls --prefix ab d
+ls --prefix zz d
+ls --prefix "" d
+ls --from b.txt d
+ls --from b d
+ls --to b.txt d
+ls --from ab.txt --to b1.txt d
+ls --from c.txt --to a.txt d
+ls --from c.txt --to c.txt d
+ls --from zzz d
+ls --prefix ab --from abc d
+ls d/a*
+ls d/?.txt
+ls d/b[0-9].txt
+ls d/[!ab]*
+ls d/*.md
+ls -l --prefix c d
+ls --prefix
+ls --from a d/*.txt
+mkdir vazio
+ls vazio
+ls --prefix a vazio
+ls vazio/*
@@ -0,0 +1,29 @@
+mkdir d
+touch d/a.txt
+touch d/b.txt
+touch d/c.txt
+touch d/d.txt
+touch d/e.txt
+mkdir d/f
+ls --limit 2 d
+ls --limit 0 d
+ls --limit 6 d
+ls --limit 100 d
+ls --offset 2 d
+ls --offset 5 d
+ls --offset 6 d
+ls --offset 100 d
+ls --offset 2 --limit 2 d
+ls --offset 4 --limit 10 d
+ls --after c.txt d
+ls --after c d
+ls --after f d
+ls --after zzz d
+ls --after c.txt --limit 1 d
+ls --prefix d --limit 1 d
+ls --from b.txt --to e.txt --offset 1 --limit 1 d
+ls --offset 1 d/*.txt
+ls --limit -1 d
+ls --limit x d
+ls --offset
+ls -l --offset 5 d
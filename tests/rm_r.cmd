@@ -0,0 +1,20 @@
+mkdir a
+mkdir a/b
+touch a/b/x.txt "x"
+touch a/y.txt "y"
+rm -r /
+rm /
+rm -r /a/..
+rm -r a/b/..
+cd a/b
+rm -r ../../
+rm -r ..
+rm -r .
+rm -r /a
+cd /
+rm -r a/nada
+rm -r a/nada.txt
+rm -r a/y.txt
+rm -r a
+ls
+du /
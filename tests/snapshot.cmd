@@ -0,0 +1,33 @@
+mkdir a
+mkdir a/b
+touch a/b/x.txt "oi"
+snapshot a/b snap
+ls a
+ls /
+cat a/snap/x.txt
+snapshot a/b snap
+snapshot a/b x/y
+snapshot / raiz
+snapshot zz n
+cd a/b
+snapshot . copia
+ls /a
+cd /
+mkdir c
+touch c/y.txt "abc"
+snapshot c c2
+stat c/y.txt
+stat c2/y.txt
+write c/y.txt 0 Z
+stat c/y.txt
+stat c2/y.txt
+write c2/y.txt 0 Q
+stat c/y.txt
+stat c2/y.txt
+stat -i 8
+touch c/k.txt "k"
+snapshot c c3
+rm c/k.txt
+stat -i 11
+rm -r c3
+stat -i 11
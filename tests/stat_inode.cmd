@@ -0,0 +1,9 @@
+mkdir d
+mkdir d/e
+touch d/e/a.txt "x"
+touch d/b.txt "y"
+rm -r d
+stat -i 2
+stat -i 3
+stat -i 4
+stat -i 5
@@ -0,0 +1,6 @@
+stat -i 1
+stat /
+mkdir a
+cd a
+stat ..
+stat -i 0